@@ -0,0 +1,33 @@
+// Boot timing and deep sleep wake stub
+#ifndef _BOOT_H
+#define _BOOT_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+/// debug output is compiled out in fast boot build (build flag FAST_BOOT)
+#ifdef FAST_BOOT
+#define BOOT_DEBUG_ENABLE       false
+#define DEBUG_PRINT(x)
+#define DEBUG_PRINTLN(x)
+#else
+#define BOOT_DEBUG_ENABLE       true
+#define DEBUG_PRINT(x)          Serial.print(x)
+#define DEBUG_PRINTLN(x)        Serial.println(x)
+#endif
+
+/**
+* Function used to record that the first sample after boot is taken. Time from wake up (wake stub entry) or
+* from application start after reset is recorded as boot phase of cycle trace, so it is reported in telemetry
+* also in fast boot build. Only the first call after boot is recorded.
+* @return - no return value
+*/
+void BOOT_markFirstSample();
+/**
+* Function used to schedule next sample by enabling timer wake up.
+* @param sleep_us - time to next sample in microseconds
+* @return - no return value
+*/
+void BOOT_scheduleNextSample(uint64_t sleep_us);
+
+#endif
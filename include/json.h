@@ -6,6 +6,21 @@
 #include "sdu.h"
 #include "ldu.h"
 #include "sensors.h"
+#include <filters.h>
+
+/// Version of cached configuration, it has to be increased when json_config structure changes
+#define JSON_CONFIG_CACHE_VERSION   6
+/// NVS namespace in which parsed configuration is cached
+#define JSON_CONFIG_CACHE_NAMESPACE "config"
+/// Maximum size of configuration file, larger files are rejected
+#define JSON_CONFIG_FILE_SIZE       3072
+/// Number of members of all objects in the largest supported configuration (every tunnel, protocol and
+/// sensor section present, NUMBER_OF_SENSOR_TYPES deadband and filter entries)
+#define JSON_CONFIG_MEMBERS         126
+/// Reserve for strings copied into document and for members not read by firmware
+#define JSON_CONFIG_STRINGS_SIZE    1024
+/// Capacity of json document, it is never smaller than 2 KB document used before configuration cache
+#define JSON_CONFIG_DOC_SIZE        (JSON_OBJECT_SIZE(JSON_CONFIG_MEMBERS) + JSON_CONFIG_STRINGS_SIZE)
 
 // Types of devices in network
 typedef enum {
@@ -32,11 +47,18 @@ typedef struct {
     // WiFi security parameters
     char wifi_ssid[32];
     char wifi_pass[32];
+    // static IP configuration (DHCP is used if ip is empty)
+    char wifi_ip[16];
+    char wifi_gateway[16];
+    char wifi_subnet[16];
+    char wifi_dns[16];
 
     // BG96 parameters
     char apn[32];
     char apn_user[32];
     char apn_password[32];
+    // PSM/eDRX configuration
+    BG96_powerConfig bg96_power;
 
     // type of protocol and server parameters
     PROTOCOL_MODE protocol;
@@ -51,14 +73,46 @@ typedef struct {
     // BLE parameters
     char serv_uuid[40];
     char char_uuid[40];
+    // core address is cached in RTC memory and connected without scan
+    bool ble_fast_connect;
+    // large MTU and fragmented writes without response
+    bool ble_bulk;
+
+    // RS485 parameters, on multi-drop bus unit sends only when core polls it (timeout in milliseconds)
+    uint32_t rs485_baudrate;
+    bool rs485_multidrop;
+    uint32_t rs485_poll_timeout;
+
+    // core accepts readings stored while it was not reachable, sent in one frame (SENSOR_BACKLOG_VALUE_HEADER)
+    bool local_backlog;
 
     // Encryption parameters
     char server_salt[32];
     char server_password[32];
     char ble_password[32];
+    // lifetime of session kept across deep sleep (in seconds)
+    uint32_t session_lifetime;
+
+    // number of readings sent in one packet and maximum age of batch (in seconds)
+    uint8_t batch_size;
+    uint32_t batch_deadline;
+
+    // single readings are sent delta encoded, with keyframe after given number of readings
+    bool compact;
+    uint8_t compact_keyframe_interval;
+
+    // network is joined on one core while sensors are measured on the other
+    bool pipeline;
 
     // Sensor configuration
     sensors_config sc;
+    // Filters applied to readings, indexed by sensor type
+    FLT_config filters[NUMBER_OF_SENSOR_TYPES];
+    // phase timing of previous cycle is appended to reading
+    bool telemetry;
+
+    // parsed configuration is cached in NVS and json is parsed again only when file changes
+    bool config_cache;
 
 } json_config;
 
@@ -70,4 +124,28 @@ typedef struct {
 **/
 bool getJsonConfig(json_config *jc, DynamicJsonDocument *config);
 
+/**
+ * Function that calculates hash of config json file, used to check if cached configuration is still valid
+ * @param json - Content of config json file
+ * @param json_length - Length of content
+ * @return Returns CRC32 of content
+**/
+uint32_t getJsonConfigHash(const char *json, uint16_t json_length);
+
+/**
+ * Function that loads configuration cached by storeJsonConfigCache()
+ * @param jc - Pointer to json_config structure to be loaded
+ * @param hash - Hash of current config json file
+ * @return Returns true if cached configuration exists and it is created from the same file by the same firmware version
+**/
+bool loadJsonConfigCache(json_config *jc, uint32_t hash);
+
+/**
+ * Function that caches parsed configuration in NVS, if caching is disabled in configuration, cached one is erased
+ * @param jc - Pointer to parsed json_config structure
+ * @param hash - Hash of config json file from which configuration is parsed
+ * @return Returns true if configuration is cached
+**/
+bool storeJsonConfigCache(json_config *jc, uint32_t hash);
+
 #endif
\ No newline at end of file
@@ -20,9 +20,13 @@ typedef struct
     char *serv_uuid;
     char *char_uuid;
     char *ble_password;
+    // HMAC key prepared from ble_password once
+    Crypto_HMACKey ble_key;
     
     // RS485 parameters
     uint32_t rs485_baudrate;
+    // address on multi-drop bus, LDU_RS485_NO_ADDRESS in point-to-point mode
+    uint16_t rs485_address;
 
     uint8_t devices_hmac[32];
 } LDU_struct;
@@ -61,12 +65,23 @@ typedef struct
 // LDU sensor headers
 #define SENSOR_MAC_ADDRESS_VALUE_HEADER     0x4D56
 #define SENSOR_DATA_VALUE_HEADER            0x4456
+/// Readings stored while core was not reachable, each one is prefixed with its length
+#define SENSOR_BACKLOG_VALUE_HEADER         0x4256
 
 /// Lengths
 #define SENSOR_MAC_ADDRESS_LENGTH           6
 #define HASH_LENGTH                         32
 #define HEADER_LENGTH                       2
 #define CRC32_LENGTH                        4
+#define RS485_ADDRESS_LENGTH                2
+/// RS485 address in point-to-point mode
+#define LDU_RS485_NO_ADDRESS                0x0000
+/// Time to wait for poll from core on multi-drop bus (in milliseconds)
+#define LDU_DEFAULT_POLL_TIMEOUT            10000
+/// Maximum length of packet, larger frames are fragmented by BLE bulk transfer
+#define LDU_MAX_PACKET_LENGTH               BLE_MAX_FRAME_LENGTH
+/// Maximum length of data in RS485 frame accepted by core (size of its sensor data buffer)
+#define LDU_RS485_MAX_DATA_LENGTH           256
 
 /**
  * Function that enables printing of debug messages for LDU library
@@ -104,6 +119,24 @@ void LDU_setBLEParams(LDU_struct *comm_params, char *serv_uuid, char *char_uuid,
  */
 void LDU_setRS485Params(LDU_struct *comm_params, uint32_t rs485_baudrate);
 
+/**
+ * Function that enables multi-drop RS485 mode, unit sends only when core polls its address and accepts only
+ * responses with its address. Address is the last two bytes of BLE MAC (0x0000 is mapped to 0x0001).
+ * Poll and response frames are: devices hash, header, address (big endian).
+ * @param comm_params - Configuration structure for local communication
+ * @param ble_mac - BLE MAC of unit
+ * @return No return value
+ */
+void LDU_setRS485Address(LDU_struct *comm_params, uint8_t ble_mac[]);
+
+/**
+ * Function that waits until core polls this unit on multi-drop RS485 bus, frames for other units are ignored
+ * @param comm_params - Configuration structure for local communication
+ * @param timeout - Time to wait for poll (in milliseconds)
+ * @return Returns LDU_OK if unit is polled
+ */
+uint8_t LDU_waitForPoll(LDU_struct *comm_params, uint32_t timeout);
+
 /**
  * Function that sets up local communication channel
  * @param comm_params - Configuration structure for local communication
@@ -116,7 +149,7 @@ uint8_t LDU_init(LDU_struct *comm_params);
  * @param comm_params - Configuration structure for local communication
  * @param packet - Buffer that contains data to be sent
  * @param size - Number of bytes that need to be sent
- * @return No return value
+ * @return Returns LDU_OK if frame is sent, BLE_ERROR or RS485_ERROR if channel failed to send it
  */
 uint8_t LDU_send(LDU_struct *comm_params, uint8_t packet[], uint16_t size);
 
@@ -124,8 +157,9 @@ uint8_t LDU_send(LDU_struct *comm_params, uint8_t packet[], uint16_t size);
  * Function that reads recieved data via local communication channel
  * @param comm_params - Configuration structure for local communication
  * @param packet -  Buffer to which data will be written to
- * @param size - ???
- * @return ???
+ * @param size - Size of buffer, updated to number of received bytes (0 if nothing is received)
+ * @param timeout - Maximum waiting time in milliseconds
+ * @return Returns LDU_OK if frame is received, BLE_ERROR or RS485_ERROR on timeout
  */
 uint8_t LDU_recv(LDU_struct *comm_params, char rx_buffer[], uint16_t *size, uint32_t timeout);
 
@@ -134,4 +168,28 @@ uint8_t LDU_sendBLEMAC(LDU_struct *comm_params, uint8_t ble_mac[]);
 
 uint8_t LDU_sendSensorData(LDU_struct *comm_params, uint8_t data[], uint16_t data_length);
 
+/**
+ * Function that returns maximum length of data in one frame on active local link: BLE frame of bulk transfer
+ * negotiated on current connection or one attribute write, RS485 frame accepted by core
+ * @param comm_params - Configuration structure for local communication
+ * @return Maximum length of data, 0 if link is not connected
+ */
+uint16_t LDU_getMaxDataLength(LDU_struct *comm_params);
+
+/**
+ * Function that sends stored readings in one frame, frame longer than BLE packet is sent by bulk transfer
+ * @param comm_params - Configuration structure for local communication
+ * @param data - Readings, each one prefixed with its length
+ * @param data_length - Length of data (at most LDU_getMaxDataLength())
+ * @return Returns LDU_OK if frame is sent
+ */
+uint8_t LDU_sendBacklog(LDU_struct *comm_params, uint8_t data[], uint16_t data_length);
+
+/**
+ * Function that closes local communication channel after the last frame is exchanged (BLE connection is closed)
+ * @param comm_params - Configuration structure for local communication
+ * @return Returns LDU_OK on success
+ */
+uint8_t LDU_close(LDU_struct *comm_params);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+// Sensing and transmitting pipeline running on both cores
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include <Arduino.h>
+#include "sensors.h"
+
+/// Number of preallocated reading buffers passed between stages
+#define PL_POOL_SIZE            2
+/// Stack size of sampling task (in bytes)
+#define PL_SAMPLE_STACK_SIZE    4096
+/// Stack size of radio task, it runs handshake and encryption (in bytes)
+#define PL_RADIO_STACK_SIZE     16384
+/// Core of radio task, the same as WiFi stack
+#define PL_RADIO_CORE           0
+/// Core of sampling task
+#define PL_SAMPLE_CORE          1
+/// Priority of pipeline tasks
+#define PL_TASK_PRIORITY        2
+
+/// Stages of pipeline, each one is called from its task
+typedef struct PL_stages
+{
+    // joins network and starts session, runs on radio core in parallel with sampling
+    void (*associate)(void);
+    // measures sensor values, runs on sampling core
+    void (*sample)(sensor_data *sd);
+    // sends reading, runs on radio core after associate
+    void (*transmit)(sensor_data *sd);
+} PL_stages;
+
+/**
+* Function that runs one pipeline cycle. Radio task associates and starts session while sampling task measures
+* readings, readings are passed to radio task through queue of preallocated buffers. Function returns after
+* all readings are transmitted, so awake time is close to the longest stage instead of sum of stages.
+* @param stages - pipeline stages
+* @param readings - number of readings to be sampled and transmitted (at least 1)
+* @return - true on success, false if tasks could not be started (no pipeline task is running when it returns)
+*/
+bool PL_run(const PL_stages *stages, uint8_t readings);
+
+#endif
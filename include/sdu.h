@@ -35,6 +35,11 @@ typedef struct
     // WIFI
     char *ssid; // ssid in case of usage of wifi connection
     char *pass; // pass in case of usage of wifi connection
+    // BG96
+    char *apn; // access point name in case of usage of BG96 connection
+    char *apn_user; // apn user in case of usage of BG96 connection
+    char *apn_password; // apn password in case of usage of BG96 connection
+    BG96_powerConfig *bg96_power; // PSM/eDRX configuration in case of usage of BG96 connection (can be NULL)
     // UDP
     char *server_IP; // server ip address
     uint16_t port; // port
@@ -43,8 +48,21 @@ typedef struct
     char *personalization_info; // salt for random number generator
     uint8_t *device_mac; // device mac address
     char *BLE_password; // password for ble communication
+    uint32_t session_lifetime; // lifetime of resumed session in seconds (0 disables session resumption)
+    uint8_t batch_size; // number of readings sent in one packet
+    uint32_t batch_deadline; // maximum age of the oldest batched reading in seconds (0 disables deadline)
 } SDU_struct;
 
+/// default lifetime of session kept across deep sleep (in seconds)
+#define SDU_DEFAULT_SESSION_LIFETIME  86400
+
+/// maximum length of raw data sent in one packet (after padding in case of encrypted communication)
+#define SDU_MAX_DATA_LENGTH         1024
+/// maximum number of readings in batch
+#define SDU_MAX_BATCH_SIZE          32
+/// size of RTC memory buffer in which batched readings are kept (MAC is added when batch is sent)
+#define SDU_BATCH_BUFFER_SIZE       1008
+
 /// CRC polynomial value definition
 #define CRC8_DEFAULT_VALUE           0x07
 
@@ -54,6 +72,8 @@ typedef struct
 #define CLIENT_VERIFY_HEADER        0x4356
 #define SENSOR_ENC_DATA_HEADER      0x5345
 #define SENSOR_DATA_HEADER          0x5350
+#define SENSOR_ENC_COMPACT_DATA_HEADER 0x5358
+#define SENSOR_COMPACT_DATA_HEADER  0x5343
 
 // server headers
 #define DATE_UPDATE_HEADER          0x5455
@@ -150,6 +170,13 @@ void SDU_debugPrintError(uint8_t error_code);
 */
 void SDU_init(SDU_struct *comm_params, COMM_MODE mode_of_work, PROTOCOL_MODE type_of_protocol, SERVER_TUNNEL_MODE type_of_tunnel, char server_IP[], uint16_t port, char *hmac_salt, char *password, uint8_t *device_mac);
 /**
+* Function used to join network (WiFi association or BG96 registration) without opening connection to server.
+* It can be called early, so network is ready when first packet is sent. SDU_sendData() and SDU_handshake() call it as well.
+* @param comm_params - pointer to communication structure that will be used
+* @return - error code
+*/
+uint8_t SDU_associate(SDU_struct *comm_params);
+/**
 * Function used to update IV seed according to documentation. Should be called before SDU_handshake() function.
 * @param comm_params - pointer to communication structure that will be used
 * @return - error code
@@ -170,6 +197,20 @@ uint8_t SDU_handshake(SDU_struct *comm_params);
 */
 uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_data_len);
 /**
+* Function used to send readings in compact format (delta encoded), in the same way as SDU_sendData() but with compact data header.
+* If server does not support compact header, it is not used anymore (see SDU_isCompactSupported()).
+* @param comm_params - pointer to communication structure that will be used
+* @param raw_data - pointer to array of bytes to be sent
+* @param raw_data_len - length of bytes to be sent
+* @return - error code
+*/
+uint8_t SDU_sendCompactData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_data_len);
+/**
+* Function used to check if compact format can be used, it is false after server rejected compact header.
+* @return - true if compact format can be used
+*/
+bool SDU_isCompactSupported();
+/**
 * Function used set MQTT parameters in communication. Should be used after SDU_init() function and before SDU_updateIV(), SDU_handshake() and SDU_sendData() functions in case of encrypted communication.
 * @param comm_params - pointer to communication structure that will be used
 * @param client_id - pointer to string that represents client id
@@ -186,6 +227,94 @@ uint8_t SDU_setMQTTparams(SDU_struct *comm_params, char *client_id, char *topic_
 * @return - error code
 */
 uint8_t SDU_setWIFIparams(SDU_struct *comm_params, char *ssid, char *pass);
+/**
+* Function used set BG96 parameters in communication. Should be used after SDU_init() function and before SDU_updateIV(), SDU_handshake() and SDU_sendData() functions.
+* Registration of modem is kept across deep sleep, so it is performed only if modem is not registered anymore.
+* @param comm_params - pointer to communication structure that will be used
+* @param apn - pointer to string that represents access point name
+* @param apn_user - pointer to string that represents APN user
+* @param apn_password - pointer to string that represents APN password
+* @param power - pointer to PSM/eDRX configuration (NULL keeps modem settings)
+* @return - error code
+*/
+uint8_t SDU_setBG96params(SDU_struct *comm_params, char *apn, char *apn_user, char *apn_password, BG96_powerConfig *power);
+/**
+* Function used to set lifetime of session that is kept in RTC memory across deep sleep. Should be used after SDU_init() function.
+* @param comm_params - pointer to communication structure that will be used
+* @param session_lifetime - session lifetime in seconds (0 disables session resumption)
+* @return - error code
+*/
+uint8_t SDU_setSessionLifetime(SDU_struct *comm_params, uint32_t session_lifetime);
+/**
+* Function used to resume session established by SDU_handshake() before deep sleep. If it succeeds, SDU_updateIV() and SDU_handshake() can be skipped.
+* @param comm_params - pointer to communication structure that will be used
+* @return - true if stored session key is valid and not expired, otherwise false
+*/
+bool SDU_resumeSession(SDU_struct *comm_params);
+/**
+* Function used to check whether session key is valid. Session is invalidated when server rejects encrypted data.
+* @return - true if session key can be used, otherwise false
+*/
+bool SDU_isSessionValid();
+/**
+* Function that checks if server response means that it could not use data encrypted with current session key (MAC, integrity
+* or verification failure). Format and length errors are caused by data itself and do not invalidate session.
+* @param response_code - response code sent by server
+* @return - true if session is rejected
+*/
+bool SDU_isSessionRejected(uint8_t response_code);
+/**
+* Function used to invalidate stored session, so next SDU_resumeSession() call fails and new handshake is required.
+* @return - no return value
+*/
+void SDU_invalidateSession();
+/**
+* Function used to set batching of readings. Batched readings are kept in RTC memory and sent in one packet
+* (MAC followed by length prefixed readings) when batch size or deadline is reached.
+* @param comm_params - pointer to communication structure that will be used
+* @param batch_size - number of readings sent in one packet (1 disables batching)
+* @param batch_deadline - maximum age of the oldest reading in batch in seconds (0 disables deadline)
+* @return - error code
+*/
+uint8_t SDU_setBatchParams(SDU_struct *comm_params, uint8_t batch_size, uint32_t batch_deadline);
+/**
+* Function used to add reading to batch. Reading should contain timestamp, since it is sent later.
+* @param comm_params - pointer to communication structure that will be used
+* @param reading - pointer to array of sensor values with headers
+* @param reading_len - length of reading (at most 255 bytes)
+* @return - error code
+*/
+uint8_t SDU_batchAdd(SDU_struct *comm_params, uint8_t *reading, uint16_t reading_len);
+/**
+* Function used to check whether batch should be sent (batch size or deadline is reached or next reading would not fit).
+* @param comm_params - pointer to communication structure that will be used
+* @return - true if batch should be sent
+*/
+bool SDU_batchReady(SDU_struct *comm_params);
+/**
+* Function used to send all batched readings in one packet using SDU_sendData(). Batch is not cleared.
+* @param comm_params - pointer to communication structure that will be used
+* @return - error code
+*/
+uint8_t SDU_sendBatch(SDU_struct *comm_params);
+/**
+* Function used to get reading from batch.
+* @param index - index of reading in batch
+* @param reading - pointer that is set to reading in batch
+* @param reading_len - length of reading
+* @return - true if reading with given index exists
+*/
+bool SDU_batchGet(uint8_t index, uint8_t **reading, uint16_t *reading_len);
+/**
+* Function used to get number of batched readings.
+* @return - number of readings in batch
+*/
+uint8_t SDU_batchCount();
+/**
+* Function used to remove all readings from batch. Should be called after batch is delivered or stored.
+* @return - no return value
+*/
+void SDU_batchClear();
 
 
 // utility functions
@@ -199,7 +328,7 @@ uint8_t SDU_setWIFIparams(SDU_struct *comm_params, char *ssid, char *pass);
 * @param output_length - length of output data (in bytes)
 * @return - error code
 */
-uint8_t SDU_constructPacket(uint8_t *mac, uint16_t header_type, uint8_t *in_data, uint8_t in_data_len, uint8_t *out_data, uint16_t *out_data_len);
+uint8_t SDU_constructPacket(uint8_t *mac, uint16_t header_type, uint8_t *in_data, uint16_t in_data_len, uint8_t *out_data, uint16_t *out_data_len);
 /**
 * Utility function used to parse packet information and returns raw bytes according to documentation.
 * @param input - pointer to bytes of data that stores packet to be parsed
@@ -1,5 +1,6 @@
 #include "BG96.h"
 #include <crypto_utils.h>
+#include <trace.h>
 /*#include "mbedtls/md.h"
 #include "mbedtls/ecdh.h"
 #include "mbedtls/ctr_drbg.h"
@@ -37,50 +38,639 @@ char ca_cert[] = "-----BEGIN CERTIFICATE-----\r\n"\
 
 char password[] = "SecretPassword";
 
-const char* strcheck(const char* X, const char* Y, int  x_length);
+/// AT command queue entry
+typedef struct
+{
+  const char *command;
+  const char *exp_response;
+  uint16_t exp_len;
+  char *response;
+  uint16_t response_size;
+  uint16_t response_len;
+  uint32_t timeout;
+  uint32_t t0;
+  BG96_ATcallback callback;
+  void *arg;
+  // sink for binary payload announced by +QIRD: <len>
+  uint8_t *data;
+  uint16_t data_size;
+  uint16_t data_len;
+  // payload written in one block when prompt (exp_response) arrives, then exp_sent is awaited
+  const uint8_t *payload;
+  uint16_t payload_len;
+  const char *exp_sent;
+  uint32_t sent_timeout;
+} BG96_ATcommand;
+
+/// Result of synchronous AT command
+typedef struct
+{
+  bool done;
+  bool success;
+} BG96_ATresult;
+
+static BG96_ATcommand at_queue[BG96_AT_QUEUE_SIZE];
+static uint8_t at_head = 0;
+static uint8_t at_count = 0;
+static bool at_active = false;
+
+// current line received from modem, used for incremental response matching
+static char at_line[BG96_AT_LINE_SIZE];
+static uint16_t at_line_len = 0;
+// position in current line from which active command response is matched
+static uint16_t at_match_start = 0;
+
+// raw payload streaming state, payload bytes bypass line tokenizer
+static uint8_t *at_raw_dest = NULL;
+static uint16_t at_raw_size = 0;
+static uint16_t *at_raw_len = NULL;
+static uint16_t at_raw_remaining = 0;
+static uint16_t at_raw_discarded = 0;
+static uint8_t *at_raw_done = NULL;
+
+/**
+ * Function that finishes active command and calls its callback
+ * @param success - True if expected response is received
+ */
+static void BG96_ATcomplete(bool success)
+{
+  BG96_ATcommand *cmd = &at_queue[at_head];
+
+  // payload still being streamed to command buffer (timeout) is discarded from now on
+  if (at_raw_remaining && at_raw_len == &cmd->data_len)
+  {
+    at_raw_dest = NULL;
+    at_raw_len = &at_raw_discarded;
+    at_raw_done = NULL;
+  }
 
-bool getBG96response(char command[], char exp_response[], char response[], uint32_t timeout)
+  // payload of failed send command is never written
+  cmd->payload = NULL;
+
+  at_head = (at_head + 1) % BG96_AT_QUEUE_SIZE;
+  at_count--;
+  at_active = false;
+
+  if (cmd->callback)
+    cmd->callback(success, cmd->response, cmd->response_len, cmd->arg);
+}
+
+/**
+ * Function that sends first command from queue if modem is idle
+ */
+static void BG96_ATstartNext()
 {
-  uint8_t count = 0;
-  bool resp_OK = false;
+  if (at_active || at_count == 0)
+    return;
+
+  BG96_ATcommand *cmd = &at_queue[at_head];
+  at_active = true;
+  at_match_start = at_line_len;
+  cmd->t0 = millis();
+  NBIOT_STREAM.print(cmd->command);
+}
 
-  response[0] = '\0';
-  
-  //DEBUG_STREAM.print(command);  
-  NBIOT_STREAM.print(command);
-  
+// unsolicited result codes routed by socket (connect ID) and MQTT client index
+static uint8_t urc_recv_count[BG96_CONNECT_IDS];
+static bool urc_closed[BG96_CONNECT_IDS];
+static uint8_t mqtt_rx_buffer[BG96_MQTT_CLIENTS][BG96_MQTT_RX_SIZE];
+static uint16_t mqtt_rx_len[BG96_MQTT_CLIENTS];
+static uint8_t mqtt_rx_count[BG96_MQTT_CLIENTS];
+// set when pipelined send fails, nothing will be received for that send
+static bool mqtt_send_failed[BG96_MQTT_CLIENTS];
+
+/**
+ * Function that parses unsigned decimal number
+ * @param str - String that contains number
+ * @param len - Length of string
+ * @param pos - Position of first digit, updated to position after last digit
+ * @param value - Parsed value
+ * @return Returns true if at least one digit is parsed
+ */
+static bool BG96_parseUInt(const char *str, uint16_t len, uint16_t *pos, uint16_t *value)
+{
+  uint16_t start = *pos;
+  *value = 0;
+  while (*pos < len && str[*pos] >= '0' && str[*pos] <= '9')
+    *value = *value * 10 + (str[(*pos)++] - '0');
+  return *pos != start;
+}
+
+/**
+ * Function that switches tokenizer to raw mode, next bytes are stored to destination without parsing
+ * @param dest - Destination buffer (can be NULL to discard payload)
+ * @param size - Size of destination buffer, bytes above it are discarded
+ * @param len - Number of bytes stored to destination buffer
+ * @param payload_len - Number of payload bytes announced by modem
+ * @param done - Flag set when the last payload byte is stored (can be NULL)
+ */
+static void BG96_rawStart(uint8_t *dest, uint16_t size, uint16_t *len, uint16_t payload_len, uint8_t *done)
+{
+  at_raw_dest = dest;
+  at_raw_size = size;
+  at_raw_len = len;
+  at_raw_remaining = payload_len;
+  at_raw_done = done;
+  *at_raw_len = 0;
+}
+
+/**
+ * Function that stores one payload byte in raw mode
+ * @param c - Received byte
+ */
+static void BG96_rawFeed(uint8_t c)
+{
+  if (at_raw_dest && *at_raw_len < at_raw_size)
+    at_raw_dest[(*at_raw_len)++] = c;
+  at_raw_remaining--;
+
+  // payload is complete only after its last byte, not when header is parsed
+  if (at_raw_remaining == 0 && at_raw_done)
+  {
+    *at_raw_done = 1;
+    at_raw_done = NULL;
+  }
+}
+
+/**
+ * Function that parses +QMTRECV: <client_idx>,<msgID>,"<topic>",<payload_len>," header
+ * (reported when modem is configured with AT+QMTCFG="recv/mode",0,0,1) and starts payload streaming
+ * @param line - Part of line received so far, ends with opening quote of payload
+ * @param len - Length of line
+ * @return Returns true if payload streaming is started
+ */
+static bool BG96_URCmqttRecvHeader(const char *line, uint16_t len)
+{
+  uint16_t pos = 10, client_idx, msg_id, payload_len;
+
+  if (!BG96_parseUInt(line, len, &pos, &client_idx) || client_idx >= BG96_MQTT_CLIENTS)
+    return false;
+  if (pos >= len || line[pos++] != ',' || !BG96_parseUInt(line, len, &pos, &msg_id))
+    return false;
+  if (pos + 1 >= len || line[pos++] != ',' || line[pos++] != '"')
+    return false;
+
+  while (pos < len && line[pos] != '"')
+    pos++;
+  pos++;
+  if (pos >= len || line[pos++] != ',' || !BG96_parseUInt(line, len, &pos, &payload_len))
+    return false;
+  if (pos + 2 != len || line[pos] != ',' || line[pos + 1] != '"' || payload_len == 0)
+    return false;
+
+  BG96_rawStart(mqtt_rx_buffer[client_idx], BG96_MQTT_RX_SIZE, &mqtt_rx_len[client_idx], payload_len, &mqtt_rx_count[client_idx]);
+  return true;
+}
+
+/**
+ * Function that parses +QMTRECV: <client_idx>,<msgID>,"<topic>","<payload>" and stores payload
+ * @param line - Line received from modem
+ * @param len - Length of line
+ */
+static void BG96_URCmqttRecv(const char *line, uint16_t len)
+{
+  uint16_t pos = 10, client_idx, msg_id;
+
+  if (!BG96_parseUInt(line, len, &pos, &client_idx) || client_idx >= BG96_MQTT_CLIENTS)
+    return;
+  if (pos >= len || line[pos++] != ',' || !BG96_parseUInt(line, len, &pos, &msg_id))
+    return;
+  if (pos + 1 >= len || line[pos++] != ',' || line[pos++] != '"')
+    return;
+
+  // skip topic
+  while (pos < len && line[pos] != '"')
+    pos++;
+  pos++;
+  if (pos + 1 >= len || line[pos++] != ',' || line[pos++] != '"')
+    return;
+
+  // payload ends with the last quote in line
+  uint16_t end = len;
+  while (end > pos && line[end - 1] != '"')
+    end--;
+  if (end == pos)
+    return;
+  end--;
+
+  uint16_t payload_len = end - pos;
+  if (payload_len > BG96_MQTT_RX_SIZE)
+    payload_len = BG96_MQTT_RX_SIZE;
+
+  memcpy(mqtt_rx_buffer[client_idx], line + pos, payload_len);
+  mqtt_rx_len[client_idx] = payload_len;
+  mqtt_rx_count[client_idx] = 1;
+}
+
+/**
+ * Function that dispatches unsolicited result codes to socket and MQTT client state
+ * @param line - Line received from modem
+ * @param len - Length of line
+ */
+static void BG96_URCdispatch(const char *line, uint16_t len)
+{
+  uint16_t pos, connect_id;
+
+  if (len > 15 && memcmp(line, "+QIURC: \"recv\",", 15) == 0)
+  {
+    pos = 15;
+    if (BG96_parseUInt(line, len, &pos, &connect_id) && connect_id < BG96_CONNECT_IDS && urc_recv_count[connect_id] < 0xff)
+      urc_recv_count[connect_id]++;
+  }
+  else if (len > 17 && memcmp(line, "+QIURC: \"closed\",", 17) == 0)
+  {
+    pos = 17;
+    if (BG96_parseUInt(line, len, &pos, &connect_id) && connect_id < BG96_CONNECT_IDS)
+      urc_closed[connect_id] = true;
+  }
+  else if (len > 10 && memcmp(line, "+QMTRECV: ", 10) == 0)
+  {
+    BG96_URCmqttRecv(line, len);
+  }
+}
+
+/**
+ * Function that processes modem output until URC counter becomes non-zero
+ * @param counter - Counter incremented by URC dispatcher
+ * @param closed - Flag that stops waiting if connection is closed (can be NULL)
+ * @param timeout - Maximum waiting time in milliseconds
+ * @return Returns true if URC is received, counter is decremented
+ */
+static bool BG96_waitForURC(uint8_t *counter, bool *closed, uint32_t timeout)
+{
   uint32_t t0 = millis();
-  while ((millis() - t0) < timeout)
+  while (*counter == 0)
   {
-    if (NBIOT_STREAM.available())
-    {
-      response[count] = NBIOT_STREAM.read();
-      DEBUG_STREAM.write(response[count]);
-      response[++count] = '\0';
-    }
-    if (strcheck(response, exp_response, count))
-    {
-      resp_OK = true;
+    BG96_ATprocess();
+    if (*counter != 0)
       break;
+    if ((closed && *closed) || (millis() - t0) >= timeout)
+      return false;
+    if (!NBIOT_STREAM.available())
+      delay(1);
+  }
+  (*counter)--;
+  return true;
+}
+
+/**
+ * Function that checks if line is final result code that reports error
+ * @param line - Line received from modem
+ * @param len - Length of line
+ * @return Returns true if line reports error
+ */
+static bool BG96_ATisError(const char *line, uint16_t len)
+{
+  if (len >= 5 && memcmp(line, "ERROR", 5) == 0)
+    return true;
+  if (len >= 10 && (memcmp(line, "+CME ERROR", 10) == 0 || memcmp(line, "+CMS ERROR", 10) == 0))
+    return true;
+  if (len >= 9 && memcmp(line, "SEND FAIL", 9) == 0)
+    return true;
+  return false;
+}
+
+/**
+ * Function that writes payload of active command after prompt is received and
+ * switches command to waiting for send confirmation
+ * @param cmd - Active command
+ */
+static void BG96_ATwritePayload(BG96_ATcommand *cmd)
+{
+  NBIOT_STREAM.write(cmd->payload, cmd->payload_len);
+
+  cmd->payload = NULL;
+  cmd->exp_response = cmd->exp_sent;
+  cmd->exp_len = strlen(cmd->exp_sent);
+  cmd->timeout = cmd->sent_timeout;
+  cmd->t0 = millis();
+  at_match_start = at_line_len;
+}
+
+/**
+ * Function that feeds one received byte to line tokenizer and completes active command
+ * when expected response or error result code is received
+ * @param c - Received byte
+ */
+static void BG96_ATfeed(char c)
+{
+  BG96_ATcommand *cmd = at_active ? &at_queue[at_head] : NULL;
+
+  if (at_raw_remaining)
+  {
+    BG96_rawFeed(c);
+    return;
+  }
+
+#ifndef FAST_BOOT
+  DEBUG_STREAM.write(c);
+#endif
+
+  if (cmd && cmd->response && cmd->response_len < cmd->response_size - 1)
+  {
+    cmd->response[cmd->response_len++] = c;
+    cmd->response[cmd->response_len] = '\0';
+  }
+
+  if (c == '\n')
+  {
+    BG96_URCdispatch(at_line, at_line_len);
+    if (cmd && BG96_ATisError(at_line, at_line_len))
+      BG96_ATcomplete(false);
+    // +QIRD: <len>[,...] is followed by exactly <len> payload bytes
+    else if (cmd && cmd->data && at_line_len > 7 && memcmp(at_line, "+QIRD: ", 7) == 0)
+    {
+      uint16_t pos = 7, payload_len;
+      if (BG96_parseUInt(at_line, at_line_len, &pos, &payload_len) && payload_len > 0)
+        BG96_rawStart(cmd->data, cmd->data_size, &cmd->data_len, payload_len, NULL);
     }
+    at_line_len = 0;
+    at_match_start = 0;
+    return;
   }
 
-  delay(200);
-  
+  if (c == '\r')
+    return;
+
+  // keep the end of line if it is too long, it is enough for matching
+  if (at_line_len == BG96_AT_LINE_SIZE)
+  {
+    uint16_t shift = BG96_AT_LINE_SIZE / 2;
+    memmove(at_line, at_line + shift, BG96_AT_LINE_SIZE - shift);
+    at_line_len -= shift;
+    at_match_start = (at_match_start > shift) ? at_match_start - shift : 0;
+  }
+  at_line[at_line_len++] = c;
+
+  // length prefixed MQTT payload can contain any byte, so it is streamed before line ends
+  if (c == '"' && at_line_len > 10 && memcmp(at_line, "+QMTRECV: ", 10) == 0 && BG96_URCmqttRecvHeader(at_line, at_line_len))
+  {
+    at_line_len = 0;
+    at_match_start = 0;
+    return;
+  }
+
+  // only the end of line can complete the match, so check is done in constant time per byte
+  if (cmd && cmd->exp_len && at_line_len - at_match_start >= cmd->exp_len &&
+      c == cmd->exp_response[cmd->exp_len - 1] &&
+      memcmp(at_line + at_line_len - cmd->exp_len, cmd->exp_response, cmd->exp_len) == 0)
+  {
+    if (cmd->payload)
+      BG96_ATwritePayload(cmd);
+    else
+      BG96_ATcomplete(true);
+  }
+}
+
+/**
+ * Function that adds command to queue without sending it
+ * @return Returns pointer to queued command or NULL if queue is full
+ */
+static BG96_ATcommand *BG96_ATqueue(const char *command, const char *exp_response, char *response, uint16_t response_size, uint32_t timeout, BG96_ATcallback callback, void *arg)
+{
+  if (at_count == BG96_AT_QUEUE_SIZE)
+    return NULL;
+
+  BG96_ATcommand *cmd = &at_queue[(at_head + at_count) % BG96_AT_QUEUE_SIZE];
+  cmd->command = command;
+  cmd->exp_response = exp_response;
+  cmd->exp_len = strlen(exp_response);
+  cmd->response = (response_size > 0) ? response : NULL;
+  cmd->response_size = response_size;
+  cmd->response_len = 0;
+  cmd->timeout = timeout;
+  cmd->callback = callback;
+  cmd->arg = arg;
+  cmd->data = NULL;
+  cmd->data_size = 0;
+  cmd->data_len = 0;
+  cmd->payload = NULL;
+  if (cmd->response)
+    cmd->response[0] = '\0';
+  at_count++;
+
+  return cmd;
+}
+
+bool BG96_ATsubmit(const char *command, const char *exp_response, char *response, uint16_t response_size, uint32_t timeout, BG96_ATcallback callback, void *arg)
+{
+  if (!BG96_ATqueue(command, exp_response, response, response_size, timeout, callback, arg))
+    return false;
+
+  BG96_ATstartNext();
+  return true;
+}
+
+uint8_t BG96_ATprocess()
+{
   while (NBIOT_STREAM.available())
-  { 
-    response[count] = NBIOT_STREAM.read();
-    DEBUG_STREAM.write(response[count]);
-    response[++count] = '\0';
+  {
+    BG96_ATfeed(NBIOT_STREAM.read());
+    BG96_ATstartNext();
+  }
+
+  if (at_active && (millis() - at_queue[at_head].t0) >= at_queue[at_head].timeout)
+    BG96_ATcomplete(false);
+
+  BG96_ATstartNext();
+  return at_count;
+}
+
+bool BG96_ATwaitIdle(uint32_t timeout)
+{
+  uint32_t t0 = millis();
+  while (BG96_ATprocess() != 0)
+  {
+    if ((millis() - t0) >= timeout)
+      return false;
+    // yield CPU while modem is working
+    if (!NBIOT_STREAM.available())
+      delay(1);
+  }
+  return true;
+}
+
+/**
+ * Completion callback used by synchronous AT commands
+ */
+static void BG96_ATsyncCallback(bool success, char *response, uint16_t response_len, void *arg)
+{
+  BG96_ATresult *result = (BG96_ATresult *)arg;
+  result->success = success;
+  result->done = true;
+}
+
+bool getBG96response(const char command[], const char exp_response[], char response[], uint16_t response_size, uint32_t timeout)
+{
+  BG96_ATresult result = {false, false};
+
+  if (!BG96_ATsubmit(command, exp_response, response, response_size, timeout, BG96_ATsyncCallback, &result))
+    return false;
+
+  // command returns as soon as expected response or error arrives
+  while (!result.done)
+  {
+    BG96_ATprocess();
+    if (!result.done && !NBIOT_STREAM.available())
+      delay(1);
   }
+#ifndef FAST_BOOT
   DEBUG_STREAM.print("\r\n");
-  
-  return resp_OK;
+#endif
+
+  return result.success;
+}
+
+/**
+ * Completion callback of pipelined send, failure is recorded in flag given as argument
+ */
+static void BG96_sendCallback(bool success, char *response, uint16_t response_len, void *arg)
+{
+  if (!success)
+    *(bool *)arg = true;
+}
+
+/**
+ * Function that sends send command (AT+QISEND, AT+QMTPUB), waits for prompt and writes whole payload
+ * in one block. Confirmation is not awaited, it is processed by engine while next commands are queued
+ * @param command - Send command
+ * @param payload - Payload to be sent
+ * @param len - Length of payload
+ * @param exp_sent - Response that confirms that payload is sent
+ * @param failed - Flag set if payload is not confirmed, it stays set until connection is reopened
+ * @return Returns true if payload is written to modem
+ */
+static bool getBG96prompt(const char command[], const uint8_t *payload, uint16_t len, const char exp_sent[], bool *failed)
+{
+  BG96_ATcommand *cmd;
+
+  // previous send that is still waiting for confirmation keeps its queue slot
+  cmd = BG96_ATqueue(command, ">", NULL, 0, 3000, BG96_sendCallback, failed);
+  if (!cmd)
+    return false;
+  cmd->payload = payload;
+  cmd->payload_len = len;
+  cmd->exp_sent = exp_sent;
+  cmd->sent_timeout = 10000;
+
+  // payload and command must be valid until prompt arrives or command fails
+  BG96_ATstartNext();
+  while (cmd->payload)
+  {
+    BG96_ATprocess();
+    if (cmd->payload && !NBIOT_STREAM.available())
+      delay(1);
+  }
+  return !*failed;
+}
+
+/**
+ * Function that sends read command (AT+QIRD) and streams announced payload directly to output buffer
+ * @param command - Read command
+ * @param output - Buffer to which payload is written
+ * @param output_len - Size of output buffer, updated to number of received payload bytes
+ * @param timeout - Command timeout in milliseconds
+ * @return Returns true on success
+ */
+bool getBG96data(const char command[], uint8_t *output, uint16_t *output_len, uint32_t timeout)
+{
+  BG96_ATresult result = {false, false};
+  char response[64];
+
+  BG96_ATcommand *cmd = BG96_ATqueue(command, "OK", response, sizeof(response), timeout, BG96_ATsyncCallback, &result);
+  if (!cmd)
+    return false;
+  cmd->data = output;
+  cmd->data_size = *output_len;
+
+  BG96_ATstartNext();
+  while (!result.done)
+  {
+    BG96_ATprocess();
+    if (!result.done && !NBIOT_STREAM.available())
+      delay(1);
+  }
+#ifndef FAST_BOOT
+  DEBUG_STREAM.print("\r\n");
+#endif
+
+  *output_len = cmd->data_len;
+  return result.success;
+}
+
+// registration state kept across deep sleep, modem stays registered in PSM/eDRX
+RTC_DATA_ATTR bool bg96_registered = false;
+// set when modem is checked (or registered) after current wake up
+static bool bg96_ready = false;
+
+/**
+ * Function that starts UART used for communication with modem
+ */
+static void BG96_beginUART()
+{
+  // UART driver fills RX ring buffer from interrupt, it must fit the largest modem response
+  NBIOT_STREAM.setRxBufferSize(BG96_RX_BUFFER_SIZE);
+  NBIOT_STREAM.begin(115200, SERIAL_8N1, U2RXD, U2TXD);
+}
+
+/**
+ * Function that encodes timer value as 3GPP GPRS timer (3 bits of unit and 5 bits of value).
+ * Smallest unit that can represent requested time is used, value is rounded up.
+ * @param seconds - Requested time in seconds
+ * @param units - Units in seconds in ascending order
+ * @param codes - Unit codes that correspond to units
+ * @param units_num - Number of units
+ * @param output - Output string with 8 binary digits
+ */
+static void BG96_encodeTimer(uint32_t seconds, const uint32_t *units, const uint8_t *codes, uint8_t units_num, char output[9])
+{
+  uint8_t code = codes[units_num - 1];
+  uint32_t value = 31;
+
+  for (uint8_t i = 0; i < units_num; i++)
+  {
+    uint32_t v = (seconds + units[i] - 1) / units[i];
+    if (v <= 31)
+    {
+      code = codes[i];
+      value = v;
+      break;
+    }
+  }
+
+  uint8_t timer = (code << 5) | value;
+  for (uint8_t i = 0; i < 8; i++)
+    output[i] = (timer & (0x80 >> i)) ? '1' : '0';
+  output[8] = '\0';
+}
+
+/**
+ * Function that checks if modem is registered to network and PDP context is active
+ * @return Returns true if registered
+ */
+static bool BG96_checkRegistration()
+{
+  char response[128];
+
+  if (!getBG96response("AT+CEREG?\r\n", "OK", response, sizeof(response), 1000))
+    return false;
+  // +CEREG: <n>,<stat>, stat 1 - home network, 5 - roaming
+  char *stat = strstr(response, "+CEREG: ");
+  if (!stat || !(stat = strchr(stat, ',')) || (stat[1] != '1' && stat[1] != '5'))
+    return false;
+
+  if (!getBG96response("AT+QIACT?\r\n", "OK", response, sizeof(response), 1000))
+    return false;
+  // +QIACT: <contextID>,<context_state>,...
+  return strstr(response, "+QIACT: 1,1") != NULL;
 }
 
 bool BG96_turnOn()
 {
-  Serial2.begin(115200, SERIAL_8N1, U2RXD, U2TXD);
+  bg96_registered = false;
+  bg96_ready = false;
+
+  BG96_beginUART();
 
   //turn on BG96
   DEBUG_STREAM.print("BG96 reset...");
@@ -92,7 +682,7 @@ bool BG96_turnOn()
   
   char response[256];
   //  check FW version
-  if (getBG96response("", "APP RDY", response, 8000))
+  if (getBG96response("", "APP RDY", response, sizeof(response), 8000))
     return true;
   return false;
 }
@@ -100,51 +690,50 @@ bool BG96_turnOn()
 bool BG96_nwkRegister(char *apn, char *apn_user, char *apn_password)
 {
   char response[256];
-  if (!getBG96response("AT+GMR\r\n", "OK", response, 1000))
+  if (!getBG96response("AT+GMR\r\n", "OK", response, sizeof(response), 1000))
     return false;
    
   //Switch the modem to minimum functionality
-  if (!getBG96response("AT+CFUN=0,0\r\n", "OK", response, 5000))
+  if (!getBG96response("AT+CFUN=0,0\r\n", "OK", response, sizeof(response), 5000))
     return false;
 
   // Verbose Error Reporting to get understandable error reporting (optional)
-  if (!getBG96response("AT+CMEE=2\r\n", "OK", response, 5000))
+  if (!getBG96response("AT+CMEE=2\r\n", "OK", response, sizeof(response), 5000))
     return false;
 
   //scan sequence: first NB-IoT, then GSM
-  if (!getBG96response("AT+QCFG=\"nwscanseq\",0301,1\r\n", "OK", response, 1000))
+  if (!getBG96response("AT+QCFG=\"nwscanseq\",0301,1\r\n", "OK", response, sizeof(response), 1000))
     return false;
   //Automatic (GSM and LTE)
-  if (!getBG96response("AT+QCFG=\"nwscanmode\",0,1\r\n", "OK", response, 1000))
+  if (!getBG96response("AT+QCFG=\"nwscanmode\",0,1\r\n", "OK", response, sizeof(response), 1000))
     return false;
   //Network category to be searched under LTE RAT: eMTC and NB-IoT
-  if (!getBG96response("AT+QCFG=\"iotopmode\",2,1\r\n", "OK", response, 1000))
+  if (!getBG96response("AT+QCFG=\"iotopmode\",2,1\r\n", "OK", response, sizeof(response), 1000))
     return false;
 
   //  turn on full module functionality
-  if (!getBG96response("AT+CFUN=1,0\r\n", "OK", response, 5000))
+  if (!getBG96response("AT+CFUN=1,0\r\n", "OK", response, sizeof(response), 5000))
     return false;
 
   //  check IMSI
-  char IMSI[20];
-  if (!getBG96response("AT+CIMI\r\n", "OK", response, 2000))
+  if (!getBG96response("AT+CIMI\r\n", "OK", response, sizeof(response), 2000))
     return false;
 
 //  //set APN
-//  if (!getBG96response("AT+CGDCONT=1,\"IP\",\"VIP.IOT\"\r\n", "OK", response, 3000))
+//  if (!getBG96response("AT+CGDCONT=1,\"IP\",\"VIP.IOT\"\r\n", "OK", response, sizeof(response), 3000))
 //    return false;
 
   
   //  error reporting
-  if (!getBG96response("AT+CMEE=1\r\n", "OK", response, 10000))
+  if (!getBG96response("AT+CMEE=1\r\n", "OK", response, sizeof(response), 10000))
     return false;
   
   //  automatically report network registration status
-  if (!getBG96response("AT+CEREG=1\r\n", "OK", response, 3000))
+  if (!getBG96response("AT+CEREG=1\r\n", "OK", response, sizeof(response), 3000))
     return false;
 
   // connect
-  if (!getBG96response("AT+COPS=0\r\n", "OK", response, 5000))
+  if (!getBG96response("AT+COPS=0\r\n", "OK", response, sizeof(response), 5000))
     return false;
 
   //polling the network registration status
@@ -152,7 +741,7 @@ bool BG96_nwkRegister(char *apn, char *apn_user, char *apn_password)
   uint8_t attempt_cnt = 0; 
   do 
   {
-    reg_ok = getBG96response("AT+CGATT?\r\n", "+CGATT: 1", response, 5000);
+    reg_ok = getBG96response("AT+CGATT?\r\n", "+CGATT: 1", response, sizeof(response), 5000);
     if (!reg_ok)
     {
       if (++attempt_cnt == 30)
@@ -160,68 +749,174 @@ bool BG96_nwkRegister(char *apn, char *apn_user, char *apn_password)
     }
   } while (!reg_ok);
 
-  getBG96response("AT+CSQ\r\n", "OK", response, 3000);
-  getBG96response("AT+CCLK?\r\n", "OK", response, 3000);
+  getBG96response("AT+CSQ\r\n", "OK", response, sizeof(response), 3000);
+  getBG96response("AT+CCLK?\r\n", "OK", response, sizeof(response), 3000);
 
     char cmd[128];
   sprintf(cmd, "AT+QICSGP=1,1,\"%s\",\"%s\",\"%s\",1\r\n", apn, apn_user, apn_password);
-  if (!getBG96response(cmd, "OK", response, 3000))
+  if (!getBG96response(cmd, "OK", response, sizeof(response), 3000))
     return false;
 
-  if (!getBG96response("AT+QIACT=1\r\n", "OK", response, 3000))
+  if (!getBG96response("AT+QIACT=1\r\n", "OK", response, sizeof(response), 3000))
     return false;
 
-  if (!getBG96response("AT+QIACT?\r\n", "OK", response, 5000))
+  if (!getBG96response("AT+QIACT?\r\n", "OK", response, sizeof(response), 5000))
     return false;
   
+  bg96_registered = true;
+  bg96_ready = true;
+  return true;
+}
+
+bool BG96_setPowerSaving(BG96_powerConfig *power)
+{
+  char response[64], cmd[64];
+
+  if (power->psm_enable)
+  {
+    // T3412 extended (periodic TAU): 2 s, 30 s, 1 min, 10 min, 1 h, 10 h, 320 h
+    static const uint32_t tau_units[] = {2, 30, 60, 600, 3600, 36000, 1152000};
+    static const uint8_t tau_codes[] = {0x03, 0x04, 0x05, 0x00, 0x01, 0x02, 0x06};
+    // T3324 (active time): 2 s, 1 min, 6 min
+    static const uint32_t active_units[] = {2, 60, 360};
+    static const uint8_t active_codes[] = {0x00, 0x01, 0x02};
+    char tau[9], active_time[9];
+
+    BG96_encodeTimer(power->psm_tau, tau_units, tau_codes, sizeof(tau_units) / sizeof(tau_units[0]), tau);
+    BG96_encodeTimer(power->psm_active_time, active_units, active_codes, sizeof(active_units) / sizeof(active_units[0]), active_time);
+    sprintf(cmd, "AT+CPSMS=1,,,\"%s\",\"%s\"\r\n", tau, active_time);
+  }
+  else
+    sprintf(cmd, "AT+CPSMS=0\r\n");
+
+  if (!getBG96response(cmd, "OK", response, sizeof(response), 1000))
+    return false;
+
+  if (power->edrx_enable)
+  {
+    char cycle[5];
+    for (uint8_t i = 0; i < 4; i++)
+      cycle[i] = (power->edrx_cycle & (0x08 >> i)) ? '1' : '0';
+    cycle[4] = '\0';
+    sprintf(cmd, "AT+CEDRXS=1,%d,\"%s\"\r\n", power->edrx_act_type, cycle);
+  }
+  else
+    sprintf(cmd, "AT+CEDRXS=0\r\n");
+
+  if (!getBG96response(cmd, "OK", response, sizeof(response), 1000))
+    return false;
+
   return true;
 }
 
+bool BG96_wake()
+{
+  char response[64];
+
+  BG96_beginUART();
+
+  if (!bg96_registered)
+    return false;
+
+  // modem in eDRX (or still in active time) answers immediately
+  bool awake = getBG96response("AT\r\n", "OK", response, sizeof(response), 300);
+  if (!awake)
+  {
+    // short PWRKEY pulse wakes modem from PSM
+    pinMode(BG96_PWRKEY, OUTPUT);
+    digitalWrite(BG96_PWRKEY, HIGH);
+    delay(BG96_PSM_WAKE_PULSE);
+    digitalWrite(BG96_PWRKEY, LOW);
+
+    for (uint8_t i = 0; i < 5 && !awake; i++)
+      awake = getBG96response("AT\r\n", "OK", response, sizeof(response), 1000);
+  }
+
+  // registration and PDP context are kept in PSM, so only state is checked
+  if (!awake || !BG96_checkRegistration())
+  {
+    bg96_registered = false;
+    return false;
+  }
+
+  bg96_ready = true;
+  return true;
+}
+
+bool BG96_isRegistered()
+{
+  return bg96_registered;
+}
+
+bool BG96_attach(char *apn, char *apn_user, char *apn_password, BG96_powerConfig *power)
+{
+  bool ret;
+
+  if (bg96_ready)
+    return true;
+
+  TRC_begin(TRC_BG96_ATTACH);
+  if (BG96_wake())
+    ret = true;
+  else if (!BG96_turnOn())
+    ret = false;
+  else
+  {
+    // timers are stored by modem and requested from network during registration
+    if (power && !BG96_setPowerSaving(power))
+      DEBUG_STREAM.println("BG96 power saving configuration failed");
+
+    ret = BG96_nwkRegister(apn, apn_user, apn_password);
+  }
+  TRC_end(TRC_BG96_ATTACH);
+
+  return ret;
+}
+
 bool BG96_TxRxUDP(char payload[], char server_IP[], uint16_t port)
 {
   char response[256], cmd[128];
 
-  if (!getBG96response("AT+QIOPEN=1,2,\"UDP SERVICE\",\"127.0.0.1\",0,3030,0\r\n", "+QIOPEN: 2,0", response, 5000))
+  if (!getBG96response("AT+QIOPEN=1,2,\"UDP SERVICE\",\"127.0.0.1\",0,3030,0\r\n", "+QIOPEN: 2,0", response, sizeof(response), 5000))
     return false;
 
-  if (!getBG96response("AT+QISTATE=0,1\r\n", "OK", response, 3000))
+  if (!getBG96response("AT+QISTATE=0,1\r\n", "OK", response, sizeof(response), 3000))
     return false;
 
-  sprintf(cmd, "AT+QISEND=2,%d,\"%s\",%d\r\n", strlen(payload), server_IP, port);
-  getBG96response(cmd, ">", response, 3000);
-  getBG96response(payload, "+QIURC: \"recv\",2", response, 10000);
+  sprintf(cmd, "AT+QISEND=2,%d,\"%s\",%d\r\n", (int)strlen(payload), server_IP, port);
+  getBG96response(cmd, ">", response, sizeof(response), 3000);
+  getBG96response(payload, "+QIURC: \"recv\",2", response, sizeof(response), 10000);
 
-  if (!getBG96response("AT+QIRD=2\r\n", "OK", response, 5000))
+  if (!getBG96response("AT+QIRD=2\r\n", "OK", response, sizeof(response), 5000))
     return false;
 
-  if (!getBG96response("AT+QICLOSE=2\r\n", "OK", response, 3000))
+  if (!getBG96response("AT+QICLOSE=2\r\n", "OK", response, sizeof(response), 3000))
     return false;
   return true;
 }
 
-bool BG96_TxRxSensorData(char server_IP[], uint16_t port, uint8_t payload[], uint8_t len)
+bool BG96_TxRxSensorData(char server_IP[], uint16_t port, uint8_t payload[], uint16_t len)
 {
   char response[256], cmd[128];
 
-  if (!getBG96response("AT+QIOPEN=1,2,\"UDP SERVICE\",\"127.0.0.1\",0,3030,0\r\n", "+QIOPEN: 2,0", response, 5000))
+  if (!getBG96response("AT+QIOPEN=1,2,\"UDP SERVICE\",\"127.0.0.1\",0,3030,0\r\n", "+QIOPEN: 2,0", response, sizeof(response), 5000))
     return false;
 
-  if (!getBG96response("AT+QISTATE=0,1\r\n", "OK", response, 3000))
+  if (!getBG96response("AT+QISTATE=0,1\r\n", "OK", response, sizeof(response), 3000))
     return false;
 
   sprintf(cmd, "AT+QISEND=2,%d,\"%s\",%d\r\n", len, server_IP, port);
-  getBG96response(cmd, ">", response, 3000);
+  getBG96response(cmd, ">", response, sizeof(response), 3000);
 
-  for (uint8_t i = 0; i < len; i++)
-    NBIOT_STREAM.write(payload[i]);
+  NBIOT_STREAM.write(payload, len);
   
-  //getBG96response("", "+QIURC: \"recv\",2", response, 10000);
-  getBG96response("", "SEND OK", response, 10000);
+  //getBG96response("", "+QIURC: \"recv\",2", response, sizeof(response), 10000);
+  getBG96response("", "SEND OK", response, sizeof(response), 10000);
 
-  if (!getBG96response("AT+QIRD=2\r\n", "OK", response, 5000))
+  if (!getBG96response("AT+QIRD=2\r\n", "OK", response, sizeof(response), 5000))
     return false;
 
-  if (!getBG96response("AT+QICLOSE=2\r\n", "OK", response, 3000))
+  if (!getBG96response("AT+QICLOSE=2\r\n", "OK", response, sizeof(response), 3000))
     return false;
   return true; 
 }
@@ -230,96 +925,48 @@ bool BG96_OpenSocketUDP()
 {
   char response[256];
 
-  if (!getBG96response("AT+QIOPEN=1,2,\"UDP SERVICE\",\"127.0.0.1\",0,3030,0\r\n", "+QIOPEN: 2,0", response, 5000))
+  urc_recv_count[BG96_UDP_CONNECT_ID] = 0;
+  urc_closed[BG96_UDP_CONNECT_ID] = false;
+
+  if (!getBG96response("AT+QIOPEN=1,2,\"UDP SERVICE\",\"127.0.0.1\",0,3030,0\r\n", "+QIOPEN: 2,0", response, sizeof(response), 5000))
     return false;
 
-  if (!getBG96response("AT+QISTATE=0,1\r\n", "OK", response, 3000))
+  if (!getBG96response("AT+QISTATE=0,1\r\n", "OK", response, sizeof(response), 3000))
     return false;
   
   return true;
 }
 
-bool BG96_SendUDP(char server_IP[], uint16_t port, uint8_t payload[], uint8_t len)
+bool BG96_SendUDP(char server_IP[], uint16_t port, uint8_t payload[], uint16_t len)
 {
-    char cmd[128], response[128];
+    char cmd[128];
 
-    sprintf(cmd, "AT+QISEND=2,%d,\"%s\",%d\r\n", len, server_IP, port);
-    if (!getBG96response(cmd, ">", response, 3000))
+    if (len > BG96_MAX_SEND_LENGTH)
       return false;
 
-    for (uint8_t i = 0; i < len; i++)
-      NBIOT_STREAM.write(payload[i]);
-    
-    if (!getBG96response("", "SEND OK", response, 10000))
-      return false;
-      
-    return true;
+    sprintf(cmd, "AT+QISEND=2,%d,\"%s\",%d\r\n", len, server_IP, port);
+    // SEND FAIL closes waiting for response on this socket
+    return getBG96prompt(cmd, payload, len, "SEND OK", &urc_closed[BG96_UDP_CONNECT_ID]);
 }
 
-// za sada ovako, modifikovati da bude univerzalno kasnije
-bool BG96_RecvUDP(uint8_t *output, uint16_t *output_len)
+bool BG96_waitForRecv(uint8_t connect_id, uint32_t timeout)
 {
-  uint16_t start_index = 0, cnt = 0;
-  char response[256];
-
-  if (!getBG96response("AT+QIRD=2\r\n", "OK", response, 5000))
+  if (connect_id >= BG96_CONNECT_IDS)
     return false;
 
-  char exp_response[] = "+QIRD:";
-  uint8_t flag;
-  while(1)
-  {
-    flag = 1;
-    for(uint8_t i = 0; i < strlen(exp_response); i++)
-    {
-      if(response[start_index + i] != exp_response[i])
-      {
-        flag = 0;
-      }
-    }
-    if(flag == 1)
-      break;
-
-    start_index++;
-  }
-  
-  uint16_t actual_size = 0;
-  while (response[start_index] != ',')
-  {
-      char c = response[start_index];
-      if (c >= '0' && c <= '9')
-      {
-        actual_size = actual_size * 10 + (c - '0');
-      }
-      start_index++;
-  }
-
-  while(response[start_index] != 0x0a)
-  {
-    start_index++;
-  }
-
-  start_index++;
-
-  //DEBUG_STREAM.println("rec.size: " + String(actual_size));
-
-  if (actual_size < *output_len)
-  {
-    *output_len = actual_size;
-    memcpy(output, response + start_index, *output_len);
-  }
-  else
-  {
-    memcpy(output, response + start_index, *output_len);
-  }
+  return BG96_waitForURC(&urc_recv_count[connect_id], &urc_closed[connect_id], timeout);
+}
 
-  return true;
+bool BG96_RecvUDP(uint8_t *output, uint16_t *output_len)
+{
+  // one datagram is read, payload is written to output without intermediate copy
+  return getBG96data("AT+QIRD=2\r\n", output, output_len, 5000);
 }
 
 bool BG96_CloseSocketUDP()
 {
     char response[128];
-    if (!getBG96response("AT+QICLOSE=2\r\n", "OK", response, 3000))
+    if (!getBG96response("AT+QICLOSE=2\r\n", "OK", response, sizeof(response), 3000))
       return false;
     return true;
 }
@@ -328,40 +975,36 @@ bool BG96_MQTTconnect(char client_id[], char broker[], int port)
 {
   char response[32], cmd[256];
   //char user[] = "node";
+
+  mqtt_rx_count[BG96_MQTT_CLIENT_IDX] = 0;
+  mqtt_send_failed[BG96_MQTT_CLIENT_IDX] = false;
+
+  // report payload length in +QMTRECV, so binary payload can be received
+  getBG96response("AT+QMTCFG=\"recv/mode\",0,0,1\r\n", "OK", response, sizeof(response), 1000);
   
   sprintf(cmd, "AT+QMTOPEN=0,\"%s\",%d\r\n", broker, port);
-  if (!getBG96response(cmd, "+QMTOPEN: 0,0", response, 5000))
+  if (!getBG96response(cmd, "+QMTOPEN: 0,0", response, sizeof(response), 5000))
     return false;
   
   //sprintf(cmd, "AT+QMTCONN=0,\"%s\",\"%s\",\"%s\"\r\n", client_id, user, user);
   sprintf(cmd, "AT+QMTCONN=0,\"%s\"\r\n", client_id);
   
-  if (!getBG96response(cmd, "+QMTCONN: 0,0,0", response, 5000))
+  if (!getBG96response(cmd, "+QMTCONN: 0,0,0", response, sizeof(response), 5000))
     return false;
 
   return true;
 }
 
-bool BG96_MQTTpublish(char *topic_to_pub, uint8_t *payload, uint8_t len)
+bool BG96_MQTTpublish(char *topic_to_pub, uint8_t *payload, uint16_t len)
 {
-  char response[32], topic[128];
+  char topic[128];
 
-  sprintf(topic, "AT+QMTPUB=0,0,0,0,\"%s\",%d\r\n", topic_to_pub, len);
-  if (!getBG96response(topic, ">", response, 5000))
-    return false;
-  
-  for (uint8_t i = 0; i < len; i++)
-  {
-    //char str[3];
-    //sprintf(str, "%02x", payload[i]);
-    //DEBUG_STREAM.println(str);
-    //Serial.println(payload[i]);
-    NBIOT_STREAM.write(payload[i]);
-  }
-  if (!getBG96response("\x1a", "+QMTPUB: 0,0,0", response, 5000))
+  if (len > BG96_MAX_SEND_LENGTH)
     return false;
 
-  return true;
+  // message length is given, so payload is not terminated with Ctrl+Z
+  sprintf(topic, "AT+QMTPUB=0,0,0,0,\"%s\",%d\r\n", topic_to_pub, len);
+  return getBG96prompt(topic, payload, len, "+QMTPUB: 0,0,0", &mqtt_send_failed[BG96_MQTT_CLIENT_IDX]);
 }
 
 bool BG96_MQTTsubscribe(char topic_to_sub[])
@@ -369,65 +1012,26 @@ bool BG96_MQTTsubscribe(char topic_to_sub[])
   char response[32], cmd[256];
   
   sprintf(cmd, "AT+QMTSUB=0,1,\"%s\",0\r\n", topic_to_sub);
-  if (!getBG96response(cmd, "OK", response, 5000))
+  if (!getBG96response(cmd, "OK", response, sizeof(response), 5000))
     return false;
 
   return true;
 }
 
-void BG96_MQTTcollectData(uint8_t *output, uint16_t *output_len)
+bool BG96_MQTTcollectData(uint8_t *output, uint16_t *output_len, uint32_t timeout)
 {
-  uint8_t count = 0;
-  char response[256];
-
-  uint32_t t0 = millis();
-  while ((millis() - t0) < 5000)
-  { 
-    if (NBIOT_STREAM.available())
-    {
-      response[count] = NBIOT_STREAM.read();
-      DEBUG_STREAM.write(response[count]);
-      response[++count] = '\0';
-    }
-  }
-
-  DEBUG_STREAM.print("\r\n");
-
-  char exp_response[] = "+QMTRECV:";
-  uint16_t start_index = 0;
-  uint8_t flag;
-
-  t0 = millis();
-  while((millis() - t0) < 15000)
+  // payload is stored by URC dispatcher as soon as +QMTRECV arrives
+  if (!BG96_waitForURC(&mqtt_rx_count[BG96_MQTT_CLIENT_IDX], &mqtt_send_failed[BG96_MQTT_CLIENT_IDX], timeout))
   {
-    flag = 1;
-    for(uint8_t i = 0; i < strlen(exp_response); i++)
-    {
-      if(response[start_index + i] != exp_response[i])
-      {
-        flag = 0;
-      }
-    }
-
-    if(flag == 1)
-      break;
-    
-    start_index++;
-  }
- 
-  count = 0;
-  while(count != 3)
-  {
-    if (response[start_index] == ',')
-      count++;
-    
-    start_index++;
+    *output_len = 0;
+    return false;
   }
 
-  start_index++;
+  if (mqtt_rx_len[BG96_MQTT_CLIENT_IDX] < *output_len)
+    *output_len = mqtt_rx_len[BG96_MQTT_CLIENT_IDX];
+  memcpy(output, mqtt_rx_buffer[BG96_MQTT_CLIENT_IDX], *output_len);
 
-  memcpy(output, response + start_index, *output_len);
-  DEBUG_STREAM.println((char *)output);
+  return true;
 }
 
 
@@ -435,7 +1039,7 @@ bool BG96_MQTTdisconnect(void)
 {
   char response[64];
   
-  if (!getBG96response("AT+QMTDISC=0\r\n", "+QMTDISC: 0,0", response, 5000))
+  if (!getBG96response("AT+QMTDISC=0\r\n", "+QMTDISC: 0,0", response, sizeof(response), 5000))
     return false;
   
   return true;
@@ -446,98 +1050,49 @@ bool BG96_OpenSocketTCP(char server_IP[], uint16_t port)
 {
   char response[256], cmd[256];
   
+  urc_recv_count[BG96_TCP_CONNECT_ID] = 0;
+  urc_closed[BG96_TCP_CONNECT_ID] = false;
+
   sprintf(cmd, "AT+QIOPEN=1,0,\"TCP\",\"%s\",%d,0,0\r\n", server_IP, port);
 
-  if (!getBG96response(cmd, "+QIOPEN: 0,0", response, 5000))
+  if (!getBG96response(cmd, "+QIOPEN: 0,0", response, sizeof(response), 5000))
     return false;
 
-  if (!getBG96response("AT+QISTATE=1,0\r\n", "OK", response, 3000))
+  if (!getBG96response("AT+QISTATE=1,0\r\n", "OK", response, sizeof(response), 3000))
     return false;
   
   return true;
 }
 
-bool BG96_SendTCP(uint8_t payload[], uint8_t len)
+bool BG96_SendTCP(uint8_t payload[], uint16_t len)
 {
-  char cmd[128], response[128];
+  char cmd[128];
 
-  sprintf(cmd, "AT+QISEND=0,%d\r\n", len);
-  if (!getBG96response(cmd, ">", response, 3000))
+  if (len > BG96_MAX_SEND_LENGTH)
     return false;
 
-  for (uint8_t i = 0; i < len; i++)
-    NBIOT_STREAM.write(payload[i]);
-  
-  if (!getBG96response("", "SEND OK", response, 10000))
-    return false;
-    
-  return true;
+  sprintf(cmd, "AT+QISEND=0,%d\r\n", len);
+  return getBG96prompt(cmd, payload, len, "SEND OK", &urc_closed[BG96_TCP_CONNECT_ID]);
 }
 
 bool BG96_RecvTCP(uint8_t *output, uint16_t *output_len)
 {
-  uint16_t start_index = 0, cnt = 0;
-  char response[256], cmd[128];
+  char cmd[32];
 
-  sprintf(cmd, "AT+QIRD=0,%d\r\n", *output_len);
-  if (!getBG96response(cmd, "OK", response, 5000))
-    return false;
+  if (*output_len > BG96_MAX_RECV_LENGTH)
+    *output_len = BG96_MAX_RECV_LENGTH;
 
-  char exp_response[] = "+QIRD:";
-  uint8_t flag;
-  while(1)
-  {
-    flag = 1;
-    for(uint8_t i = 0; i < strlen(exp_response); i++)
-    {
-      if(response[start_index + i] != exp_response[i])
-      {
-        flag = 0;
-      }
-    }
-    if(flag == 1)
-      break;
-
-    start_index++;
-  }
-
-  uint16_t actual_size = 0;
-  start_index += strlen("+QIRD: ");
-
-  while (response[start_index] >= '0' && response[start_index] <= '9')
-  {
-      char c = response[start_index];
-      actual_size = actual_size * 10 + (c - '0');
-      start_index++;
-  }
-
-  while(response[start_index] != 0x0a)
-  {
-    start_index++;
-  }
-
-  start_index++;
-
-  if (actual_size < *output_len)
-  {
-    *output_len = actual_size;
-    memcpy(output, response + start_index, *output_len);
-  }
-  else
-  {
-    memcpy(output, response + start_index, *output_len);
-  }
-
-  return true;
+  sprintf(cmd, "AT+QIRD=0,%d\r\n", *output_len);
+  return getBG96data(cmd, output, output_len, 5000);
 }
 
 bool BG96_CloseSocketTCP()
 {
   char response[128];
  
-  if (!getBG96response("AT+QICLOSE=0\r\n", "OK", response, 10000))
+  if (!getBG96response("AT+QICLOSE=0\r\n", "OK", response, sizeof(response), 10000))
   {
-    if (!getBG96response("AT+QICLOSE=0\r\n", "OK", response, 10000))
+    if (!getBG96response("AT+QICLOSE=0\r\n", "OK", response, sizeof(response), 10000))
       return false;
   }
   return true;
@@ -552,11 +1107,11 @@ bool BG96_setAwsCredential(String crd, String filename)
 
    String Cmd = "AT+QFUPL=\"" + filename + "\"," + String(crd.length())+",100\r\n";
    Cmd.toCharArray(cmd, Cmd.length());
-   getBG96response(cmd, "CONNECT", response, 6000);
+   getBG96response(cmd, "CONNECT", response, sizeof(response), 6000);
 
    crd += "\r\n";
    crd.toCharArray(cmd, crd.length());
-   getBG96response(cmd, "OK", response, 6000);
+   getBG96response(cmd, "OK", response, sizeof(response), 6000);
    return true;
 }
 
@@ -566,55 +1121,55 @@ void BG96_MQTTconfigureSSL(char ClientID[])
   
   // configure session in ssl mode
   sprintf(cmd, "AT+QMTCFG=\"SSL\",0,1,2\r\n");
-  getBG96response(cmd, "OK", response, 10000);
+  getBG96response(cmd, "OK", response, sizeof(response), 10000);
 
   // ssl cert load
-  sprintf(cmd, "AT+QFUPL=\"cacert.pem\", %d, 100\r\n", strlen(ca_cert));
-  getBG96response(cmd, "CONNECT", response, 5000);
+  sprintf(cmd, "AT+QFUPL=\"cacert.pem\", %d, 100\r\n", (int)strlen(ca_cert));
+  getBG96response(cmd, "CONNECT", response, sizeof(response), 5000);
 
   for (uint16_t i = 0; i < strlen(ca_cert) - 1; i++)
     NBIOT_STREAM.write(ca_cert[i]);
 
-  getBG96response(&ca_cert[strlen(ca_cert) - 1], "OK", response, 5000);
+  getBG96response(&ca_cert[strlen(ca_cert) - 1], "OK", response, sizeof(response), 5000);
 
   // configure ca cert
   sprintf(cmd, "AT+QSSLCFG=\"cacert\",2,\"cacert.pem\"\r\n");
-  getBG96response(cmd, "OK", response, 5000);
+  getBG96response(cmd, "OK", response, sizeof(response), 5000);
 
   //Configure SSL parameters.  
   //SSL authentication mode: server authentication
   sprintf(cmd, "AT+QSSLCFG=\"seclevel\",2,1\r\n");
-  getBG96response(cmd, "OK", response, 5000);
+  getBG96response(cmd, "OK", response, sizeof(response), 5000);
 
   //SSL authentication version
   sprintf(cmd, "AT+QSSLCFG=\"sslversion\",2,4\r\n");
-  getBG96response(cmd, "OK", response, 5000);
+  getBG96response(cmd, "OK", response, sizeof(response), 5000);
 
   //Cipher suite
   sprintf(cmd, "AT+QSSLCFG=\"ciphersuite\",2,0xFFFF\r\n");
-  getBG96response(cmd, "OK", response, 5000);
+  getBG96response(cmd, "OK", response, sizeof(response), 5000);
 
   //Ignore the time of authentication
   sprintf(cmd, "AT+QSSLCFG=\"ignorelocaltime\",1\r\n");
-  getBG96response(cmd, "OK", response, 5000);
+  getBG96response(cmd, "OK", response, sizeof(response), 5000);
 
   // open and connect
   sprintf(cmd, "AT+QMTOPEN=0,\"%s\",8883\r\n", MQTT_URL);
-  getBG96response(cmd, "+QMTOPEN: 0,0", response, 5000);
+  getBG96response(cmd, "+QMTOPEN: 0,0", response, sizeof(response), 5000);
   sprintf(cmd, "AT+QMTCONN=0,\"%s\"\r\n", ClientID);
-  getBG96response(cmd, "+QMTCONN: 0,0,0", response, 5000);
+  getBG96response(cmd, "+QMTCONN: 0,0,0", response, sizeof(response), 5000);
 }
 
 
 bool BG96_turnGpsOn()
 {
   char response[256];
-  getBG96response("AT+QGPS?\r\n", "OK", response, 3000);
+  getBG96response("AT+QGPS?\r\n", "OK", response, sizeof(response), 3000);
   
   if (strstr(response, "+QGPS: 1"))
     return true;
   else
-    return getBG96response("AT+QGPS=1\r\n", "OK", response, 10000);
+    return getBG96response("AT+QGPS=1\r\n", "OK", response, sizeof(response), 10000);
 }
 
 bool BG96_getGpsFix()
@@ -622,7 +1177,7 @@ bool BG96_getGpsFix()
   char response[256];
   
   DEBUG_STREAM.println("Getting GPS fix...");
-  while (!getBG96response("AT+QGPSLOC?\r\n", "OK", response, 5000))
+  while (!getBG96response("AT+QGPSLOC?\r\n", "OK", response, sizeof(response), 5000))
   {
     DEBUG_STREAM.print(".");
     delay(3000);
@@ -636,7 +1191,7 @@ bool BG96_getGpsPosition(char position[])
 {
   char response[128], *start, *end;
 
-  if (!getBG96response("AT+QGPSLOC=2\r\n", "OK", response, 3000))
+  if (!getBG96response("AT+QGPSLOC=2\r\n", "OK", response, sizeof(response), 3000))
     return false;
   start = strstr(response, "+QGPSLOC:");
   start = strstr(start, ",") + 1;
@@ -677,32 +1232,3 @@ void BG96_serialBridge()
       DEBUG_STREAM.write(NBIOT_STREAM.read());  
   }
 }
-
-
-int compare(const char *X, const char *Y)
-{
-	while (*X && *Y)
-	{
-		if (*X != *Y) {
-			return 0;
-		}
-		
-		X++;
-		Y++;
-	}
-	return (*Y == '\0');
-}
-
-// Function to implement `strstr()` function
-const char* strcheck(const char* X, const char* Y, int  x_length)
-{
-	for(int i = 0; i < x_length; i++)
-	{
-		if ((*X == *Y) && compare(X, Y)) {
-			return X;
-		}
-		X++;
-	}
-	
-	return NULL;
-}
\ No newline at end of file
@@ -24,10 +24,123 @@
 #define APN_PASS  ""
 #endif
 
+/// Size of UART receive ring buffer filled by UART interrupt
+#define BG96_RX_BUFFER_SIZE   2048
+/// Maximum number of queued AT commands
+#define BG96_AT_QUEUE_SIZE    8
+/// Size of line buffer used by AT response tokenizer
+#define BG96_AT_LINE_SIZE     256
+
+/// Number of sockets (connect IDs) supported by modem
+#define BG96_CONNECT_IDS      12
+/// Connect ID used for UDP socket
+#define BG96_UDP_CONNECT_ID   2
+/// Connect ID used for TCP socket
+#define BG96_TCP_CONNECT_ID   0
+/// Number of MQTT clients whose received messages are buffered
+#define BG96_MQTT_CLIENTS     1
+/// MQTT client index used for connection
+#define BG96_MQTT_CLIENT_IDX  0
+/// Size of buffer for message received from subscribed topic
+#define BG96_MQTT_RX_SIZE     1548
+/// Maximum number of bytes that can be read from socket at once
+#define BG96_MAX_RECV_LENGTH  1500
+/// Maximum number of bytes that can be sent with one send command
+#define BG96_MAX_SEND_LENGTH  1460
+
+/// Duration of PWRKEY pulse that wakes modem from PSM (in milliseconds)
+#define BG96_PSM_WAKE_PULSE   500
+
+/// eDRX access technology type
+#define BG96_EDRX_ACT_EMTC    4
+#define BG96_EDRX_ACT_NBIOT   5
+
+/// Power saving configuration of modem
+typedef struct
+{
+  bool psm_enable;          // enable power saving mode
+  uint32_t psm_tau;         // requested periodic TAU (T3412) in seconds
+  uint32_t psm_active_time; // requested active time (T3324) in seconds
+  bool edrx_enable;         // enable extended discontinuous reception
+  uint8_t edrx_act_type;    // access technology (BG96_EDRX_ACT_EMTC or BG96_EDRX_ACT_NBIOT)
+  uint8_t edrx_cycle;       // requested eDRX cycle value (4 bits, 3GPP TS 24.008)
+} BG96_powerConfig;
+
+/**
+ * Callback called when queued AT command completes
+ * @param success - True if expected response is received, false on error result code or timeout
+ * @param response - Buffer with received response (can be NULL)
+ * @param response_len - Number of received bytes stored in response buffer
+ * @param arg - Argument given on command submission
+ */
+typedef void (*BG96_ATcallback)(bool success, char *response, uint16_t response_len, void *arg);
+
+// AT command engine
+/**
+ * Function that queues AT command. Command is sent when all previously queued commands complete
+ * and it completes as soon as expected response or error result code is received.
+ * @param command - Command to be sent, must stay valid until command completes
+ * @param exp_response - Response that completes command successfully, must stay valid until command completes
+ * @param response - Buffer in which received response is stored (can be NULL)
+ * @param response_size - Size of response buffer
+ * @param timeout - Command timeout in milliseconds
+ * @param callback - Function called on completion (can be NULL)
+ * @param arg - Argument passed to callback
+ * @return Returns true if command is queued
+ */
+bool BG96_ATsubmit(const char *command, const char *exp_response, char *response, uint16_t response_size, uint32_t timeout, BG96_ATcallback callback, void *arg);
+
+/**
+ * Function that processes received bytes, completes and starts queued commands.
+ * Should be called periodically while commands are pending.
+ * @return Returns number of pending commands
+ */
+uint8_t BG96_ATprocess();
+
+/**
+ * Function that waits until all queued commands complete
+ * @param timeout - Maximum waiting time in milliseconds
+ * @return Returns true if queue is empty
+ */
+bool BG96_ATwaitIdle(uint32_t timeout);
+
 bool BG96_turnOn();
 bool BG96_nwkRegister(char *apn, char *apn_user, char *apn_password);
+
+// power saving functions
+/**
+ * Function that configures PSM (AT+CPSMS) and eDRX (AT+CEDRXS) timers. Timers are rounded up
+ * to values that can be encoded and are applied on next registration or tracking area update.
+ * @param power - Power saving configuration
+ * @return Returns true on success
+ */
+bool BG96_setPowerSaving(BG96_powerConfig *power);
+
+/**
+ * Function that wakes modem after deep sleep of ESP32 (from PSM if needed) and checks whether
+ * it is still registered to network
+ * @return Returns true if modem is registered and PDP context is active, otherwise full registration is needed
+ */
+bool BG96_wake();
+
+/**
+ * Function that returns registration state kept in RTC memory across deep sleep
+ * @return Returns true if modem was registered before deep sleep
+ */
+bool BG96_isRegistered();
+
+/**
+ * Function that makes modem ready for socket operations. Registration kept across deep sleep is reused,
+ * otherwise modem is turned on, power saving is configured and network registration is performed.
+ * @param apn - Access point name
+ * @param apn_user - APN user name
+ * @param apn_password - APN password
+ * @param power - Power saving configuration (can be NULL)
+ * @return Returns true on success
+ */
+bool BG96_attach(char *apn, char *apn_user, char *apn_password, BG96_powerConfig *power);
 bool BG96_TxRxUDP(char payload[], char server_IP[], uint16_t port);
-bool BG96_TxRxSensorData(char server_IP[], uint16_t port, uint8_t payload[], uint8_t len);
+bool BG96_TxRxSensorData(char server_IP[], uint16_t port, uint8_t payload[], uint16_t len);
 
 bool BG96_turnGpsOn();
 bool BG96_getGpsFix();
@@ -47,17 +160,26 @@ void BG96_serialBridge();
 bool BG96_OpenSocketUDP();
 
 /**
- * Function that sends data via UDP
+ * Function that sends data via UDP. Function returns when payload is written to modem,
+ * SEND OK is processed while next command is queued. Failed send stops BG96_waitForRecv.
  * @param server_IP - Server IP address
  * @param port - Server port
  * @param payload - Pointer to array of bytes to be sent
- * @param len - Number of bytes to be sent
+ * @param len - Number of bytes to be sent (at most BG96_MAX_SEND_LENGTH)
  * @return Returns true on success
  */
-bool BG96_SendUDP(char server_IP[], uint16_t port, uint8_t payload[], uint8_t len);
+bool BG96_SendUDP(char server_IP[], uint16_t port, uint8_t payload[], uint16_t len);
 
 /**
- * Function that reads recieved data via UDP
+ * Function that waits for +QIURC: "recv" notification on given socket
+ * @param connect_id - Socket connect ID (BG96_UDP_CONNECT_ID or BG96_TCP_CONNECT_ID)
+ * @param timeout - Maximum waiting time in milliseconds
+ * @return Returns true if data is ready to be read
+ */
+bool BG96_waitForRecv(uint8_t connect_id, uint32_t timeout);
+
+/**
+ * Function that reads recieved data via UDP. Payload is binary safe, bytes above output_len are discarded.
  * @param payload - Pointer to array of bytes to which data will be written
  * @param output_len - Maximum number of recieved bytes. If number of recieved bytes 
  * is smaller then expected, len will be updated.
@@ -81,15 +203,16 @@ bool BG96_CloseSocketUDP();
 bool BG96_OpenSocketTCP(char server_IP[], uint16_t port);
 
 /**
- * Function that sends data via TCP
+ * Function that sends data via TCP. Function returns when payload is written to modem,
+ * SEND OK is processed while next command is queued. Failed send stops BG96_waitForRecv.
  * @param payload - Pointer to array of bytes to be sent
- * @param len - Number of bytes to be sent
+ * @param len - Number of bytes to be sent (at most BG96_MAX_SEND_LENGTH)
  * @return Returns true on success
  */
-bool BG96_SendTCP(uint8_t payload[], uint8_t len);
+bool BG96_SendTCP(uint8_t payload[], uint16_t len);
 
 /**
- * Function that reads recieved data via TCP
+ * Function that reads recieved data via TCP. Payload is binary safe, at most BG96_MAX_RECV_LENGTH bytes are read.
  * @param payload - Pointer to array of bytes to which data will be written
  * @param output_len - Maximum number of recieved bytes. If number of recieved bytes 
  * is smaller then expected, len will be updated.
@@ -124,19 +247,21 @@ bool BG96_MQTTsubscribe(char topic_to_sub[]);
  * Function that publishes data to MQTT topic
  * @param topic_to_pub - Topic to which device publishes data
  * @param payload - Array of bytes to be published
- * @param len - Number of bytes to be sent
- * @return Returns true on success
+ * @param len - Number of bytes to be sent (at most BG96_MAX_SEND_LENGTH)
+ * @return Returns true when payload is written to modem, publish confirmation is processed
+ * while next command is queued. Failed publish stops BG96_MQTTcollectData.
  */
-bool BG96_MQTTpublish(char *topic_to_pub, uint8_t *payload, uint8_t len);
+bool BG96_MQTTpublish(char *topic_to_pub, uint8_t *payload, uint16_t len);
 
 /**
  * Function that collects data recieved from subscribed topic via MQTT
  * @param output - Pointer to array of bytes to which data will be written
  * @param output_len - Maximum number of recieved bytes. If number of recieved bytes 
  * is smaller then expected, len will be updated.
+ * @param timeout - Maximum time to wait for +QMTRECV notification in milliseconds
  * @return Returns true on success
  */
-void BG96_MQTTcollectData(uint8_t *output, uint16_t *output_len);
+bool BG96_MQTTcollectData(uint8_t *output, uint16_t *output_len, uint32_t timeout);
 
 /**
  * Function that disconnects from MQTT broker
@@ -3,10 +3,25 @@
 
 #include "esp_bt_main.h"
 #include "esp_bt_device.h"
+#include "esp_gap_ble_api.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "BLEDevice.h"
 #include "file_utils.h"
 #include "BLE_client.h"
 
+/// Peer found by scan, kept in RTC memory so unit connects directly after deep sleep
+typedef struct
+{
+  bool valid;
+  uint8_t addr[6];
+  uint8_t addr_type;
+  uint16_t mtu;
+  uint16_t char_handle;
+} BLE_peerCache;
+
+RTC_DATA_ATTR BLE_peerCache ble_peer = {0};
+
 static boolean doConnect = false;
 static boolean connected = false;
 static boolean doScan = false;
@@ -17,21 +32,114 @@ static char CHAR_UUID[64];
 static char ble_server_addr[6];
 
 static BLEClient* pClient;
+static bool fast_connect = false;
+static bool bulk_transfer = false;
+
+// notifications received from core, each one is stored with its length in front
+static uint8_t rx_ring[BLE_RX_BUFFER_SIZE];
+static uint16_t rx_head = 0;
+static uint16_t rx_tail = 0;
+static portMUX_TYPE rx_mux = portMUX_INITIALIZER_UNLOCKED;
+static StaticSemaphore_t rx_sem_buffer;
+static SemaphoreHandle_t rx_sem = NULL;
+static bool notify_enabled = false;
 
 bool BLE_client_debug_enable = false;
 
+void BLE_setFastConnect(bool enable)
+{
+  fast_connect = enable;
+  if (!enable)
+    ble_peer.valid = false;
+}
+
+void BLE_setBulkTransfer(bool enable)
+{
+  bulk_transfer = enable;
+}
+
+uint16_t BLE_getMTU()
+{
+  if (connected)
+    return pClient->getMTU();
+  return ble_peer.valid ? ble_peer.mtu : BLEDevice::getMTU();
+}
+
 void BLE_debugEnable(bool enable)
 {
   BLE_client_debug_enable = enable;
 }
 
+/**
+ * Function that returns number of free bytes in receive ring
+ **/
+static uint16_t rxFree()
+{
+  return (rx_tail + BLE_RX_BUFFER_SIZE - rx_head - 1) % BLE_RX_BUFFER_SIZE;
+}
+
+/**
+ * Function that copies bytes to receive ring, caller checks free space
+ **/
+static void rxWrite(const uint8_t *data, uint16_t length)
+{
+  for (uint16_t i = 0; i < length; i++)
+  {
+    rx_ring[rx_head] = data[i];
+    rx_head = (rx_head + 1) % BLE_RX_BUFFER_SIZE;
+  }
+}
+
+/**
+ * Function that copies bytes from receive ring, caller checks available data
+ **/
+static void rxRead(uint8_t *data, uint16_t length)
+{
+  for (uint16_t i = 0; i < length; i++)
+  {
+    if (data != NULL)
+      data[i] = rx_ring[rx_tail];
+    rx_tail = (rx_tail + 1) % BLE_RX_BUFFER_SIZE;
+  }
+}
+
+/**
+ * Function that drops all received notifications
+ **/
+static void rxClear()
+{
+  if (rx_sem != NULL)
+    while (xSemaphoreTake(rx_sem, 0) == pdTRUE);
+  portENTER_CRITICAL(&rx_mux);
+  rx_head = rx_tail = 0;
+  portEXIT_CRITICAL(&rx_mux);
+}
+
 static void notifyCallback(BLERemoteCharacteristic* pBLERemoteCharacteristic,
                            uint8_t* pData,
                            size_t length,
                            bool isNotify) 
 {
-  if (BLE_client_debug_enable)
-    Serial.println("Notify callbeck.");
+  uint16_t len = length;
+  bool stored = false;
+
+  // notification is delivered from BT task, it is only copied here
+  if (rx_sem == NULL)
+    return;
+
+  portENTER_CRITICAL(&rx_mux);
+  if (length <= BLE_RX_BUFFER_SIZE && rxFree() >= 2 + len)
+  {
+    rxWrite((uint8_t *)&len, 2);
+    rxWrite(pData, len);
+    stored = true;
+  }
+  portEXIT_CRITICAL(&rx_mux);
+
+  if (stored)
+    xSemaphoreGive(rx_sem);
+  else if (BLE_client_debug_enable)
+    Serial.println("Notification dropped, receive buffer full.");
 }
 
 class MyClientCallback : public BLEClientCallbacks 
@@ -51,7 +159,7 @@ class MyClientCallback : public BLEClientCallbacks
   }
 };
 
-bool connectToServer() 
+static bool connectToPeer(BLEAddress address, esp_ble_addr_type_t address_type)
 {
   BLEUUID serviceUUID(SERV_UUID);
   BLEUUID charUUID(CHAR_UUID);
@@ -59,17 +167,24 @@ bool connectToServer()
   if (BLE_client_debug_enable)
   {
     Serial.print("Forming a connection to ");
-    Serial.println(myDevice->getAddress().toString().c_str());
+    Serial.println(address.toString().c_str());
   }
   
-  pClient  = BLEDevice::createClient();
-  if (BLE_client_debug_enable)
-    Serial.println(" - Created client");
-  
-  pClient->setClientCallbacks(new MyClientCallback());
+  // client is created once and reused for every connection
+  if (pClient == nullptr)
+  {
+    pClient  = BLEDevice::createClient();
+    if (BLE_client_debug_enable)
+      Serial.println(" - Created client");
+    
+    pClient->setClientCallbacks(new MyClientCallback());
+  }
+
+  // short connection interval, exchange is done in a few connection events
+  esp_ble_gap_set_prefer_conn_params(*address.getNative(), BLE_CONN_MIN_INTERVAL, BLE_CONN_MAX_INTERVAL, BLE_CONN_LATENCY, BLE_CONN_TIMEOUT);
   
   // Connect to the remote BLE Server.
-  if (!pClient->connect(myDevice))
+  if (!pClient->connect(address, address_type))
   {
     if (BLE_client_debug_enable)
       Serial.println(" - Failed to connect to server");
@@ -109,10 +224,32 @@ bool connectToServer()
   if (BLE_client_debug_enable)
     Serial.println(" - Found our characteristic");
   
-  // assign for notify
-  //pRemoteCharacteristic->registerForNotify(notifyCallback);
+  // longer link layer packets, so one ATT packet is not split into several air packets
+  if (bulk_transfer)
+    esp_ble_gap_set_pkt_data_len(*address.getNative(), BLE_BULK_DATA_LENGTH);
+
+  // response is pushed by core, so separate read is not needed
+  rxClear();
+  notify_enabled = pRemoteCharacteristic->canNotify() || pRemoteCharacteristic->canIndicate();
+  if (notify_enabled)
+    pRemoteCharacteristic->registerForNotify(notifyCallback, pRemoteCharacteristic->canNotify());
 
+  // core database changed (e.g. firmware update), cached peer is refreshed
+  if (ble_peer.valid && ble_peer.char_handle != pRemoteCharacteristic->getHandle() && BLE_client_debug_enable)
+    Serial.println(" - Characteristic handle changed");
+
+  if (fast_connect)
+  {
+    memcpy(ble_peer.addr, address.getNative(), 6);
+    ble_peer.addr_type = address_type;
+    ble_peer.mtu = pClient->getMTU();
+    ble_peer.char_handle = pRemoteCharacteristic->getHandle();
+    ble_peer.valid = true;
+  }
+
+  memcpy(ble_server_addr, address.getNative(), 6);
   connected = true;
+  return true;
 }
 
 /**
@@ -134,14 +271,11 @@ class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks
       Serial.println(advertisedDevice.toString().c_str());
     }
 
-    uint8_t* tmp = (uint8_t *)advertisedDevice.getAddress().getNative();
-    for (int i = 0; i < 6; i++)
-      ble_server_addr[i] = tmp[i];
-
     // We have found a device, let us now see if it contains the service we are looking for.
     if (advertisedDevice.haveServiceUUID() && advertisedDevice.isAdvertisingService(serviceUUID)) {
 
       BLEDevice::getScan()->stop();
+      delete myDevice;
       myDevice = new BLEAdvertisedDevice(advertisedDevice);
       doConnect = true;
       doScan = true;
@@ -150,17 +284,59 @@ class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks
   } // onResult
 }; // MyAdvertisedDeviceCallbacks
 
+// scan callbacks are kept by scan object, one instance is used for every scan
+static MyAdvertisedDeviceCallbacks advertised_device_callbacks;
+
+/**
+ * Scan for BLE server that advertises our service, scan is stopped as soon as it is found
+ */
+static void scanForServer()
+{
+  // Retrieve a Scanner and set the callback we want to use to be informed when we
+  // have detected a new device.  Specify that we want active scanning and start the
+  // scan to run for 5 seconds.
+  BLEScan* pBLEScan = BLEDevice::getScan();
+  pBLEScan->setAdvertisedDeviceCallbacks(&advertised_device_callbacks);
+  pBLEScan->setInterval(1349);
+  pBLEScan->setWindow(449);
+  pBLEScan->setActiveScan(true);
+  pBLEScan->start(BLE_SCAN_TIME, false);
+}
+
+bool connectToServer() 
+{
+  // cached peer is tried first, scan is done only if it is not reachable anymore
+  if (ble_peer.valid)
+  {
+    if (connectToPeer(BLEAddress(ble_peer.addr), (esp_ble_addr_type_t)ble_peer.addr_type))
+      return true;
+
+    if (BLE_client_debug_enable)
+      Serial.println("Cached server not reachable, scanning");
+    ble_peer.valid = false;
+    scanForServer();
+  }
+
+  if (myDevice == nullptr)
+    return false;
+
+  return connectToPeer(myDevice->getAddress(), myDevice->getAddressType());
+}
+
 
 void BLE_clientSetup(char *serv_uuid, char *char_uuid) 
 { 
   memcpy(SERV_UUID, serv_uuid, strlen(serv_uuid));
   memcpy(CHAR_UUID, char_uuid, strlen(char_uuid));
 
+  if (rx_sem == NULL)
+    rx_sem = xSemaphoreCreateCountingStatic(BLE_RX_BUFFER_SIZE / 2, 0, &rx_sem_buffer);
+
   if (BLE_client_debug_enable)
     Serial.println("Starting Arduino BLE Client application...");
   BLEDevice::init("IO3T-MU");
 
-  if (BLEDevice::setMTU(100) != ESP_OK)
+  if (BLEDevice::setMTU(bulk_transfer ? BLE_BULK_MTU : BLE_DEFAULT_MTU) != ESP_OK)
   {
     if (BLE_client_debug_enable)
     {
@@ -175,15 +351,14 @@ void BLE_clientSetup(char *serv_uuid, char *char_uuid)
     Serial.println(BLEDevice::getMTU(), HEX);
   }
 
-  // Retrieve a Scanner and set the callback we want to use to be informed when we
-  // have detected a new device.  Specify that we want active scanning and start the
-  // scan to run for 5 seconds.
-  BLEScan* pBLEScan = BLEDevice::getScan();
-  pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
-  pBLEScan->setInterval(1349);
-  pBLEScan->setWindow(449);
-  pBLEScan->setActiveScan(true);
-  pBLEScan->start(5, false);
+  // core found before deep sleep is connected directly, without scan
+  if (fast_connect && ble_peer.valid)
+  {
+    doConnect = true;
+    return;
+  }
+
+  scanForServer();
 } // End of setup.
 
 
@@ -204,7 +379,8 @@ bool BLE_connectToServer()
       doConnect = false; // Zasto ne radi sa true?
     }
   }
-  return !doConnect;
+  // failed connect leaves client without connection, so state of connection is returned
+  return connected;
 }
 
 bool BLE_disconnectFromServer()
@@ -213,36 +389,244 @@ bool BLE_disconnectFromServer()
   return true;
 }
 
-bool BLE_send(uint8_t packet[], uint16_t size)
+/**
+ * Function that waits for acknowledgment of bulk transfer fragments, other notifications are dropped
+ * @return Sequence number of last fragment received in order, -1 on timeout
+ **/
+static int16_t waitForAck()
 {
-  if (connected)
-  { 
-    pRemoteCharacteristic->writeValue(packet, size, true);
-    return true;
+  uint8_t notification[BLE_FRAG_HEADER_LENGTH];
+  uint16_t len;
+  uint32_t start = millis();
+
+  while (true)
+  {
+    uint32_t elapsed = millis() - start;
+    if (elapsed >= BLE_BULK_ACK_TIMEOUT || xSemaphoreTake(rx_sem, pdMS_TO_TICKS(BLE_BULK_ACK_TIMEOUT - elapsed)) != pdTRUE)
+      break;
+
+    // only header is needed, rest of notification is dropped
+    portENTER_CRITICAL(&rx_mux);
+    if (rx_head == rx_tail)
+    {
+      portEXIT_CRITICAL(&rx_mux);
+      continue;
+    }
+    rxRead((uint8_t *)&len, 2);
+    rxRead(notification, min(len, (uint16_t)BLE_FRAG_HEADER_LENGTH));
+    if (len > BLE_FRAG_HEADER_LENGTH)
+      rxRead(NULL, len - BLE_FRAG_HEADER_LENGTH);
+    portEXIT_CRITICAL(&rx_mux);
+
+    if (len == BLE_FRAG_HEADER_LENGTH && notification[0] == BLE_FRAG_ACK)
+      return notification[1];
   }
-  return false;
+  return -1;
 }
 
-bool BLE_recv(uint8_t *rx_buffer, uint16_t *rx_buffer_len)
+/**
+ * Function that sends frame in fragments written without response, each window is acknowledged by core and
+ * fragments after the last acknowledged one are sent again (go-back-N)
+ **/
+static bool bulkSend(uint8_t packet[], uint16_t size)
 {
-  if (connected)
+  uint8_t fragment[BLE_BULK_MTU - BLE_ATT_HEADER_LENGTH];
+  uint16_t payload = BLE_getMTU() - BLE_ATT_HEADER_LENGTH - BLE_FRAG_HEADER_LENGTH;
+  uint16_t count = size == 0 ? 1 : (size + payload - 1) / payload;
+  uint16_t acked = 0;
+  uint8_t retries = 0;
+
+  if (payload > sizeof(fragment) - BLE_FRAG_HEADER_LENGTH)
+    payload = sizeof(fragment) - BLE_FRAG_HEADER_LENGTH;
+  if (count > 256)
+    return false;
+
+  while (acked < count)
   {
-      std::string rxValue = pRemoteCharacteristic->readValue();
+    uint16_t end = min((uint16_t)(acked + BLE_BULK_WINDOW), count);
+    for (uint16_t i = acked; i < end; i++)
+    {
+      uint16_t offset = i * payload;
+      uint16_t len = min(payload, (uint16_t)(size - offset));
 
-      *rx_buffer_len = rxValue.length();
-      uint8_t *ptr = rx_buffer;
-      for (uint8_t i = 0; i < *rx_buffer_len; i++)
+      fragment[0] = BLE_FRAG_DATA | (i == 0 ? BLE_FRAG_FIRST : 0) | (i == count - 1 ? BLE_FRAG_LAST : 0);
+      fragment[1] = i;
+      memcpy(&fragment[BLE_FRAG_HEADER_LENGTH], &packet[offset], len);
+      pRemoteCharacteristic->writeValue(fragment, BLE_FRAG_HEADER_LENGTH + len, false);
+    }
+
+    int16_t ack = waitForAck();
+    if (ack < 0 || ack + 1 <= acked || ack >= end)
+    {
+      if (++retries > BLE_BULK_RETRIES)
       {
-        *ptr = rxValue[i];
-        ptr++;
+        if (BLE_client_debug_enable)
+          Serial.println("Bulk transfer not acknowledged.");
+        return false;
       }
-      //rx_buffer = (uint8_t *)(&rxValue[0]);
+      continue;
+    }
+
+    acked = ack + 1;
+    retries = 0;
+  }
+  return true;
+}
+
+bool BLE_isBulkTransfer()
+{
+  // acknowledgments are notified, core that does not implement bulk transfer keeps default MTU
+  return connected && bulk_transfer && notify_enabled && BLE_getMTU() > BLE_DEFAULT_MTU;
+}
+
+uint16_t BLE_getMaxFrameLength()
+{
+  if (!connected)
+    return 0;
+  return BLE_isBulkTransfer() ? BLE_MAX_FRAME_LENGTH : BLE_MAX_ATTR_LENGTH;
+}
+
+bool BLE_send(uint8_t packet[], uint16_t size)
+{
+  if (!connected || size > BLE_getMaxFrameLength())
+    return false;
+
+  if (BLE_isBulkTransfer())
+    return bulkSend(packet, size);
+
+  // write with response does not report status of write, failed write drops connection
+  pRemoteCharacteristic->writeValue(packet, size, true);
+  return connected && pClient->isConnected();
+}
+
+/**
+ * Function that takes one notification from receive ring, bytes above buffer size are dropped
+ * @param rx_buffer - Buffer for notification
+ * @param rx_buffer_len - Size of buffer, updated to number of stored bytes
+ **/
+static bool rxPop(uint8_t *rx_buffer, uint16_t *rx_buffer_len)
+{
+  bool ok = false;
+
+  portENTER_CRITICAL(&rx_mux);
+  if (rx_head != rx_tail)
+  {
+    uint16_t len;
+    rxRead((uint8_t *)&len, 2);
+    uint16_t copy_len = (len < *rx_buffer_len) ? len : *rx_buffer_len;
+    rxRead(rx_buffer, copy_len);
+    rxRead(NULL, len - copy_len);
+    *rx_buffer_len = copy_len;
+    ok = true;
+  }
+  portEXIT_CRITICAL(&rx_mux);
+
+  return ok;
+}
+
+/**
+ * Function that acknowledges fragments received from core
+ * @param seq - Sequence number of last fragment received in order
+ **/
+static void sendAck(uint8_t seq)
+{
+  uint8_t ack[BLE_FRAG_HEADER_LENGTH] = {BLE_FRAG_ACK, seq};
+  pRemoteCharacteristic->writeValue(ack, sizeof(ack), false);
+}
 
+/**
+ * Function that reassembles fragmented frame from notifications, notification without fragment header is returned as is
+ * @param rx_buffer - Buffer for frame
+ * @param rx_buffer_len - Size of buffer, updated to length of frame. Frame that does not fit fails, notification is truncated
+ * @param timeout - Time to wait for each notification (in milliseconds)
+ **/
+static bool bulkRecv(uint8_t *rx_buffer, uint16_t *rx_buffer_len, uint32_t timeout)
+{
+  static uint8_t fragment[BLE_BULK_MTU];
+  uint16_t len;
+  uint16_t capacity = *rx_buffer_len;
+  uint16_t frame_len = 0;
+  uint8_t expected = 0;
+
+  while (xSemaphoreTake(rx_sem, pdMS_TO_TICKS(timeout)) == pdTRUE)
+  {
+    len = sizeof(fragment);
+    if (!rxPop(fragment, &len))
+      continue;
+
+    bool is_fragment = len >= BLE_FRAG_HEADER_LENGTH && (fragment[0] & BLE_FRAG_TYPE_MASK) == BLE_FRAG_DATA;
+    if (!is_fragment)
+    {
+      if (frame_len > 0 || expected > 0 || (len > 0 && fragment[0] == BLE_FRAG_ACK))
+        continue;
+      if (len > capacity)
+        len = capacity;
+      memcpy(rx_buffer, fragment, len);
+      *rx_buffer_len = len;
       return true;
+    }
+
+    // fragment lost, core sends again everything after the last one received in order
+    if (fragment[1] != expected)
+    {
+      // nothing received in order yet, core sends window again after acknowledgment timeout
+      if (expected > 0)
+        sendAck(expected - 1);
+      continue;
+    }
+
+    len -= BLE_FRAG_HEADER_LENGTH;
+    if (frame_len + len > capacity)
+      return false;
+    memcpy(&rx_buffer[frame_len], &fragment[BLE_FRAG_HEADER_LENGTH], len);
+    frame_len += len;
+    expected++;
+
+    if (fragment[0] & BLE_FRAG_LAST)
+    {
+      sendAck(fragment[1]);
+      *rx_buffer_len = frame_len;
+      return true;
+    }
+    if (expected % BLE_BULK_WINDOW == 0)
+      sendAck(fragment[1]);
   }
   return false;
 }
 
+bool BLE_recv(uint8_t *rx_buffer, uint16_t *rx_buffer_len, uint32_t timeout)
+{
+  uint16_t capacity = *rx_buffer_len;
+
+  if (!connected)
+    return false;
+
+  // notification support is decided at connect, characteristic value would only hold the last written frame
+  if (notify_enabled)
+  {
+    if (bulk_transfer)
+    {
+      if (bulkRecv(rx_buffer, rx_buffer_len, timeout))
+        return true;
+    }
+    // semaphore counts notifications stored in ring
+    else if (xSemaphoreTake(rx_sem, pdMS_TO_TICKS(timeout)) == pdTRUE && rxPop(rx_buffer, rx_buffer_len))
+      return true;
+
+    if (BLE_client_debug_enable)
+      Serial.println("No response notified before timeout.");
+    *rx_buffer_len = 0;
+    return false;
+  }
+
+  // core that does not notify, response is read from characteristic
+  std::string rxValue = pRemoteCharacteristic->readValue();
+  *rx_buffer_len = (rxValue.length() < capacity) ? rxValue.length() : capacity;
+  memcpy(rx_buffer, rxValue.data(), *rx_buffer_len);
+
+  return true;
+}
+
 void BLE_getServerMac(uint8_t *server_mac)
 {
   for (int i = 0; i < 6; i++)
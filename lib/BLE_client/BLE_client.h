@@ -3,14 +3,103 @@
 
 #include "sensors.h"
 
+/// Duration of scan for core (in seconds)
+#define BLE_SCAN_TIME           5
+/// Preferred connection parameters (interval in 1.25 ms units, timeout in 10 ms units)
+#define BLE_CONN_MIN_INTERVAL   0x06
+#define BLE_CONN_MAX_INTERVAL   0x10
+#define BLE_CONN_LATENCY        0
+#define BLE_CONN_TIMEOUT        400
+/// Time to wait for response from core (in milliseconds)
+#define BLE_RECV_TIMEOUT        5000
+
+/// MTU requested in default and bulk transfer mode
+#define BLE_DEFAULT_MTU         100
+#define BLE_BULK_MTU            517
+/// Link layer payload requested with Data Length Extension
+#define BLE_BULK_DATA_LENGTH    251
+/// Number of fragments written without response before core acknowledges them
+#define BLE_BULK_WINDOW         8
+/// Time to wait for acknowledgment (in milliseconds) and number of window retransmissions
+#define BLE_BULK_ACK_TIMEOUT    500
+#define BLE_BULK_RETRIES        3
+/// Maximum length of reassembled frame
+#define BLE_MAX_FRAME_LENGTH    1024
+/// ATT header of write and notification
+#define BLE_ATT_HEADER_LENGTH   3
+/// Longest attribute value written at once (long write), longer frame needs bulk transfer
+#define BLE_MAX_ATTR_LENGTH     512
+/// Size of ring buffer for notifications received from core, it holds full window of bulk fragments with their lengths
+#define BLE_RX_BUFFER_SIZE      (BLE_BULK_WINDOW * (BLE_BULK_MTU - BLE_ATT_HEADER_LENGTH + 2) + 1)
+
+/// Bulk transfer fragment header: type with flags, sequence number
+#define BLE_FRAG_HEADER_LENGTH  2
+#define BLE_FRAG_DATA           0x10
+#define BLE_FRAG_FIRST          0x01
+#define BLE_FRAG_LAST           0x02
+#define BLE_FRAG_ACK            0x20
+#define BLE_FRAG_TYPE_MASK      0xF0
+
 void BLE_debugEnable(bool enable);
 
+/**
+ * Function that enables connecting to core found before deep sleep without scanning, it should be called before BLE_clientSetup()
+ * @param enable - True if address of core is cached in RTC memory
+ * @return No return value
+ */
+void BLE_setFastConnect(bool enable);
+
+/**
+ * Function that enables bulk transfer mode: large MTU, Data Length Extension and frames fragmented into
+ * writes without response, acknowledged by core every BLE_BULK_WINDOW fragments. It should be called before BLE_clientSetup()
+ * @param enable - True if bulk transfer is used
+ * @return No return value
+ */
+void BLE_setBulkTransfer(bool enable);
+
 void BLE_clientSetup(char *serv_uuid, char *char_uuid);
 
+/**
+ * Function that connects to core found by scan or cached before deep sleep, if connection is not open yet
+ * @return True if connected to core
+ */
 bool BLE_connectToServer();
 bool BLE_disconnectFromServer();
+/**
+ * Function that sends frame to core, in bulk transfer mode it is fragmented and sent without response
+ * @param packet - Frame to be sent
+ * @param size - Length of frame (at most BLE_getMaxFrameLength())
+ * @return True if frame is sent (and acknowledged in bulk transfer mode)
+ */
 bool BLE_send(uint8_t packet[], uint16_t size);
-bool BLE_recv(uint8_t *rx_buffer, uint16_t *rx_buffer_len);
+
+/**
+ * Function that checks if bulk transfer is used on current connection: it is enabled, core notifies and core
+ * accepted MTU larger than BLE_DEFAULT_MTU
+ * @return True if frames are fragmented by bulk transfer
+ */
+bool BLE_isBulkTransfer();
+
+/**
+ * Function that returns length of the longest frame that can be sent on current connection
+ * @return BLE_MAX_FRAME_LENGTH in bulk transfer mode, BLE_MAX_ATTR_LENGTH otherwise, 0 if not connected
+ */
+uint16_t BLE_getMaxFrameLength();
+/**
+ * Function that waits for response from core, it is taken from notifications if characteristic supports them,
+ * otherwise characteristic value is read. Fragmented response is reassembled.
+ * @param rx_buffer - Buffer for response
+ * @param rx_buffer_len - Size of buffer, updated to length of response. Longer response is truncated, longer fragmented frame fails
+ * @param timeout - Time to wait for notification (in milliseconds)
+ * @return True if response is received, false if not connected or nothing is notified before timeout
+ */
+bool BLE_recv(uint8_t *rx_buffer, uint16_t *rx_buffer_len, uint32_t timeout = BLE_RECV_TIMEOUT);
+
+/**
+ * Function that returns MTU of current connection, or MTU negotiated with cached core
+ * @return MTU in bytes
+ */
+uint16_t BLE_getMTU();
 
 void BLE_getServerMac(uint8_t *server_mac);
 void BLE_getMACStandalone(uint8_t *data);
@@ -1,4 +1,8 @@
 #include <Arduino.h>
+#include "driver/uart.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "RS485.h"
 
 //RS-485 pins
@@ -12,6 +16,25 @@
 
 bool RS485_debug_enable = false;
 
+// UART events, data event with timeout flag marks end of frame
+static QueueHandle_t rs485_queue = NULL;
+// frame is assembled here before it is copied to caller
+static uint8_t rs485_frame[RS485_MAX_FRAME_LENGTH];
+static uint32_t rs485_baudrate = 115200;
+// time between UART events within one frame, full FIFO has to fit in it (in milliseconds)
+static uint32_t rs485_frame_timeout = RS485_FRAME_TIMEOUT;
+// last byte of the last received frame (in microseconds from boot)
+static int64_t rs485_last_rx = 0;
+
+/**
+ * Function that returns duration of frame gap on the line (10 bits per character)
+ * @return Frame gap in microseconds
+ */
+static int64_t frameGap()
+{
+  return (int64_t)RS485_FRAME_GAP * 10 * 1000000 / rs485_baudrate;
+}
+
 void RS485_debugEnable(bool enable)
 {
   RS485_debug_enable = enable;
@@ -32,12 +55,29 @@ void RS485_debugPrint(int8_t *title, uint8_t *data, uint16_t data_len)
 
 void RS485_begin(uint32_t baudrate)
 {
-  RS485_STREAM.begin(baudrate, SERIAL_8N1, 26, 32); //RXD1=26, TXD1=32
+  uart_config_t config = {};
+  rs485_baudrate = baudrate;
+  // at low baud rates filling of FIFO takes longer than RS485_FRAME_TIMEOUT
+  rs485_frame_timeout = (uint32_t)((RS485_FIFO_THRESHOLD + RS485_FRAME_GAP) * 10 * 1000 / baudrate) + 1;
+  if (rs485_frame_timeout < RS485_FRAME_TIMEOUT)
+    rs485_frame_timeout = RS485_FRAME_TIMEOUT;
+  config.baud_rate = baudrate;
+  config.data_bits = UART_DATA_8_BITS;
+  config.parity = UART_PARITY_DISABLE;
+  config.stop_bits = UART_STOP_BITS_1;
+  config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+
+  // UART driver receives in ISR, task is woken only on full FIFO or line idle
+  uart_driver_install(RS485_UART, RS485_RX_BUFFER_SIZE, 0, RS485_EVENT_QUEUE_SIZE, &rs485_queue, 0);
+  uart_param_config(RS485_UART, &config);
+  uart_set_pin(RS485_UART, RS485_TX_PIN, RS485_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+  uart_set_rx_timeout(RS485_UART, RS485_FRAME_GAP);
 }
 
 void RS485_end()
 {
-  RS485_STREAM.end();
+  uart_driver_delete(RS485_UART);
+  rs485_queue = NULL;
 }
 
 void RS485_setMode(RS485_MODE mode)
@@ -65,66 +105,82 @@ void RS485_setMode(RS485_MODE mode)
 
 bool RS485_send(uint8_t packet[], uint16_t size)
 {
-  if (RS485_STREAM.write(packet, size) != size)
-  {
-    RS485_STREAM.flush();
-    return false;
-  }
-  RS485_STREAM.flush();
-  return true;
+  // anything received before request is not response to it
+  uart_flush_input(RS485_UART);
+  xQueueReset(rs485_queue);
+
+  bool ok = uart_write_bytes(RS485_UART, (const char *)packet, size) == size;
+
+  // driver stays enabled until last bit is on the line
+  uart_wait_tx_done(RS485_UART, portMAX_DELAY);
+  return ok;
 }
 
-bool RS485_recv(uint8_t rx_buffer[], uint16_t *size, uint32_t timeout)
+bool RS485_transmit(uint8_t packet[], uint16_t size)
 {
-  uint32_t t0 = millis();
-  while (!RS485_STREAM.available() && (millis() - t0) < timeout);
-  delay(100);
-  
-  
-  if (*size > RS485_STREAM.available())
-    *size = RS485_STREAM.available();
-
-  if (*size != 0)
-  {
-    RS485_STREAM.readBytes(rx_buffer, *size);
-    rx_buffer[*size] = 0;
-  }
+  // every unit on bus has to see end of previous frame before next one starts
+  int64_t wait = rs485_last_rx + frameGap() - esp_timer_get_time();
+  if (wait > 0)
+    delayMicroseconds(wait);
 
-  if (RS485_debug_enable)
-  {
-    RS485_debugPrint((int8_t *) "rs485 rec", (uint8_t *) rx_buffer, *size);
-  }
+  RS485_setMode(RS485_TX);
+  delayMicroseconds(RS485_DE_SETUP_US);
+  bool ok = RS485_send(packet, size);
+  RS485_setMode(RS485_RX);
 
-  return true;
+  return ok;
 }
 
-
-// from old main
-void dummy()
+bool RS485_recv(uint8_t rx_buffer[], uint16_t *size, uint32_t timeout)
 {
-  //TODO: RS-485 code
-  /*while (!RS485.available());
-  delay(50);
+  uart_event_t event;
+  uint16_t frame_len = 0;
+  bool complete = false;
 
-  if (RS485.available() == sizeof(sensor_data))
-  {
-    LED_setColor(BLUE);
+  if (rs485_queue == NULL)
+    return false;
 
-    //read sensor data from the serial buffer
-    uint8_t *ptr = &packet[6];
-    for (uint8_t i = 0; i < sizeof(sensor_data); i++)
+  // first event has to arrive before timeout, the rest of frame follows within gap
+  while (!complete && xQueueReceive(rs485_queue, &event, frame_len == 0 ? pdMS_TO_TICKS(timeout) : pdMS_TO_TICKS(rs485_frame_timeout)) == pdTRUE)
+  {
+    switch (event.type)
     {
-      *ptr = RS485.read();
-      ptr++;
+      case UART_DATA:
+      {
+        uint16_t len = event.size;
+        if (frame_len + len > sizeof(rs485_frame))
+          len = sizeof(rs485_frame) - frame_len;
+        frame_len += uart_read_bytes(RS485_UART, &rs485_frame[frame_len], len, 0);
+
+        // data event caused by idle line ends frame
+        complete = event.timeout_flag || frame_len == sizeof(rs485_frame);
+        // idle event comes frame gap after the last byte, that gap is already seen by every unit
+        rs485_last_rx = esp_timer_get_time() - (event.timeout_flag ? frameGap() : 0);
+        break;
+      }
+
+      case UART_FIFO_OVF:
+      case UART_BUFFER_FULL:
+        // frame is lost, line is left to the next one
+        uart_flush_input(RS485_UART);
+        xQueueReset(rs485_queue);
+        frame_len = 0;
+        break;
+
+      default:
+        break;
     }
-    sensor_data *sd = (sensor_data *)(&packet[6]);
-    printSensorData(*sd);
-    BG96_TxRxSensorData(SERVER_IP, 58088, packet, sizeof(packet));
-    
-    LED_setColor(BLACK); 
-  }*/
-
-//  String cmd = RS485.readString();
-//  Serial.println(cmd);
-}
+  }
 
+  if (*size > frame_len)
+    *size = frame_len;
+  memcpy(rx_buffer, rs485_frame, *size);
+  rx_buffer[*size] = 0;
+
+  if (RS485_debug_enable)
+  {
+    RS485_debugPrint((int8_t *) "rs485 rec", (uint8_t *) rx_buffer, *size);
+  }
+
+  return *size != 0;
+}
@@ -1,9 +1,26 @@
 #ifndef _RS485_H
 #define _RS485_H
 
-#define RS485_STREAM Serial1
+#define RS485_UART   UART_NUM_1
 #define DEBUG_STREAM Serial
 
+/// RS485 UART pins
+#define RS485_RX_PIN            26
+#define RS485_TX_PIN            32
+/// Size of UART driver receive ring buffer and of preallocated frame buffer
+#define RS485_RX_BUFFER_SIZE    1024
+#define RS485_MAX_FRAME_LENGTH  1024
+/// Depth of UART event queue
+#define RS485_EVENT_QUEUE_SIZE  16
+/// Silence after which received frame is complete, in character times (Modbus t3.5 rounded up)
+#define RS485_FRAME_GAP         4
+/// Minimum time between UART events within one frame (in milliseconds), raised at low baud rates
+#define RS485_FRAME_TIMEOUT     50
+/// RX FIFO full threshold of UART driver (IDF default), data event is raised after this many bytes
+#define RS485_FIFO_THRESHOLD    120
+/// Time from driver enable to first bit, covers transceiver enable time (in microseconds)
+#define RS485_DE_SETUP_US       5
+
 #include <stdint.h>
 
 /// RS485 modes
@@ -54,10 +71,20 @@ void RS485_setMode(RS485_MODE mode);
 bool RS485_send(uint8_t packet[], uint16_t size);
 
 /**
- * Function that reads recieved data via RS485 communication channel
- * @param packet -  Buffer to which data will be written to
- * @param size - ???
- * @return ??
+ * Function that sends frame on shared bus: it waits RS485_FRAME_GAP character times after the last received frame,
+ * enables driver, sends frame and releases bus as soon as the last bit is sent
+ * @param packet - Buffer that contains data to be sent
+ * @param size - Number of bytes that need to be sent
+ * @return Returns true on successful transmission
+ */
+bool RS485_transmit(uint8_t packet[], uint16_t size);
+
+/**
+ * Function that waits for one frame, frame ends with RS485_FRAME_GAP character times of silence on the line
+ * @param rx_buffer - Buffer to which frame will be written to, frame is terminated with zero byte
+ * @param size - Size of buffer without terminating byte, it is set to length of received frame
+ * @param timeout - Time to wait for start of frame (in milliseconds)
+ * @return Returns true if frame is received
  */
 bool RS485_recv(uint8_t rx_buffer[], uint16_t *size, uint32_t timeout);
 
@@ -7,9 +7,31 @@
 #include <WiFiMulti.h>
 #include <WiFiUdp.h>
 #include <PubSubClient.h>
+#include <trace.h>
 
 #define ATTEMPTS_NUM 20
 
+#define WIFI_CACHE_MAGIC 0x57494649
+
+/// Parameters of last connection kept across deep sleep
+typedef struct
+{
+  uint32_t magic;
+  char ssid[33];
+  uint8_t bssid[6];
+  int32_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint32_t lease_time;
+} WiFi_cache;
+
+RTC_DATA_ATTR WiFi_cache wifi_cache;
+
+// static IP configuration (not used if ip is 0)
+IPAddress static_ip((uint32_t)0), static_gateway((uint32_t)0), static_subnet((uint32_t)0), static_dns((uint32_t)0);
+
 WiFiUDP udp;
 WiFiMulti wifiMulti;
 WiFiClient tcp;
@@ -25,10 +47,109 @@ void WiFI_debugEnable(bool enable)
   WIFI_debug_enable = enable;
 }
 
+bool WiFi_setStaticIP(const char *ip, const char *gateway, const char *subnet, const char *dns)
+{
+  if (!static_ip.fromString(ip) || !static_gateway.fromString(gateway) || !static_subnet.fromString(subnet))
+  {
+    static_ip = (uint32_t)0;
+    return false;
+  }
+  if (!static_dns.fromString(dns))
+    static_dns = static_gateway;
+  return true;
+}
+
+/**
+* Function that stores parameters of current connection in RTC memory.
+* @param ssid - pointer to string that represents WIFI service set identifier (ssid)
+* @param new_lease - true if IP address is obtained by DHCP in this connection
+* @return - no return value
+*/
+void WiFi_saveCache(const char* ssid, bool new_lease)
+{
+  if (new_lease)
+    wifi_cache.lease_time = time(NULL);
+
+  strncpy(wifi_cache.ssid, ssid, sizeof(wifi_cache.ssid) - 1);
+  wifi_cache.ssid[sizeof(wifi_cache.ssid) - 1] = '\0';
+  memcpy(wifi_cache.bssid, WiFi.BSSID(), 6);
+  wifi_cache.channel = WiFi.channel();
+  wifi_cache.ip = WiFi.localIP();
+  wifi_cache.gateway = WiFi.gatewayIP();
+  wifi_cache.subnet = WiFi.subnetMask();
+  wifi_cache.dns = WiFi.dnsIP();
+  wifi_cache.magic = WIFI_CACHE_MAGIC;
+}
+
+/**
+* Function that connects to access point stored in RTC memory.
+* @param ssid - pointer to string that represents WIFI service set identifier (ssid)
+* @param pass - pointer to string that represents WIFI password
+* @return - true if connection is established, otherwise false
+*/
+bool WiFi_fastConnect(const char* ssid, const char* pass)
+{
+  if (wifi_cache.magic != WIFI_CACHE_MAGIC || strncmp(wifi_cache.ssid, ssid, sizeof(wifi_cache.ssid)) != 0)
+    return false;
+
+  // DHCP is skipped with static IP or recent lease, lease is not reused after it could be given to someone else
+  uint32_t now = time(NULL);
+  bool dhcp = false;
+  if ((uint32_t)static_ip != 0)
+    WiFi.config(static_ip, static_gateway, static_subnet, static_dns);
+  else if (now >= wifi_cache.lease_time && now - wifi_cache.lease_time < WIFI_LEASE_REUSE_TIME)
+    WiFi.config(IPAddress(wifi_cache.ip), IPAddress(wifi_cache.gateway), IPAddress(wifi_cache.subnet), IPAddress(wifi_cache.dns));
+  else
+    dhcp = true;
+
+  // no scan, access point is known
+  WiFi.begin(ssid, pass, wifi_cache.channel, wifi_cache.bssid);
+
+  uint32_t t0 = millis();
+  while (WiFi.status() != WL_CONNECTED)
+  {
+    if (millis() - t0 >= WIFI_FAST_CONNECT_TIMEOUT)
+    {
+      if (WIFI_debug_enable)
+        Serial.println("Fast connect failed");
+      wifi_cache.magic = 0;
+      WiFi.disconnect();
+      // go back to DHCP for full connect
+      if ((uint32_t)static_ip == 0)
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+      return false;
+    }
+    delay(10);
+  }
+
+  if (dhcp)
+    WiFi_saveCache(ssid, true);
+
+  if (WIFI_debug_enable)
+    Serial.println("Fast connect in " + String(millis() - t0) + " ms, IP address: " + WiFi.localIP().toString());
+
+  return true;
+}
+
 void WiFi_setup(const char* ssid, const char* pass)
 {
   uint32_t num_of_attempts = 100;
 
+  TRC_begin(TRC_WIFI_CONNECT);
+
+  // connection parameters are kept in RTC memory instead of flash
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_STA);
+
+  if (WiFi_fastConnect(ssid, pass))
+  {
+    TRC_end(TRC_WIFI_CONNECT);
+    return;
+  }
+
+  if ((uint32_t)static_ip != 0)
+    WiFi.config(static_ip, static_gateway, static_subnet, static_dns);
+
   if (WIFI_debug_enable)
     Serial.print("Connecting to WiFi");
   
@@ -43,6 +164,10 @@ void WiFi_setup(const char* ssid, const char* pass)
     if (--num_of_attempts == 0)
       break;
   } while (!(wifiMulti.run() == WL_CONNECTED));
+
+  if (WiFi.status() == WL_CONNECTED)
+    WiFi_saveCache(ssid, (uint32_t)static_ip == 0);
+  TRC_end(TRC_WIFI_CONNECT);
   
   if (WIFI_debug_enable)
   {
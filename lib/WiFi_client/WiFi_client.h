@@ -4,14 +4,29 @@
 /// used libraries
 #include <WiFi.h>
 
+/// maximum time to wait for connection to cached access point before full scan (in milliseconds)
+#define WIFI_FAST_CONNECT_TIMEOUT   1000
+/// maximum age of cached DHCP lease that is reused without DHCP (in seconds)
+#define WIFI_LEASE_REUSE_TIME       3600
+
 /**
-* Function used to connect to WIFI network.
+* Function used to connect to WIFI network. Access point (BSSID and channel) and IP configuration of last connection
+* are kept in RTC memory and reused after deep sleep, full scan is performed only if fast connect fails.
 * @param ssid - pointer to string that represents WIFI service set identifier (ssid)
 * @param pass - pointer to string that represents WIFI password
 * @return - no return value
 */
 void WiFi_setup(const char* ssid, const char* pass);
 /**
+* Function used to set static IP configuration, so DHCP is not used. Should be called before WiFi_setup().
+* @param ip - pointer to string that represents IP address
+* @param gateway - pointer to string that represents gateway address
+* @param subnet - pointer to string that represents subnet mask
+* @param dns - pointer to string that represents DNS server address
+* @return - true if addresses are valid, otherwise false
+*/
+bool WiFi_setStaticIP(const char *ip, const char *gateway, const char *subnet, const char *dns);
+/**
 * Function used to reconnect to WIFI network.
 * @return - no return value
 */
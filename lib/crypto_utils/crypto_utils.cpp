@@ -31,44 +31,106 @@ bool Crypto_Digest(mbedtls_md_context_t *ctx, DIGEST_TYPE d_type, uint8_t *input
     mbedtls_md_type_t md_type = MBEDTLS_MD_SHA256;
     mbedtls_md_init(ctx);
 
-    if (mbedtls_md_setup(ctx, mbedtls_md_info_from_type(md_type), d_type) != 0)
-      return false;
+    bool ok = mbedtls_md_setup(ctx, mbedtls_md_info_from_type(md_type), d_type) == 0;
     
-    if (d_type == SHA256)
+    if (ok && d_type == SHA256)
     {
-      if (mbedtls_md_starts(ctx) != 0)
-        return false;
-
-      if (mbedtls_md_update(ctx, (const unsigned char *) input, input_size) != 0)
-        return false;
-
-      if (mbedtls_md_finish(ctx, output) != 0)
-        return false;
+      ok = mbedtls_md_starts(ctx) == 0 &&
+           mbedtls_md_update(ctx, (const unsigned char *) input, input_size) == 0 &&
+           mbedtls_md_finish(ctx, output) == 0;
     }
-    else if (d_type == HMAC_SHA256)
+    else if (ok && d_type == HMAC_SHA256)
     {
-      if (mbedtls_md_hmac_starts(ctx, (const unsigned char *) key, key_len))
-        return false;
-
-      if (mbedtls_md_hmac_update(ctx, (const unsigned char *) input, input_size) != 0)
-        return false;
-
-      if (mbedtls_md_hmac_finish(ctx, output) != 0)
-        return false;
+      ok = mbedtls_md_hmac_starts(ctx, (const unsigned char *) key, key_len) == 0 &&
+           mbedtls_md_hmac_update(ctx, (const unsigned char *) input, input_size) == 0 &&
+           mbedtls_md_hmac_finish(ctx, output) == 0;
     }
     else
     {
-      return false;
+      ok = false;
     }
 
+    // setup allocates state on heap, so context is freed on failure as well
     mbedtls_md_free(ctx);
 
-    if (crypto_debug_enable)
+    if (ok && crypto_debug_enable)
       Crypto_debugPrint((int8_t *)"digest", output, 32);
 
+    return ok;
+}
+
+bool Crypto_HMACSetKey(Crypto_HMACKey *hkey, uint8_t *key, uint16_t key_len)
+{
+    const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    uint8_t block[CRYPTO_SHA256_BLOCK_SIZE];
+
+    Crypto_HMACFree(hkey);
+    mbedtls_md_init(&hkey->inner);
+    mbedtls_md_init(&hkey->outer);
+    mbedtls_md_init(&hkey->work);
+    hkey->ready = true;
+
+    bool ok = mbedtls_md_setup(&hkey->inner, md_info, 0) == 0 &&
+              mbedtls_md_setup(&hkey->outer, md_info, 0) == 0 &&
+              mbedtls_md_setup(&hkey->work, md_info, 0) == 0;
+
+    // key longer than block is replaced by its hash (RFC 2104)
+    memset(block, 0x00, sizeof(block));
+    if (key_len > CRYPTO_SHA256_BLOCK_SIZE)
+      ok = ok && mbedtls_md(md_info, key, key_len, block) == 0;
+    else
+      memcpy(block, key, key_len);
+
+    for (uint8_t i = 0; i < CRYPTO_SHA256_BLOCK_SIZE; i++)
+      block[i] ^= 0x36;
+    ok = ok && mbedtls_md_starts(&hkey->inner) == 0 && mbedtls_md_update(&hkey->inner, block, sizeof(block)) == 0;
+
+    // 0x36 ^ 0x5c turns ipad into opad
+    for (uint8_t i = 0; i < CRYPTO_SHA256_BLOCK_SIZE; i++)
+      block[i] ^= 0x36 ^ 0x5c;
+    ok = ok && mbedtls_md_starts(&hkey->outer) == 0 && mbedtls_md_update(&hkey->outer, block, sizeof(block)) == 0;
+
+    memset(block, 0x00, sizeof(block));
+    if (!ok)
+      Crypto_HMACFree(hkey);
+    return ok;
+}
+
+bool Crypto_HMAC(Crypto_HMACKey *hkey, uint8_t *input, uint16_t input_size, uint8_t *output)
+{
+    uint8_t inner_hash[CRYPTO_SHA256_SIZE];
+
+    if (!hkey->ready)
+      return false;
+
+    // work context continues from precomputed states, so padded key is not hashed again
+    if (mbedtls_md_clone(&hkey->work, &hkey->inner) != 0 ||
+        mbedtls_md_update(&hkey->work, (const unsigned char *) input, input_size) != 0 ||
+        mbedtls_md_finish(&hkey->work, inner_hash) != 0)
+      return false;
+
+    if (mbedtls_md_clone(&hkey->work, &hkey->outer) != 0 ||
+        mbedtls_md_update(&hkey->work, inner_hash, sizeof(inner_hash)) != 0 ||
+        mbedtls_md_finish(&hkey->work, output) != 0)
+      return false;
+
+    if (crypto_debug_enable)
+      Crypto_debugPrint((int8_t *)"hmac", output, CRYPTO_SHA256_SIZE);
+
     return true;
 }
 
+void Crypto_HMACFree(Crypto_HMACKey *hkey)
+{
+    if (!hkey->ready)
+      return;
+
+    mbedtls_md_free(&hkey->inner);
+    mbedtls_md_free(&hkey->outer);
+    mbedtls_md_free(&hkey->work);
+    hkey->ready = false;
+}
+
 bool Crypto_keyGen(mbedtls_ecdh_context *ecdh_ctx, mbedtls_ctr_drbg_context *drbg_ctx, mbedtls_ecp_group_id curve_type)
 {
     mbedtls_ecdh_init(ecdh_ctx);
@@ -94,33 +156,37 @@ bool Crypto_ECDH(mbedtls_ecdh_context *ctx)
 bool Crypto_AES(mbedtls_aes_context *ctx, ENCRYPTION_DIRECTION_TYPE ed_type, uint8_t *key, uint16_t key_len, uint8_t iv[16], uint8_t *input, uint8_t *output, uint16_t length)
 {
     mbedtls_aes_init(ctx);
-    uint16_t padding = 16 - length % 16;
+    int mode;
 
-    // prepraviti padding
-    uint8_t tmp[128];
-    memset(tmp, 0x00, 128);
-    memcpy(tmp, input, length);
+    // full blocks are processed in place, the last block is padded with 1 to 16 zero bytes
+    uint16_t full_length = length - length % 16;
+    uint8_t tmp[16];
+    memset(tmp, 0x00, 16);
+    memcpy(tmp, input + full_length, length - full_length);
 
     if (ed_type == ENCRYPT)
     {
       if (mbedtls_aes_setkey_enc(ctx, (const unsigned char*) key, key_len) != 0)
         return false;
-      
-      if (mbedtls_aes_crypt_cbc(ctx, (int)MBEDTLS_AES_ENCRYPT, length + padding, iv, tmp, output) != 0)
-        return false;
+      mode = MBEDTLS_AES_ENCRYPT;
     }
     else if (ed_type == DECRYPT)
     {
       if (mbedtls_aes_setkey_dec(ctx, (const unsigned char*) key, key_len) != 0)
         return false;
-      
-      if (mbedtls_aes_crypt_cbc(ctx, (int)MBEDTLS_AES_DECRYPT, length + padding, iv, tmp, output) != 0)
-        return false;
+      mode = MBEDTLS_AES_DECRYPT;
     }
     else
     {
       return false;
     }
+
+    // iv is updated by each call, so chaining continues in the last block
+    if (full_length > 0 && mbedtls_aes_crypt_cbc(ctx, mode, full_length, iv, input, output) != 0)
+      return false;
+    if (mbedtls_aes_crypt_cbc(ctx, mode, 16, iv, tmp, output + full_length) != 0)
+      return false;
+
     mbedtls_aes_free(ctx);
 
     if (crypto_debug_enable)
@@ -16,6 +16,19 @@ typedef enum {SHA256, HMAC_SHA256} DIGEST_TYPE;
 /// type of encryption direction
 typedef enum {ENCRYPT, DECRYPT} ENCRYPTION_DIRECTION_TYPE;
 
+/// block and output size of SHA256
+#define CRYPTO_SHA256_BLOCK_SIZE  64
+#define CRYPTO_SHA256_SIZE        32
+
+/// HMAC_SHA256 key with precomputed inner (key ^ ipad) and outer (key ^ opad) hash states
+typedef struct
+{
+  mbedtls_md_context_t inner;
+  mbedtls_md_context_t outer;
+  mbedtls_md_context_t work;
+  bool ready;
+} Crypto_HMACKey;
+
 /**
 * Function used for random number generator initialization.
 * @param ctx - pointer to random number generator context that is used
@@ -45,6 +58,29 @@ bool Crypto_Random(mbedtls_ctr_drbg_context *ctx, uint8_t *output, uint16_t outp
 */
 bool Crypto_Digest(mbedtls_md_context_t *ctx, DIGEST_TYPE d_type, uint8_t *input, uint16_t input_size, uint8_t *output, uint8_t *key = NULL, uint16_t key_len = 0);
 /**
+* Function that prepares HMAC_SHA256 key, hash states of padded key are computed once and reused for every message.
+* @param hkey - pointer to key structure (zero initialized before first use), previous key is freed
+* @param key - pointer to buffer where key is stored
+* @param key_len - length of key in bytes
+* @return - true if operation is successful, otherwise false
+*/
+bool Crypto_HMACSetKey(Crypto_HMACKey *hkey, uint8_t *key, uint16_t key_len);
+/**
+* Function used to generate HMAC_SHA256 digest with key prepared by Crypto_HMACSetKey().
+* @param hkey - pointer to prepared key structure
+* @param input - pointer to buffer where input bytes of data are stored
+* @param input_size - length of input data bytes
+* @param output - pointer to buffer where output bytes (digest) of data will be stored (32 bytes)
+* @return - true if operation is successful, otherwise false
+*/
+bool Crypto_HMAC(Crypto_HMACKey *hkey, uint8_t *input, uint16_t input_size, uint8_t *output);
+/**
+* Function that frees key prepared by Crypto_HMACSetKey().
+* @param hkey - pointer to key structure
+* @return - no return value
+*/
+void Crypto_HMACFree(Crypto_HMACKey *hkey);
+/**
 * Function that performs AES encryption.
 * @param ctx - pointer to aes context that is used
 * @param ed_type - type of encryption direction to be used (encrypt/decrypt)
@@ -33,27 +33,40 @@ void FS_listDir(fs::FS &fs, const char * dirname, uint8_t levels)
     }
 }
 
-int16_t FS_readFile(fs::FS &fs, const char * path, char output_buffer[])
+int16_t FS_readFile(fs::FS &fs, const char * path, char output_buffer[], uint16_t size)
 {
-  String tmp = "";
+#ifndef FAST_BOOT
   Serial.printf("Reading file: %s\r\n", path);
+#endif
 
+  output_buffer[0] = '\0';
   File file = fs.open(path);
   if(!file || file.isDirectory()){
+#ifndef FAST_BOOT
       Serial.println("- failed to open file for reading");
+#endif
       return 0;
   }
 
-  Serial.println("- read from file:");
-  int16_t i = 0;
-  while(file.available())
-  {
-    output_buffer[i] = file.read();
-    Serial.write(output_buffer[i++]);
+  if(file.size() >= size){
+#ifndef FAST_BOOT
+      Serial.println("- file too large for buffer");
+#endif
+      file.close();
+      return 0;
   }
+
+  // whole file is read in one call instead of byte by byte
+  int16_t i = file.read((uint8_t *)output_buffer, file.size());
+  if (i < 0)
+    i = 0;
   output_buffer[i] = '\0';
   file.close();
-  Serial.println();
+
+#ifndef FAST_BOOT
+  Serial.println("- read from file:");
+  Serial.println(output_buffer);
+#endif
   return i;
 }
 
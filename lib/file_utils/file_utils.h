@@ -22,9 +22,10 @@ void FS_listDir(fs::FS &fs, const char * dirname, uint8_t levels);
  * @param fs - File system
  * @param path - Path to file that neads to be read
  * @param output_buffer - Buffer in which content of file is written to
- * @return Number of characters read from file
+ * @param size - Size of output buffer, file has to be shorter than it to leave room for terminator
+ * @return Number of characters read from file, 0 if file can't be read or doesn't fit in buffer
  **/
-int16_t FS_readFile(fs::FS &fs, const char * path, char output_buffer[]);
+int16_t FS_readFile(fs::FS &fs, const char * path, char output_buffer[], uint16_t size);
 
 /**
  * Function that writes data in file
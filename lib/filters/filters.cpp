@@ -0,0 +1,118 @@
+#include "filters.h"
+
+/// Filter state of one sensor type
+typedef struct
+{
+  int32_t window[FLT_MAX_MEDIAN];
+  uint8_t count;
+  uint8_t index;
+  int32_t ewma;
+  bool ewma_valid;
+} FLT_state;
+
+// filter state kept across deep sleep
+RTC_DATA_ATTR FLT_state flt_state[NUMBER_OF_SENSOR_TYPES];
+
+/**
+ * Function that adds value to median window and returns median of window
+ * @param state - Filter state
+ * @param size - Size of median window
+ * @param value - New value
+ * @return Median of values in window
+ **/
+static int32_t FLT_median(FLT_state *state, uint8_t size, int32_t value)
+{
+  int32_t sorted[FLT_MAX_MEDIAN];
+
+  // window size changed, old values are dropped
+  if (state->index >= size || state->count > size)
+  {
+    state->index = 0;
+    state->count = 0;
+  }
+
+  state->window[state->index] = value;
+  state->index = (state->index + 1) % size;
+  if (state->count < size)
+    state->count++;
+
+  // insertion sort, window is small
+  for (uint8_t i = 0; i < state->count; i++)
+  {
+    int32_t v = state->window[i];
+    int8_t j = i - 1;
+    while (j >= 0 && sorted[j] > v)
+    {
+      sorted[j + 1] = sorted[j];
+      j--;
+    }
+    sorted[j + 1] = v;
+  }
+
+  return sorted[state->count / 2];
+}
+
+/**
+ * Function that divides value by 2^shift rounding half away from zero, plain shift of negative value
+ * rounds toward minus infinity and filtered value would settle below falling input
+ * @param value - Value to divide
+ * @param shift - Number of bits
+ * @return Rounded quotient
+ **/
+static int64_t FLT_roundShift(int64_t value, uint8_t shift)
+{
+  if (shift == 0)
+    return value;
+
+  int64_t half = (int64_t)1 << (shift - 1);
+  return value >= 0 ? (value + half) >> shift : -((-value + half) >> shift);
+}
+
+/**
+ * Function that updates EWMA accumulator with new value and returns filtered value
+ * @param state - Filter state
+ * @param shift - Smoothing factor is 1 / 2^shift
+ * @param value - New value
+ * @return Filtered value rounded to integer
+ **/
+static int32_t FLT_ewma(FLT_state *state, uint8_t shift, int32_t value)
+{
+  int64_t scaled = (int64_t)value << FLT_EWMA_FRAC_BITS;
+
+  if (!state->ewma_valid)
+  {
+    state->ewma = scaled;
+    state->ewma_valid = true;
+  }
+  else
+    state->ewma += FLT_roundShift(scaled - state->ewma, shift);
+
+  return FLT_roundShift(state->ewma, FLT_EWMA_FRAC_BITS);
+}
+
+void FLT_apply(sensor_data *sd, sensors_config *sc, const FLT_config *fc)
+{
+  for (uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+  {
+    const sensor_descriptor *desc = &sensor_descriptors[i];
+
+    if (desc->type == TIMESTAMP || !isSensorEnabled(sc, desc))
+      continue;
+
+    uint8_t median = fc[i].median < FLT_MAX_MEDIAN ? fc[i].median : FLT_MAX_MEDIAN;
+    uint8_t shift = fc[i].ewma_shift < FLT_MAX_EWMA_SHIFT ? fc[i].ewma_shift : FLT_MAX_EWMA_SHIFT;
+    int32_t value = getSensorValue(sd, desc);
+
+    if (median > 1)
+      value = FLT_median(&flt_state[i], median, value);
+    if (shift > 0)
+      value = FLT_ewma(&flt_state[i], shift, value);
+
+    setSensorValue(sd, desc, value);
+  }
+}
+
+void FLT_reset()
+{
+  memset(flt_state, 0, sizeof(flt_state));
+}
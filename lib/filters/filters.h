@@ -0,0 +1,39 @@
+#ifndef _FILTERS_H
+#define _FILTERS_H
+
+#include <Arduino.h>
+#include "sensors.h"
+
+/// Maximum number of readings in median window
+#define FLT_MAX_MEDIAN      7
+/// Number of fractional bits of EWMA accumulator
+#define FLT_EWMA_FRAC_BITS  8
+/// Maximum EWMA shift (smoothing factor is 1 / 2^shift)
+#define FLT_MAX_EWMA_SHIFT  8
+
+/// Filter configuration of one sensor type
+typedef struct FLT_config
+{
+  // Number of last readings from which median is taken (0 or 1 disables median)
+  uint8_t median;
+  // EWMA smoothing factor is 1 / 2^ewma_shift (0 disables EWMA)
+  uint8_t ewma_shift;
+} FLT_config;
+
+/**
+ * Function that filters enabled sensor values in place, median of last readings is taken first and then EWMA
+ * is applied. State of filters is kept in RTC memory across deep sleep. Timestamp is never filtered.
+ * @param sd - Sensor data structure with new reading, values are replaced with filtered ones
+ * @param sc - Sensor configuration
+ * @param fc - Filter configuration, one for each sensor type (indexed by sensor type)
+ * @return No return value
+ **/
+void FLT_apply(sensor_data *sd, sensors_config *sc, const FLT_config *fc);
+
+/**
+ * Function that clears state of all filters, next reading is used as is
+ * @return No return value
+ **/
+void FLT_reset();
+
+#endif
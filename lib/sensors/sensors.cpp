@@ -5,6 +5,8 @@
 #include <SparkFunBME280.h>
 #include <Zanshin_BME680.h>
 #include <ArduinoJson.h>
+#include <ulp_sampler.h>
+#include <trace.h>
 #include "sensors.h"
 
 // DS18B20 soil temperature 
@@ -13,6 +15,9 @@ OneWire DS18B20_onewire_2(19);
 DallasTemperature DS18B20_1(&DS18B20_onewire_1);
 DallasTemperature DS18B20_2(&DS18B20_onewire_2);
 
+// Start of running DS18B20 conversion (in milliseconds), 0 if no conversion is running
+uint32_t DS18B20_conversion_start = 0;
+
 // Soil moisture sensors
 #define SOIL_IN_1  35
 #define SOIL_IN_2  4
@@ -24,22 +29,100 @@ BH1750FVI::eDeviceAddress_t DEVICEADDRESS = BH1750FVI::k_DevAddress_L;
 BH1750FVI::eDeviceMode_t DEVICEMODE = BH1750FVI::k_DevModeContHighRes;
 BH1750FVI LightSensor(23, DEVICEADDRESS, DEVICEMODE);
 
+// sensor init output is compiled out in fast boot build
+#ifdef FAST_BOOT
+#define SENSORS_PRINT(x)
+#define SENSORS_PRINTLN(x)
+#else
+#define SENSORS_PRINT(x)   Serial.print(x)
+#define SENSORS_PRINTLN(x) Serial.println(x)
+#endif
+
 // BME280
 BME280 bme280; //Uses I2C address 0x76 (jumper closed)
 BME680_Class BME680;
 
+#define SENSOR(type, flag, member, is_signed, scale, name, unit, key) \
+  { type, offsetof(sensors_config, flag), offsetof(sensor_data, member), member_size(sensor_data, member), is_signed, scale, name, unit, key }
+
+const sensor_descriptor sensor_descriptors[NUMBER_OF_SENSOR_TYPES] = {
+  SENSOR(AIR_TEMPERATURE,    air_temp,     air_temp,     true,  100, "Air temperature",    "\xC2\xB0\x43", "air_temperature"),
+  SENSOR(AIR_HUMIDITY,       air_hum,      air_hum,      true,  100, "Air humidity",       "%",               "air_humidity"),
+  SENSOR(AIR_PRESSURE,       air_pres,     air_pres,     true,  100, "Air pressure",       "mBar",            "air_pressure"),
+  SENSOR(SOIL_TEMPERATURE_1, soil_temp_1,  soil_temp_1,  true,  100, "Soil temperature 1", "\xC2\xB0\x43", "soil_temperature_1"),
+  SENSOR(SOIL_TEMPERATURE_2, soil_temp_2,  soil_temp_2,  true,  100, "Soil temperature 2", "\xC2\xB0\x43", "soil_temperature_2"),
+  SENSOR(SOIL_MOISTURE_1,    soil_moist_1, soil_moist_1, true,  1,   "Soil moisture 1",    "%",               "soil_moisture_1"),
+  SENSOR(SOIL_MOISTURE_2,    soil_moist_2, soil_moist_2, true,  1,   "Soil moisture 2",    "%",               "soil_moisture_2"),
+  SENSOR(LUMINOSITY,         lum,          lum,          false, 1,   "Luminosity",         "lux",             "luminosity"),
+  SENSOR(TIMESTAMP,          timestamp,    timestamp,    false, 1,   "Timestamp",          "s",               "timestamp"),
+};
+
+// Last reported reading, reference for report by exception
+RTC_DATA_ATTR sensor_data last_reported_data;
+RTC_DATA_ATTR uint32_t last_report_time = 0;
+RTC_DATA_ATTR bool last_report_valid = false;
+
+// Compact encoding reference of this device and reading waiting for delivery result
+RTC_DATA_ATTR compact_state compact_encoder = {};
+sensor_data compact_pending;
+uint16_t compact_pending_bitmap = 0;
+bool compact_pending_keyframe = false;
+
+// Compact decoding reference used by convertToSensorData
+compact_state compact_decoder = {};
+
+bool isSensorEnabled(const sensors_config *sc, const sensor_descriptor *desc)
+{
+  return *(const bool *)((const uint8_t *)sc + desc->enabled);
+}
+
+void setSensorEnabled(sensors_config *sc, const sensor_descriptor *desc, bool enabled)
+{
+  *(bool *)((uint8_t *)sc + desc->enabled) = enabled;
+}
+
+int64_t getSensorValue(const sensor_data *sd, const sensor_descriptor *desc)
+{
+  const uint8_t *value = (const uint8_t *)sd + desc->value;
+
+  switch(desc->width)
+  {
+    case 1:
+      return desc->is_signed ? (int64_t)*(const int8_t *)value : (int64_t)*(const uint8_t *)value;
+    case 2:
+      return desc->is_signed ? (int64_t)*(const int16_t *)value : (int64_t)*(const uint16_t *)value;
+    case 4:
+      return desc->is_signed ? (int64_t)*(const int32_t *)value : (int64_t)*(const uint32_t *)value;
+    default:
+      return 0;
+  }
+}
+
+void setSensorValue(sensor_data *sd, const sensor_descriptor *desc, int64_t value)
+{
+  // values are little endian, same as in packets
+  memcpy((uint8_t *)sd + desc->value, &value, desc->width);
+}
+
 void resetSensorConfig(sensors_config *sc)
 {
-  sc->air_temp = false;
-  sc->air_hum = false;
-  sc->air_pres = false;
+  for(uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+    setSensorEnabled(sc, &sensor_descriptors[i], false);
+
+  sc->soil_temp_1_resolution = DS18B20_DEFAULT_RESOLUTION;
+  sc->soil_temp_2_resolution = DS18B20_DEFAULT_RESOLUTION;
+  sc->async_sampling = false;
 
-  sc->soil_temp_1 = false;
-  sc->soil_temp_2 =false;
-  sc->soil_moist_1 =false;
-  sc->soil_moist_2 = false;
+  sc->ulp_sampling = false;
+  sc->ulp_period = ULP_DEFAULT_PERIOD;
+  sc->ulp_batch = ULP_DEFAULT_BATCH;
+  sc->ulp_threshold = ULP_DEFAULT_THRESHOLD;
 
-  sc->lum = false;
+  sc->report_by_exception = false;
+  sc->heartbeat = DEFAULT_HEARTBEAT;
+  memset(sc->deadband, 0, sizeof(sc->deadband));
+
+  sc->soil_oversampling = 1;
 
   sc->number_of_sensors_bytes = 0;
 }
@@ -48,23 +131,9 @@ uint8_t calculateNumberOfSensorsBytes(sensors_config *sc)
 {
   sc->number_of_sensors_bytes = 0;
 
-  if(sc->air_temp)
-    sc->number_of_sensors_bytes += HEADER_SIZE + member_size(sensor_data, air_temp);
-  if(sc->air_hum)
-    sc->number_of_sensors_bytes += HEADER_SIZE + member_size(sensor_data, air_hum);
-  if(sc->air_pres)  
-    sc->number_of_sensors_bytes += HEADER_SIZE + member_size(sensor_data, air_pres);
-  
-  if(sc->soil_temp_1)
-    sc->number_of_sensors_bytes += HEADER_SIZE + member_size(sensor_data, soil_temp_1);
-  if(sc->soil_temp_2)
-    sc->number_of_sensors_bytes += HEADER_SIZE + member_size(sensor_data, soil_temp_2);
-  if(sc->soil_moist_1)
-    sc->number_of_sensors_bytes += HEADER_SIZE + member_size(sensor_data, soil_moist_1);
-  if(sc->soil_moist_2)
-    sc->number_of_sensors_bytes += HEADER_SIZE + member_size(sensor_data, soil_moist_2);
-  if(sc->lum)
-    sc->number_of_sensors_bytes += HEADER_SIZE + member_size(sensor_data, lum);
+  for(uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+    if(isSensorEnabled(sc, &sensor_descriptors[i]))
+      sc->number_of_sensors_bytes += HEADER_SIZE + sensor_descriptors[i].width;
 
   return sc->number_of_sensors_bytes;
 }
@@ -73,27 +142,42 @@ void initSensors(sensors_config *sc)
 {
   //sensor init
   if(sc->soil_temp_1)
+  {
     DS18B20_1.begin();
+    DS18B20_1.setResolution(sc->soil_temp_1_resolution);
+    DS18B20_1.setWaitForConversion(!sc->async_sampling);
+  }
   if(sc->soil_temp_2)
+  {
     DS18B20_2.begin();
+    DS18B20_2.setResolution(sc->soil_temp_2_resolution);
+    DS18B20_2.setWaitForConversion(!sc->async_sampling);
+  }
   if(sc->lum)
     LightSensor.begin();
 
+  // GPIO35 is on ADC1 which ULP can sample, soil moisture 2 (GPIO4, ADC2) is read after boot
+  if(sc->soil_moist_1 && sc->ulp_sampling)
+  {
+    if(!ULPS_start(sc->ulp_period, sc->ulp_batch, (uint32_t)sc->ulp_threshold * (SOIL_DRY - SOIL_WET) / 100))
+      SENSORS_PRINTLN("ULP sampling start failed");
+  }
+
   if(sc->air_hum || sc->air_temp || sc->air_pres) 
   {    
     switch (sc->air_sensor)
     {
       case IC_BME280:
-        Serial.println(F("BME280 init..."));
+        SENSORS_PRINTLN(F("BME280 init..."));
         Wire.begin();
         bme280.setI2CAddress(0x76);
         if(bme280.beginI2C()) 
-          Serial.println("OK!\n");
+          SENSORS_PRINTLN("OK!\n");
         else
-          Serial.println("FALSE!\n");
+          SENSORS_PRINTLN("FALSE!\n");
         break;
       case IC_BME680:
-        Serial.print(F("BME680 init..."));
+        SENSORS_PRINT(F("BME680 init..."));
         if(BME680.begin(I2C_STANDARD_MODE)) 
         {
           BME680.setOversampling(TemperatureSensor, Oversample16);
@@ -101,34 +185,30 @@ void initSensors(sensors_config *sc)
           BME680.setOversampling(PressureSensor, Oversample16);
           BME680.setIIRFilter(IIR4);
           BME680.setGas(320, 150);  // 320c for 150 milliseconds
-          Serial.print(F("OK!\r\n"));
+          SENSORS_PRINT(F("OK!\r\n"));
 
           static int32_t  temp, humidity, pressure, gas;
           BME680.getSensorData(temp, humidity, pressure, gas);  // Initial readout
         }
         else
         {
-          Serial.print(F("FAIL...\r\n"));
+          SENSORS_PRINT(F("FAIL...\r\n"));
         }
         break;
       default:
-        Serial.println("AIR SENSOR not present!");
+        SENSORS_PRINTLN("AIR SENSOR not present!");
     }
   }
 }
 
 /**
- * Function that measures soil moisture
- * @param sms - Numeber of soil moisture sensor (SOIL_MOISTURE_1 or SOIL_MOISTURE_2)
- * @return Scaled soil moisture sensor value
+ * Function that scales raw soil moisture sensor value
+ * @param val - ADC value
+ * @return Soil moisture in %
  **/
-int16_t soil_moisture(sensor_type sms)
+int16_t soil_moisture_scale(int16_t val)
 {
-  int16_t moist, val;
-  if (sms == SOIL_MOISTURE_1)
-    val = analogRead(SOIL_IN_1);
-  else
-    val = analogRead(SOIL_IN_2);
+  int16_t moist;
 
   if (val < SOIL_WET)
     moist = 100;
@@ -140,8 +220,98 @@ int16_t soil_moisture(sensor_type sms)
   return moist;
 }
 
+/**
+ * Function that measures soil moisture
+ * @param sms - Numeber of soil moisture sensor (SOIL_MOISTURE_1 or SOIL_MOISTURE_2)
+ * @param oversampling - Number of ADC samples that are averaged
+ * @return Scaled soil moisture sensor value
+ **/
+int16_t soil_moisture(sensor_type sms, uint8_t oversampling)
+{
+  int32_t sum = 0;
+
+  // ADC1 is owned by ULP, its last averaged value is used
+  if (sms == SOIL_MOISTURE_1 && ULPS_isRunning())
+    return soil_moisture_scale(ULPS_getLast());
+
+  if (oversampling == 0)
+    oversampling = 1;
+  for (uint8_t i = 0; i < oversampling; i++)
+    sum += analogRead(sms == SOIL_MOISTURE_1 ? SOIL_IN_1 : SOIL_IN_2);
+
+  return soil_moisture_scale((sum + oversampling / 2) / oversampling);
+}
+
+uint8_t getSoilMoistureHistory(int8_t *values, uint8_t max_count, sensors_config *sc)
+{
+  uint16_t history[ULPS_HISTORY_SIZE];
+
+  if(!sc->soil_moist_1 || !ULPS_isRunning())
+    return 0;
+
+  uint8_t count = ULPS_getHistory(history, max_count < ULPS_HISTORY_SIZE ? max_count : ULPS_HISTORY_SIZE);
+  for(uint8_t i = 0; i < count; i++)
+    values[i] = soil_moisture_scale(history[i]);
+
+  return count;
+}
+
+bool prepareSensorsForSleep(sensors_config *sc)
+{
+  if(!sc->soil_moist_1 || !ULPS_isRunning())
+    return false;
+
+  ULPS_rearm(ULPS_getLast());
+  ULPS_enableWakeup();
+  return true;
+}
+
+void startSensorConversions(sensors_config *sc)
+{
+  if(!sc->async_sampling || DS18B20_conversion_start != 0)
+    return;
+
+  if(sc->soil_temp_1)
+    DS18B20_1.requestTemperatures();
+  if(sc->soil_temp_2)
+    DS18B20_2.requestTemperatures();
+
+  // 0 is reserved for no running conversion
+  DS18B20_conversion_start = millis() | 1;
+}
+
+/**
+ * Function that waits until started DS18B20 conversions are finished
+ * @param sc - Sensor configuration
+ * @return No return value
+ **/
+void waitSensorConversions(sensors_config *sc)
+{
+  uint16_t conversion_time = 0;
+
+  if(sc->soil_temp_1)
+    conversion_time = DS18B20_1.millisToWaitForConversion(sc->soil_temp_1_resolution);
+  if(sc->soil_temp_2 && DS18B20_2.millisToWaitForConversion(sc->soil_temp_2_resolution) > conversion_time)
+    conversion_time = DS18B20_2.millisToWaitForConversion(sc->soil_temp_2_resolution);
+
+  // probes signal end of conversion earlier than worst case time
+  while(millis() - DS18B20_conversion_start < conversion_time)
+  {
+    if((!sc->soil_temp_1 || DS18B20_1.isConversionComplete()) && (!sc->soil_temp_2 || DS18B20_2.isConversionComplete()))
+      break;
+    delay(1);
+  }
+
+  DS18B20_conversion_start = 0;
+}
+
 void getSensorData(sensor_data *sd, sensors_config *sc)
 {
+  TRC_begin(TRC_SAMPLE);
+
+  // conversions not started earlier still overlap with each other and with other sensors
+  startSensorConversions(sc);
+
   switch (sc->air_sensor)
   {
     case IC_BME280:
@@ -167,238 +337,285 @@ void getSensorData(sensor_data *sd, sensors_config *sc)
       break;
   }
 
-  // DS18B20
-  if(sc->soil_temp_1)
-  {
-    DS18B20_1.requestTemperatures();
-    sd->soil_temp_1 = DS18B20_1.getTempCByIndex(0) * 100;
-  }
-  if(sc->soil_temp_2)
-  {
-    DS18B20_2.requestTemperatures();
-    sd->soil_temp_2 = DS18B20_2.getTempCByIndex(0) * 100;
-  }
-
   // Soil moisture
   if(sc->soil_moist_1)
-    sd->soil_moist_1 = soil_moisture(SOIL_MOISTURE_1);
+    sd->soil_moist_1 = soil_moisture(SOIL_MOISTURE_1, sc->soil_oversampling);
   if(sc->soil_moist_2)
-    sd->soil_moist_2 = soil_moisture(SOIL_MOISTURE_2);
+    sd->soil_moist_2 = soil_moisture(SOIL_MOISTURE_2, sc->soil_oversampling);
 
   //BH1750FVI
   if(sc->lum)
     sd->lum = LightSensor.GetLightIntensity();
+
+  // DS18B20, read last so conversions have as much time as possible
+  TRC_begin(TRC_CONVERSION);
+  if(sc->async_sampling)
+    waitSensorConversions(sc);
+  else
+  {
+    if(sc->soil_temp_1)
+      DS18B20_1.requestTemperatures();
+    if(sc->soil_temp_2)
+      DS18B20_2.requestTemperatures();
+  }
+  TRC_end(TRC_CONVERSION);
+  if(sc->soil_temp_1)
+    sd->soil_temp_1 = DS18B20_1.getTempCByIndex(0) * 100;
+  if(sc->soil_temp_2)
+    sd->soil_temp_2 = DS18B20_2.getTempCByIndex(0) * 100;
+
+  TRC_end(TRC_SAMPLE);
 }
 
-bool convertToSensorDataArray(uint8_t *data, uint16_t length, uint16_t *size, sensor_data *sd, sensors_config *sc)
+bool isReportNeeded(sensor_data *sd, sensors_config *sc, uint32_t now)
 {
-  *size = 0;
+  if(!sc->report_by_exception || !last_report_valid)
+    return true;
 
-  if(sc->air_temp)
-  {
-    if((*size) + HEADER_SIZE + member_size(sensor_data, air_temp) < length)
-    {
-      data[(*size)++] = (uint8_t)AIR_TEMPERATURE;
-      memcpy(&data[*size], (uint8_t *)&sd->air_temp, 2);
-      *size += member_size(sensor_data, air_temp);
-    }
-    else
-      return false;
-  }
+  // clock set back also forces report
+  if(now - last_report_time >= sc->heartbeat)
+    return true;
 
-  if(sc->air_hum)
+  for(uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
   {
-    if((*size) + HEADER_SIZE + member_size(sensor_data, air_hum) < length)
-    {
-      data[(*size)++] = (uint8_t)AIR_HUMIDITY;
-      memcpy(&data[*size], (uint8_t *)&sd->air_hum, 2);
-      *size += member_size(sensor_data, air_hum);
-    }
-    else
-      return false;
+    const sensor_descriptor *desc = &sensor_descriptors[i];
+
+    if(desc->type == TIMESTAMP || !isSensorEnabled(sc, desc))
+      continue;
+
+    int64_t diff = getSensorValue(sd, desc) - getSensorValue(&last_reported_data, desc);
+    if(diff < 0)
+      diff = -diff;
+    if(diff != 0 && diff >= sc->deadband[i])
+      return true;
   }
 
-  if(sc->air_pres)
+  return false;
+}
+
+void markReported(sensor_data *sd, uint32_t now)
+{
+  last_reported_data = *sd;
+  last_report_time = now;
+  last_report_valid = true;
+}
+
+bool convertToSensorDataArray(uint8_t *data, uint16_t length, uint16_t *size, sensor_data *sd, sensors_config *sc)
+{
+  *size = 0;
+
+  for(uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
   {
-    if((*size) + HEADER_SIZE + member_size(sensor_data, air_pres) < length)
-    {
-      data[(*size)++] = (uint8_t)AIR_PRESSURE;
-      memcpy(&data[*size], (uint8_t *)&sd->air_pres, 4);
-      *size += member_size(sensor_data, air_pres);
-    }
-    else
+    const sensor_descriptor *desc = &sensor_descriptors[i];
+
+    if(!isSensorEnabled(sc, desc))
+      continue;
+
+    if((*size) + HEADER_SIZE + desc->width >= length)
       return false;
+
+    data[(*size)++] = (uint8_t)desc->type;
+    memcpy(&data[*size], (uint8_t *)sd + desc->value, desc->width);
+    *size += desc->width;
   }
 
-  if(sc->soil_temp_1)
+  return (*size != 0);
+}
+
+/**
+ * Function that returns bitmap of enabled sensors, bit position is sensor type
+ * @param sc - Sensor configuration
+ * @return Bitmap of enabled sensors
+ **/
+uint16_t getSensorBitmap(sensors_config *sc)
+{
+  uint16_t bitmap = 0;
+
+  for(uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+    if(isSensorEnabled(sc, &sensor_descriptors[i]))
+      bitmap |= 1 << sensor_descriptors[i].type;
+
+  return bitmap;
+}
+
+/**
+ * Function that writes value as zig-zag varint (7 bits per byte, least significant first)
+ * @param data - Array to which value is written
+ * @param length - Maximum length of array
+ * @param size - Current size of array, it is increased by number of written bytes
+ * @param value - Signed value
+ * @return Returns true if value fits in array
+ **/
+bool writeVarint(uint8_t *data, uint16_t length, uint16_t *size, int64_t value)
+{
+  uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+
+  do
   {
-    if((*size) + HEADER_SIZE + member_size(sensor_data, soil_temp_1) < length)
-    {
-      data[(*size)++] = (uint8_t)SOIL_TEMPERATURE_1;
-      memcpy(&data[*size], (uint8_t *)&sd->soil_temp_1, 2);
-      *size += member_size(sensor_data, soil_temp_1);
-    }
-    else
+    if(*size >= length)
       return false;
-  }
+    data[(*size)++] = (zigzag & 0x7F) | (zigzag > 0x7F ? 0x80 : 0);
+    zigzag >>= 7;
+  } while(zigzag);
 
-  if(sc->soil_temp_2)
+  return true;
+}
+
+/**
+ * Function that reads zig-zag varint value
+ * @param data - Array from which value is read
+ * @param size - Size of array
+ * @param position - Position of value, it is moved after value
+ * @param value - Read value
+ * @return Returns true on successful read
+ **/
+bool readVarint(const uint8_t *data, uint16_t size, uint16_t *position, int64_t *value)
+{
+  uint64_t zigzag = 0;
+
+  for(uint8_t shift = 0; shift < 64; shift += 7)
   {
-    if((*size) + HEADER_SIZE + member_size(sensor_data, soil_temp_2) < length)
-    {
-      data[(*size)++] = (uint8_t)SOIL_TEMPERATURE_2;
-      memcpy(&data[*size], (uint8_t *)&sd->soil_temp_2, 2);
-      *size += member_size(sensor_data, soil_temp_2);
-    }
-    else
+    if(*position >= size)
       return false;
-  }
 
-  if(sc->soil_moist_1)
-  {
-    if((*size) + HEADER_SIZE + member_size(sensor_data, soil_moist_1) < length)
+    uint8_t byte = data[(*position)++];
+    zigzag |= (uint64_t)(byte & 0x7F) << shift;
+    if(!(byte & 0x80))
     {
-      data[(*size)++] = (uint8_t)SOIL_MOISTURE_1;
-      memcpy(&data[*size], (uint8_t *)&sd->soil_moist_1, 1);
-      *size += member_size(sensor_data, soil_moist_1);
+      *value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+      return true;
     }
-    else
-      return false;
   }
 
-  if(sc->soil_moist_2)
+  return false;
+}
+
+bool convertToCompactSensorDataArray(uint8_t *data, uint16_t length, uint16_t *size, sensor_data *sd, sensors_config *sc, uint8_t keyframe_interval)
+{
+  uint16_t bitmap = getSensorBitmap(sc);
+  bool keyframe = !compact_encoder.valid || compact_encoder.bitmap != bitmap || compact_encoder.since_keyframe + 1 >= keyframe_interval;
+
+  *size = 0;
+  if(bitmap == 0 || length < 4)
+    return false;
+
+  data[(*size)++] = COMPACT_MARKER | (keyframe ? COMPACT_KEYFRAME : 0);
+  data[(*size)++] = compact_encoder.sequence + 1;
+  data[(*size)++] = bitmap & 0xFF;
+  data[(*size)++] = bitmap >> 8;
+
+  for(uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
   {
-    if((*size) + HEADER_SIZE + member_size(sensor_data, soil_moist_2) < length)
-    {
-      data[(*size)++] = (uint8_t)SOIL_MOISTURE_2;
-      memcpy(&data[*size], (uint8_t *)&sd->soil_moist_2, 1);
-      *size += member_size(sensor_data, soil_moist_2);
-    }
-    else
+    const sensor_descriptor *desc = &sensor_descriptors[i];
+
+    if(!isSensorEnabled(sc, desc))
+      continue;
+
+    int64_t value = getSensorValue(sd, desc);
+    if(!keyframe)
+      value -= getSensorValue(&compact_encoder.reference, desc);
+
+    if(!writeVarint(data, length, size, value))
       return false;
   }
 
-  if(sc->lum)
+  compact_pending = *sd;
+  compact_pending_bitmap = bitmap;
+  compact_pending_keyframe = keyframe;
+
+  return true;
+}
+
+void compactFrameDelivered(bool delivered)
+{
+  // server may have received reading even if delivery failed, so next reading does not depend on it
+  if(!delivered)
   {
-    if((*size) + HEADER_SIZE + member_size(sensor_data, lum) < length)
-    {
-      data[(*size)++] = (uint8_t)LUMINOSITY;
-      memcpy(&data[*size], (uint8_t *)&sd->lum, 2);
-      *size += member_size(sensor_data, lum);
-    }
-    else
-      return false;
+    compact_encoder.valid = false;
+    return;
   }
 
-  return (*size != 0);
+  compact_encoder.reference = compact_pending;
+  compact_encoder.bitmap = compact_pending_bitmap;
+  compact_encoder.sequence++;
+  compact_encoder.since_keyframe = compact_pending_keyframe ? 0 : compact_encoder.since_keyframe + 1;
+  compact_encoder.valid = true;
 }
 
-/**
- * Function that parses sensor value and enables sensor in configuration
- * @param sd - Sensor data structure in which value will be stored
- * @param sc - Sensor configuration in which sensor will be enabled
- * @param data - Array that contains header and value of sensor
- * @param size - Size of array
- * @param position - Position of targeted sensor value in array that should be parsed
- * @return Returns true on successful parse
- **/
-bool parseSensorValue(sensor_data *sd, sensors_config *sc, const uint8_t *data, const uint16_t size, uint8_t *position)
+bool convertCompactToSensorData(sensor_data *sd, sensors_config *sc, const uint8_t *data, const uint16_t size, compact_state *state)
 {
-  switch(data[0])
+  uint16_t position = 4;
+
+  if(size < position || (data[0] & ~COMPACT_KEYFRAME) != COMPACT_MARKER)
+    return false;
+
+  bool keyframe = data[0] & COMPACT_KEYFRAME;
+  uint8_t sequence = data[1];
+  uint16_t bitmap = data[2] | ((uint16_t)data[3] << 8);
+
+  // delta reading is valid only against the previous reading with the same sensors
+  if(!keyframe && (!state->valid || state->bitmap != bitmap || sequence != (uint8_t)(state->sequence + 1)))
+    return false;
+  if(bitmap >> NUMBER_OF_SENSOR_TYPES)
+    return false;
+
+  resetSensorConfig(sc);
+  for(uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
   {
-    case AIR_TEMPERATURE:
-      if(!sc->air_temp && (HEADER_SIZE + member_size(sensor_data, air_temp) <= size))
-      {
-        sd->air_temp = ((uint16_t)data[2] << 8) | data[1];
-        *position += HEADER_SIZE + member_size(sensor_data, air_temp);
-        return true;
-      }
-      else
-        return false;
-    case AIR_HUMIDITY:
-      if(!sc->air_hum && (HEADER_SIZE + member_size(sensor_data, air_hum) <= size))
-      {
-        sc->air_hum = true;
-        sd->air_hum = ((uint16_t)data[2] << 8) | data[1];
-        *position += HEADER_SIZE + member_size(sensor_data, air_hum);
-        return true;
-      }
-      else
-        return false;
-    case AIR_PRESSURE:
-      if(!sc->air_pres && (HEADER_SIZE + member_size(sensor_data, air_pres) <= size))
-      {
-        sc->air_pres = true;
-        sd->air_pres = ((uint32_t)data[4] << 24) | ((uint32_t)data[3] << 16) | ((uint32_t)data[2] << 8) | data[1];
-        *position += HEADER_SIZE + member_size(sensor_data, air_pres);
-        return true;
-      }
-      else
-        return false;
-    case SOIL_TEMPERATURE_1:
-      if(!sc->soil_temp_1 && (HEADER_SIZE + member_size(sensor_data, soil_temp_1) <= size))
-      {
-        sc->soil_temp_1 = true;
-        sd->soil_temp_1 = ((uint16_t)data[2] << 8) | data[1];
-        *position += HEADER_SIZE + member_size(sensor_data, soil_temp_1);
-        return true;
-      }
-      else
-        return false;
-    case SOIL_TEMPERATURE_2:
-      if(!sc->soil_temp_2 && (HEADER_SIZE + member_size(sensor_data, soil_temp_2) <= size))
-      {
-        sc->soil_temp_2 = true;
-        sd->soil_temp_2 = ((uint16_t)data[2] << 8) | data[1];
-        *position += HEADER_SIZE + member_size(sensor_data, soil_temp_2);
-        return true;
-      }
-      else
-        return false;
-    case SOIL_MOISTURE_1:
-      if(!sc->soil_moist_1 && (HEADER_SIZE + member_size(sensor_data, soil_temp_1) <= size))
-      {
-        sc->soil_moist_1 = true;
-        sd->soil_moist_1 = data[1];
-        *position += HEADER_SIZE + member_size(sensor_data, soil_temp_1);
-        return true;
-      }
-      else
-        return false;
-    case SOIL_MOISTURE_2:
-      if(!sc->soil_moist_2 && (HEADER_SIZE + member_size(sensor_data, soil_moist_2) <= size))
-      {
-        sc->soil_moist_2 = true;
-        sd->soil_moist_2 = data[1];
-        *position += HEADER_SIZE + member_size(sensor_data, soil_moist_2);
-        return true;
-      }
-      else
-        return false;
-    case LUMINOSITY:
-      if(!sc->lum && (HEADER_SIZE + member_size(sensor_data, lum) <= size))
-      {
-        sc->lum = true;
-        sd->lum = ((uint16_t)data[2] << 8) | data[1];
-        *position += HEADER_SIZE + member_size(sensor_data, lum);
-        return true;
-      }
-      else
-        return false;
-    default:
+    const sensor_descriptor *desc = &sensor_descriptors[i];
+    int64_t value;
+
+    if(!(bitmap & (1 << desc->type)))
+      continue;
+
+    if(!readVarint(data, size, &position, &value))
       return false;
+    if(!keyframe)
+      value += getSensorValue(&state->reference, desc);
+
+    setSensorEnabled(sc, desc, true);
+    setSensorValue(sd, desc, value);
   }
+
+  if(position != size)
+    return false;
+
+  calculateNumberOfSensorsBytes(sc);
+
+  state->reference = *sd;
+  state->bitmap = bitmap;
+  state->sequence = sequence;
+  state->since_keyframe = keyframe ? 0 : state->since_keyframe + 1;
+  state->valid = true;
+
+  return true;
 }
 
 bool convertToSensorData(sensor_data *sd, sensors_config *sc, const uint8_t *data, const uint16_t size)
 {
-  uint8_t position = 0;
+  uint16_t position = 0;
+
+  if(size > 0 && (data[0] & ~COMPACT_KEYFRAME) == COMPACT_MARKER)
+    return convertCompactToSensorData(sd, sc, data, size, &compact_decoder);
 
   resetSensorConfig(sc);
   while(position < size)
-    if(!parseSensorValue(sd, sc, &data[position], size - position, &position))
+  {
+    // descriptors are ordered by sensor type
+    if(data[position] >= NUMBER_OF_SENSOR_TYPES)
       return false;
 
+    const sensor_descriptor *desc = &sensor_descriptors[data[position]];
+
+    // every sensor can be present only once
+    if(isSensorEnabled(sc, desc) || HEADER_SIZE + desc->width > size - position)
+      return false;
+
+    setSensorEnabled(sc, desc, true);
+    memcpy((uint8_t *)sd + desc->value, &data[position + HEADER_SIZE], desc->width);
+    position += HEADER_SIZE + desc->width;
+  }
+
   sc->number_of_sensors_bytes = position;
 
   return true;
@@ -406,43 +623,26 @@ bool convertToSensorData(sensor_data *sd, sensors_config *sc, const uint8_t *dat
 
 void printSensorData(sensor_data *sd, sensors_config *sc)
 {  
-  if(sc->lum)
-  {
-    Serial.println("*** Luminosity ***");
-    Serial.println("\tL = " + (String)(sd->lum) + " lux");
-  }
-  
-  if(sc->soil_temp_1 || sc->soil_temp_2)
-  {
-    Serial.println("*** Soil temperature ***");
-    if(sc->soil_temp_1)
-      Serial.println("\tT1 = " + (String)(sd->soil_temp_1 / 100) + "." + (String)(sd->soil_temp_1 % 100) + " \xC2\xB0\x43");
-    if(sc->soil_temp_2)
-      Serial.println("\tT2 = " + (String)(sd->soil_temp_2 / 100) + "." + (String)(sd->soil_temp_2 % 100) + " \xC2\xB0\x43");
-  }
-
-  if(sc->soil_moist_1 || sc->soil_moist_2)
-  {
-    Serial.println("*** Soil moisture ***");
-    if(sc->soil_moist_1)
-      Serial.println("\tH1 = " + (String)sd->soil_moist_1 + " %");
-    if(sc->soil_moist_2)
-      Serial.println("\tH2 = " + (String)sd->soil_moist_2 + " %");
-  }
-
+  Serial.println("*** Sensor data ***");
   if(sc->air_hum || sc->air_temp || sc->air_pres)
   {
-    Serial.println("*** Air parameters ***");
     if(sc->air_sensor == IC_BME280)
       Serial.println("** BME280 **");
     else if(sc->air_sensor == IC_BME680)
       Serial.println("** BME680 **");
+  }
+
+  for(uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+  {
+    const sensor_descriptor *desc = &sensor_descriptors[i];
 
-    if(sc->air_hum)
-      Serial.println("\tH = " + String(sd->air_hum / 100) + "." + (String)(sd->air_hum % 100) + " \%");
-    if(sc->air_temp)
-      Serial.println("\tT = " + String(sd->air_temp / 100) + "." + (String)(sd->air_temp % 100) + " \xC2\xB0\x43");
-    if(sc->air_pres)
-      Serial.println("\tP = " + String(sd->air_pres / 100) + "." + (String)(sd->air_pres % 100) + " mBar");
+    if(!isSensorEnabled(sc, desc))
+      continue;
+
+    int64_t value = getSensorValue(sd, desc);
+    if(desc->scale == 1)
+      Serial.println("\t" + String(desc->name) + " = " + String((int32_t)value) + " " + desc->unit);
+    else
+      Serial.println("\t" + String(desc->name) + " = " + String((float)value / desc->scale, 2) + " " + desc->unit);
   }
-}
\ No newline at end of file
+}
@@ -13,6 +13,7 @@ typedef enum {
   SOIL_MOISTURE_1 = 0x05,
   SOIL_MOISTURE_2 = 0x06,
   LUMINOSITY = 0x07,
+  TIMESTAMP = 0x08,
   ERROR = -1
 } sensor_type;
 
@@ -24,6 +25,29 @@ typedef enum {
 /// Number of bytes for sensor header
 #define HEADER_SIZE 1
 
+/// Number of sensor descriptors, one for each sensor type
+#define NUMBER_OF_SENSOR_TYPES 9
+
+/// First byte of reading in compact format (sensor types are lower than marker)
+#define COMPACT_MARKER 0x80
+/// Flag in first byte of compact reading, values are absolute instead of deltas
+#define COMPACT_KEYFRAME 0x01
+/// Default number of compact readings between two keyframes
+#define COMPACT_DEFAULT_KEYFRAME_INTERVAL 16
+
+/// Default maximum time without report in report by exception mode (in seconds)
+#define DEFAULT_HEARTBEAT 3600
+
+/// Default DS18B20 conversion resolution (in bits, 9 - 12)
+#define DS18B20_DEFAULT_RESOLUTION 12
+
+/// Default ULP soil moisture sampling period (in milliseconds)
+#define ULP_DEFAULT_PERIOD 1000
+/// Default number of ULP samples after which main CPU is woken up (at most 32)
+#define ULP_DEFAULT_BATCH 32
+/// Default change of soil moisture (in %) that wakes main CPU
+#define ULP_DEFAULT_THRESHOLD 5
+
 //https://stackoverflow.com/questions/3553296/sizeof-single-struct-member-in-c
 #define member_size(type, member) sizeof(((type *)0)->member)
 
@@ -49,6 +73,35 @@ typedef struct sensors_config
 
   // Luminosity
   bool lum;
+
+  // Time of measurement, used for readings sent from backlog
+  bool timestamp;
+
+  // DS18B20 conversion resolution in bits (9 - 12)
+  uint8_t soil_temp_1_resolution;
+  uint8_t soil_temp_2_resolution;
+
+  // DS18B20 conversions run in background while other sensors are read
+  bool async_sampling;
+
+  // Soil moisture 1 is sampled by ULP during deep sleep
+  bool ulp_sampling;
+  // ULP sampling period in milliseconds
+  uint16_t ulp_period;
+  // Number of ULP samples after which main CPU is woken up
+  uint8_t ulp_batch;
+  // Change of soil moisture (in %) that wakes main CPU
+  uint8_t ulp_threshold;
+
+  // Reading is reported only if some value changed by more than its deadband or heartbeat expired
+  bool report_by_exception;
+  // Maximum time without report in seconds
+  uint32_t heartbeat;
+  // Deadband of each sensor type in units of transmitted value
+  uint32_t deadband[NUMBER_OF_SENSOR_TYPES];
+
+  // Number of ADC samples averaged in one soil moisture measurement
+  uint8_t soil_oversampling;
 } sensors_config;
 
 /// Data structure for enabled sensor values
@@ -67,8 +120,84 @@ typedef struct sensor_data
 
   // Luminosity
   uint16_t lum;
+
+  // Time of measurement (unix epoch)
+  uint32_t timestamp;
 } sensor_data;
 
+/// Descriptor of sensor value, values are encoded as header (sensor type) followed by little endian value
+typedef struct sensor_descriptor
+{
+  // Sensor type used as header
+  sensor_type type;
+  // Offset of enable flag in sensors_config
+  size_t enabled;
+  // Offset of value in sensor_data
+  size_t value;
+  // Number of bytes of value
+  uint8_t width;
+  // Value is signed
+  bool is_signed;
+  // Raw value divided by scale gives value in unit
+  uint16_t scale;
+  // Name and unit used for printing
+  const char *name;
+  const char *unit;
+  // Key used in configuration file
+  const char *key;
+} sensor_descriptor;
+
+
+/// Sensor descriptors ordered by sensor type, adding new sensor requires only new descriptor and sensor_data/sensors_config members
+extern const sensor_descriptor sensor_descriptors[NUMBER_OF_SENSOR_TYPES];
+
+/**
+ * Function that checks if sensor is enabled in configuration
+ * @param sc - Sensor configuration
+ * @param desc - Sensor descriptor
+ * @return Returns true if sensor is enabled
+ **/
+bool isSensorEnabled(const sensors_config *sc, const sensor_descriptor *desc);
+
+/**
+ * Function that enables or disables sensor in configuration
+ * @param sc - Sensor configuration
+ * @param desc - Sensor descriptor
+ * @param enabled - New state of sensor
+ * @return No return value
+ **/
+void setSensorEnabled(sensors_config *sc, const sensor_descriptor *desc, bool enabled);
+
+/**
+ * Function that returns raw value of sensor from sensor data structure
+ * @param sd - Sensor data structure
+ * @param desc - Sensor descriptor
+ * @return Raw sensor value
+ **/
+int64_t getSensorValue(const sensor_data *sd, const sensor_descriptor *desc);
+
+/**
+ * Function that stores raw value of sensor in sensor data structure
+ * @param sd - Sensor data structure
+ * @param desc - Sensor descriptor
+ * @param value - Raw sensor value
+ * @return No return value
+ **/
+void setSensorValue(sensor_data *sd, const sensor_descriptor *desc, int64_t value);
+
+/// Reference state of compact encoding, the last reading on both encoder and decoder side
+typedef struct compact_state
+{
+  sensor_data reference;
+  // Bitmap of sensors present in reference
+  uint16_t bitmap;
+  // Sequence number of reference
+  uint8_t sequence;
+  // Number of readings since last keyframe
+  uint8_t since_keyframe;
+  bool valid;
+} compact_state;
+
 /**
  * Function that resets sc strucutre, disabling all sensors
  * @param sc - Sensor configuration structure
@@ -90,6 +219,15 @@ uint8_t calculateNumberOfSensorsBytes(sensors_config *sc);
  **/
 void initSensors(sensors_config *sc);
 
+/**
+ * Function that starts DS18B20 temperature conversions on both buses without waiting for them.
+ * Conversions run while other sensors are read or radio connects, results are collected by getSensorData.
+ * Function does nothing if asynchronous sampling is disabled.
+ * @param sc - Sensor configuration
+ * @return No return value
+ **/
+void startSensorConversions(sensors_config *sc);
+
 /**
  * Function measures values of enabled sensors
  * @param sd - Sensor data structure in which measurements are stored
@@ -98,6 +236,41 @@ void initSensors(sensors_config *sc);
  **/
 void getSensorData(sensor_data *sd, sensors_config *sc);
 
+/**
+ * Function that returns soil moisture values sampled by ULP since last wake up, the oldest first
+ * @param values - Buffer for soil moisture values (in %)
+ * @param max_count - Size of buffer
+ * @param sc - Sensor configuration
+ * @return Number of values, 0 if ULP sampling is not used
+ **/
+uint8_t getSoilMoistureHistory(int8_t *values, uint8_t max_count, sensors_config *sc);
+
+/**
+ * Function that prepares sensors for deep sleep. If ULP sampling is used, sampled values are
+ * cleared, last value is used as reference for threshold and ULP wake up is enabled.
+ * @param sc - Sensor configuration
+ * @return Returns true if ULP wakes main CPU, so timer wake up is not needed
+ **/
+bool prepareSensorsForSleep(sensors_config *sc);
+
+/**
+ * Function that checks if reading should be reported. In report by exception mode reading is reported
+ * if some value differs from the last reported one by at least its deadband or if heartbeat expired.
+ * @param sd - Sensor data structure with new reading
+ * @param sc - Sensor configuration
+ * @param now - Current time (unix epoch)
+ * @return Returns true if reading should be reported
+ **/
+bool isReportNeeded(sensor_data *sd, sensors_config *sc, uint32_t now);
+
+/**
+ * Function that stores reported reading as reference for report by exception, it is kept across deep sleep
+ * @param sd - Sensor data structure with reported reading
+ * @param now - Current time (unix epoch)
+ * @return No return value
+ **/
+void markReported(sensor_data *sd, uint32_t now);
+
 /**
  * Function that converts sensor_data structure to array of values with headers for enabled sensors
  * @param data - Array to be created
@@ -110,7 +283,41 @@ void getSensorData(sensor_data *sd, sensors_config *sc);
 bool convertToSensorDataArray(uint8_t *data, uint16_t length, uint16_t *size, sensor_data *sd, sensors_config *sc);
 
 /**
- * Function that creates configuration and parses sensor values from array
+ * Function that converts sensor_data structure to compact array: marker, sequence number, bitmap of enabled sensors
+ * and zig-zag varint deltas against the last delivered reading. Keyframe with absolute values is created periodically,
+ * after configuration change or after failed delivery. compactFrameDelivered should be called with result of sending.
+ * @param data - Array to be created
+ * @param length - Maximum length of array
+ * @param size - Size of created array
+ * @param sd - Sensor data structure in which measurements are stored
+ * @param sc - Sensor configuration
+ * @param keyframe_interval - Number of readings between two keyframes
+ * @return Returns true on successful conversion
+ **/
+bool convertToCompactSensorDataArray(uint8_t *data, uint16_t length, uint16_t *size, sensor_data *sd, sensors_config *sc, uint8_t keyframe_interval);
+
+/**
+ * Function that updates reference of compact encoding after reading is sent. Reading becomes new reference
+ * if it is delivered, otherwise next reading is sent as keyframe.
+ * @param delivered - True if last converted reading is delivered
+ * @return No return value
+ **/
+void compactFrameDelivered(bool delivered);
+
+/**
+ * Function that parses sensor values from compact array and updates reference state
+ * @param sd - Sensor data structure in which values will be stored
+ * @param sc - Sensor configuration that will be created
+ * @param data - Array in compact format
+ * @param size - Size of array
+ * @param state - Reference state of sender, delta reading is accepted only if it follows reference
+ * @return Returns true on successful conversion
+ **/
+bool convertCompactToSensorData(sensor_data *sd, sensors_config *sc, const uint8_t *data, const uint16_t size, compact_state *state);
+
+/**
+ * Function that creates configuration and parses sensor values from array. Readings in compact format are
+ * decoded against reference of single sender kept internally.
  * @param sd - Sensor data structure in which values will be stored
  * @param sc - Sensor configuration that will be creadted
  * @param data - Array that contains headers and values of sensors
@@ -0,0 +1,137 @@
+#include "trace.h"
+#include "esp_timer.h"
+
+/// Span recorded in ring
+typedef struct
+{
+  uint32_t start;
+  uint32_t duration;
+  uint16_t cycle;
+  uint8_t phase;
+  uint8_t reserved;
+} TRC_span;
+
+static const char *trc_phase_names[TRC_PHASE_COUNT] = {
+  "boot", "config", "sensor init", "sample", "conversion", "wifi connect",
+  "bg96 attach", "handshake", "send", "response", "local send", "local recv"
+};
+
+// spans of last cycles kept across deep sleep
+RTC_DATA_ATTR TRC_span trc_ring[TRC_RING_SIZE];
+RTC_DATA_ATTR uint16_t trc_head = 0;
+RTC_DATA_ATTR uint16_t trc_count = 0;
+RTC_DATA_ATTR uint16_t trc_cycle = 0;
+
+static int64_t trc_start[TRC_PHASE_COUNT];
+// spans are recorded from tasks on both cores
+static portMUX_TYPE trc_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Function that appends span to ring, the oldest span is overwritten when ring is full
+ * @param phase - Traced phase
+ * @param start - Start of phase in microseconds from application start
+ * @param duration - Duration of phase in microseconds
+ **/
+static void TRC_record(TRC_phase phase, int64_t start, int64_t duration)
+{
+  portENTER_CRITICAL(&trc_mux);
+  TRC_span *span = &trc_ring[trc_head];
+  span->start = start;
+  span->duration = duration;
+  span->cycle = trc_cycle;
+  span->phase = phase;
+  trc_head = (trc_head + 1) % TRC_RING_SIZE;
+  if (trc_count < TRC_RING_SIZE)
+    trc_count++;
+  portEXIT_CRITICAL(&trc_mux);
+}
+
+void TRC_newCycle()
+{
+  trc_cycle++;
+  for (uint8_t i = 0; i < TRC_PHASE_COUNT; i++)
+    trc_start[i] = -1;
+}
+
+void TRC_add(TRC_phase phase, int64_t start, int64_t duration)
+{
+  TRC_record(phase, start < 0 ? 0 : start, duration);
+}
+
+void TRC_begin(TRC_phase phase)
+{
+  trc_start[phase] = esp_timer_get_time();
+}
+
+void TRC_end(TRC_phase phase)
+{
+  if (trc_start[phase] < 0)
+    return;
+
+  TRC_record(phase, trc_start[phase], esp_timer_get_time() - trc_start[phase]);
+  trc_start[phase] = -1;
+}
+
+uint16_t TRC_getTelemetry(uint8_t *data, uint16_t length)
+{
+  uint32_t total[TRC_PHASE_COUNT] = {0};
+  uint16_t cycle = trc_cycle - 1;
+  uint16_t size = 0;
+
+  if (length < TRC_TELEMETRY_LENGTH)
+    return 0;
+
+  for (uint16_t i = 0; i < trc_count; i++)
+  {
+    TRC_span *span = &trc_ring[(trc_head + TRC_RING_SIZE - 1 - i) % TRC_RING_SIZE];
+    if (span->cycle == cycle)
+      total[span->phase] += span->duration;
+  }
+
+  data[size++] = TRC_TELEMETRY_MARKER;
+  data[size++] = cycle & 0xFF;
+  for (uint8_t phase = 0; phase < TRC_PHASE_COUNT; phase++)
+  {
+    if (total[phase] == 0)
+      continue;
+
+    uint32_t ms = (total[phase] + 500) / 1000;
+    if (ms > 0xFFFF)
+      ms = 0xFFFF;
+    data[size++] = phase;
+    data[size++] = ms & 0xFF;
+    data[size++] = ms >> 8;
+  }
+
+  return size > 2 ? size : 0;
+}
+
+void TRC_dump()
+{
+  Serial.println("*** Trace (cycle, phase, start us, duration us) ***");
+  for (uint16_t i = 0; i < trc_count; i++)
+  {
+    TRC_span *span = &trc_ring[(trc_head + TRC_RING_SIZE - trc_count + i) % TRC_RING_SIZE];
+    Serial.printf("%5u %-12s %10u %10u\r\n", span->cycle, trc_phase_names[span->phase], span->start, span->duration);
+  }
+}
+
+void TRC_handleSerial()
+{
+  static char command[8];
+  static uint8_t len = 0;
+
+  while (Serial.available())
+  {
+    char c = Serial.read();
+    if (c == '\r' || c == '\n')
+    {
+      command[len] = '\0';
+      if (strcmp(command, "trace") == 0)
+        TRC_dump();
+      len = 0;
+    }
+    else if (len < sizeof(command) - 1)
+      command[len++] = c;
+  }
+}
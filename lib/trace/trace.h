@@ -0,0 +1,80 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <Arduino.h>
+
+/// Number of spans kept in RTC memory ring
+#define TRC_RING_SIZE           48
+/// First byte of telemetry record appended to uplink (sensor types and compact marker are lower)
+#define TRC_TELEMETRY_MARKER    0xC0
+/// Maximum length of telemetry record
+#define TRC_TELEMETRY_LENGTH    (2 + 3 * TRC_PHASE_COUNT)
+
+/// Traced phases of cycle
+typedef enum {
+  TRC_BOOT = 0,
+  TRC_CONFIG,
+  TRC_SENSOR_INIT,
+  TRC_SAMPLE,
+  TRC_CONVERSION,
+  TRC_WIFI_CONNECT,
+  TRC_BG96_ATTACH,
+  TRC_HANDSHAKE,
+  TRC_SEND,
+  TRC_RESPONSE,
+  TRC_LOCAL_SEND,
+  TRC_LOCAL_RECV,
+  TRC_PHASE_COUNT
+} TRC_phase;
+
+/**
+ * Function that starts new cycle, it should be called first after wake up
+ * @return No return value
+ **/
+void TRC_newCycle();
+
+/**
+ * Function that records span measured outside of tracer, e.g. boot phase measured from wake stub entry
+ * @param phase - Traced phase
+ * @param start - Start of phase in microseconds from application start, start before application is recorded as 0
+ * @param duration - Duration of phase in microseconds
+ * @return No return value
+ **/
+void TRC_add(TRC_phase phase, int64_t start, int64_t duration);
+
+/**
+ * Function that marks start of phase
+ * @param phase - Traced phase
+ * @return No return value
+ **/
+void TRC_begin(TRC_phase phase);
+
+/**
+ * Function that marks end of phase and records span to ring. Nothing is recorded if phase was not started.
+ * @param phase - Traced phase
+ * @return No return value
+ **/
+void TRC_end(TRC_phase phase);
+
+/**
+ * Function that creates telemetry record with total duration of each phase in previous cycle:
+ * marker, cycle number and (phase, duration in ms) pairs
+ * @param data - Buffer for record (at least TRC_TELEMETRY_LENGTH bytes)
+ * @param length - Size of buffer
+ * @return Length of record, 0 if there is nothing to report
+ **/
+uint16_t TRC_getTelemetry(uint8_t *data, uint16_t length);
+
+/**
+ * Function that prints all recorded spans to serial port
+ * @return No return value
+ **/
+void TRC_dump();
+
+/**
+ * Function that checks serial port for "trace" command and prints recorded spans when it is received
+ * @return No return value
+ **/
+void TRC_handleSerial();
+
+#endif
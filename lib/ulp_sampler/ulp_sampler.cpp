@@ -0,0 +1,151 @@
+#include "ulp_sampler.h"
+#include "esp_sleep.h"
+#include "esp32/ulp.h"
+#include "driver/adc.h"
+#include "soc/rtc.h"
+
+// Variables shared with ULP program, word offsets in RTC slow memory (ULP uses lower 16 bits)
+#define ULPS_VAR_COUNT          0
+#define ULPS_VAR_BATCH          1
+#define ULPS_VAR_LOW            2
+#define ULPS_VAR_HIGH           3
+#define ULPS_VAR_LAST           4
+#define ULPS_VAR_WAKE_REASON    5
+#define ULPS_VAR_HISTORY        8
+/// Offset of ULP program, it follows shared variables
+#define ULPS_PROG_OFFSET        (ULPS_VAR_HISTORY + ULPS_HISTORY_SIZE)
+
+#define ULPS_VAR(offset)        (RTC_SLOW_MEM[offset] & 0xFFFF)
+
+// labels of ULP program
+#define ULPS_LABEL_SAMPLE       1
+#define ULPS_LABEL_CHECK_BATCH  2
+#define ULPS_LABEL_CHECK_LEVEL  3
+#define ULPS_LABEL_THRESHOLD    4
+#define ULPS_LABEL_WAKE         5
+
+RTC_DATA_ATTR bool ulps_running = false;
+RTC_DATA_ATTR uint16_t ulps_threshold = 0;
+
+/**
+ * ULP program, on every wake up it averages ADC samples, appends average to history
+ * and wakes main CPU if history is full or average moved out of threshold window
+ */
+static const ulp_insn_t ulps_program[] = {
+    I_MOVI(R3, 0),                                      // R3 - base address of shared variables
+    I_MOVI(R1, 0),                                      // R1 - sum of samples
+    I_STAGE_RST(),
+    M_LABEL(ULPS_LABEL_SAMPLE),
+        I_ADC(R0, 0, ULPS_ADC_CHANNEL),
+        I_ADDR(R1, R1, R0),
+        I_STAGE_INC(1),
+        M_BSLT(ULPS_LABEL_SAMPLE, 1 << ULPS_OVERSAMPLING_SHIFT),
+    I_RSHI(R1, R1, ULPS_OVERSAMPLING_SHIFT),            // R1 - average
+    I_ST(R1, R3, ULPS_VAR_LAST),
+
+    I_LD(R0, R3, ULPS_VAR_COUNT),
+    M_BGE(ULPS_LABEL_CHECK_BATCH, ULPS_HISTORY_SIZE),   // history full, main CPU did not read it yet
+    I_ST(R1, R0, ULPS_VAR_HISTORY),
+    I_ADDI(R0, R0, 1),
+    I_ST(R0, R3, ULPS_VAR_COUNT),
+
+    M_LABEL(ULPS_LABEL_CHECK_BATCH),
+    I_LD(R2, R3, ULPS_VAR_BATCH),
+    I_SUBR(R2, R0, R2),                                 // count - batch overflows while batch is not full
+    M_BXF(ULPS_LABEL_CHECK_LEVEL),
+    I_MOVI(R0, ULPS_WAKE_BATCH),
+    M_BX(ULPS_LABEL_WAKE),
+
+    M_LABEL(ULPS_LABEL_CHECK_LEVEL),
+    I_LD(R2, R3, ULPS_VAR_LOW),
+    I_SUBR(R2, R1, R2),                                 // average - low overflows if average is below window
+    M_BXF(ULPS_LABEL_THRESHOLD),
+    I_LD(R2, R3, ULPS_VAR_HIGH),
+    I_SUBR(R2, R2, R1),                                 // high - average overflows if average is above window
+    M_BXF(ULPS_LABEL_THRESHOLD),
+    I_HALT(),
+
+    M_LABEL(ULPS_LABEL_THRESHOLD),
+    I_MOVI(R0, ULPS_WAKE_THRESHOLD),
+    M_LABEL(ULPS_LABEL_WAKE),
+    I_ST(R0, R3, ULPS_VAR_WAKE_REASON),
+    I_WAKE(),
+    I_HALT(),
+};
+
+bool ULPS_start(uint32_t period_ms, uint8_t batch_size, uint16_t threshold)
+{
+    if (batch_size == 0 || batch_size > ULPS_HISTORY_SIZE)
+        batch_size = ULPS_HISTORY_SIZE;
+
+    ulps_threshold = threshold;
+    RTC_SLOW_MEM[ULPS_VAR_BATCH] = batch_size;
+
+    // ULP keeps running during deep sleep, history collected so far is kept
+    if (ulps_running)
+        return ulp_set_wakeup_period(0, period_ms * 1000) == ESP_OK;
+
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten((adc1_channel_t)ULPS_ADC_CHANNEL, ADC_ATTEN_DB_11);
+    adc1_ulp_enable();
+
+    size_t size = sizeof(ulps_program) / sizeof(ulp_insn_t);
+    if (ulp_process_macros_and_load(ULPS_PROG_OFFSET, ulps_program, &size) != ESP_OK)
+        return false;
+
+    RTC_SLOW_MEM[ULPS_VAR_COUNT] = 0;
+    RTC_SLOW_MEM[ULPS_VAR_WAKE_REASON] = ULPS_WAKE_NONE;
+    // no reference yet, first sample wakes main CPU
+    RTC_SLOW_MEM[ULPS_VAR_LOW] = 0xFFFF;
+    RTC_SLOW_MEM[ULPS_VAR_HIGH] = 0;
+
+    if (ulp_set_wakeup_period(0, period_ms * 1000) != ESP_OK)
+        return false;
+    if (ulp_run(ULPS_PROG_OFFSET) != ESP_OK)
+        return false;
+
+    ulps_running = true;
+    return true;
+}
+
+bool ULPS_isRunning()
+{
+    return ulps_running;
+}
+
+uint16_t ULPS_getLast()
+{
+    return ULPS_VAR(ULPS_VAR_LAST);
+}
+
+uint8_t ULPS_getHistory(uint16_t *values, uint8_t max_count)
+{
+    uint8_t count = ULPS_VAR(ULPS_VAR_COUNT);
+
+    if (count > max_count)
+        count = max_count;
+    for (uint8_t i = 0; i < count; i++)
+        values[i] = ULPS_VAR(ULPS_VAR_HISTORY + i);
+
+    return count;
+}
+
+uint8_t ULPS_getWakeReason()
+{
+    return ULPS_VAR(ULPS_VAR_WAKE_REASON);
+}
+
+void ULPS_rearm(uint16_t reference)
+{
+    RTC_SLOW_MEM[ULPS_VAR_LOW] = reference > ulps_threshold ? reference - ulps_threshold : 0;
+    RTC_SLOW_MEM[ULPS_VAR_HIGH] = reference + ulps_threshold < ULPS_ADC_MAX ? reference + ulps_threshold : 0xFFFF;
+    RTC_SLOW_MEM[ULPS_VAR_WAKE_REASON] = ULPS_WAKE_NONE;
+    RTC_SLOW_MEM[ULPS_VAR_COUNT] = 0;
+}
+
+void ULPS_enableWakeup()
+{
+    // ADC has to stay powered for ULP
+    esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+    esp_sleep_enable_ulp_wakeup();
+}
@@ -0,0 +1,70 @@
+#ifndef _ULP_SAMPLER_H
+#define _ULP_SAMPLER_H
+
+#include <Arduino.h>
+
+/// ADC1 channel sampled by ULP (GPIO35, soil moisture 1)
+#define ULPS_ADC_CHANNEL        7
+/// Number of ADC samples averaged on every ULP wake up (power of 2)
+#define ULPS_OVERSAMPLING_SHIFT 2
+/// Maximum number of averaged samples stored in RTC slow memory
+#define ULPS_HISTORY_SIZE       32
+/// Full scale of 12-bit ADC
+#define ULPS_ADC_MAX            4095
+
+/// Reasons for which ULP woke main CPU
+#define ULPS_WAKE_NONE          0
+#define ULPS_WAKE_THRESHOLD     1
+#define ULPS_WAKE_BATCH         2
+
+/**
+ * Function that loads ULP program and starts sampling. Program is loaded only once, after it is
+ * already running (wake up from deep sleep) only sampling parameters are updated.
+ * @param period_ms - Time between two ULP samples in milliseconds
+ * @param batch_size - Number of stored samples after which main CPU is woken up (at most ULPS_HISTORY_SIZE)
+ * @param threshold - Change of ADC value from last reported value that wakes main CPU
+ * @return Returns true on success
+ **/
+bool ULPS_start(uint32_t period_ms, uint8_t batch_size, uint16_t threshold);
+
+/**
+ * Function that checks if ULP sampling is running
+ * @return Returns true if ULP program is running
+ **/
+bool ULPS_isRunning();
+
+/**
+ * Function that returns the last averaged ADC value
+ * @return ADC value (0 - ULPS_ADC_MAX)
+ **/
+uint16_t ULPS_getLast();
+
+/**
+ * Function that copies stored averaged ADC values, the oldest first
+ * @param values - Buffer for values
+ * @param max_count - Size of buffer
+ * @return Number of copied values
+ **/
+uint8_t ULPS_getHistory(uint16_t *values, uint8_t max_count);
+
+/**
+ * Function that returns why ULP woke main CPU
+ * @return ULPS_WAKE_NONE, ULPS_WAKE_THRESHOLD or ULPS_WAKE_BATCH
+ **/
+uint8_t ULPS_getWakeReason();
+
+/**
+ * Function that clears history and sets new reference value for threshold. It should be called
+ * after stored values are reported, just before going to deep sleep.
+ * @param reference - Last reported ADC value
+ * @return No return value
+ **/
+void ULPS_rearm(uint16_t reference);
+
+/**
+ * Function that enables wake up of main CPU by ULP during deep sleep
+ * @return No return value
+ **/
+void ULPS_enableWakeup();
+
+#endif
@@ -0,0 +1,221 @@
+#include "uplink_queue.h"
+#include "esp32/rom/crc.h"
+
+#define UQ_MAGIC 0x55510001
+
+/// Record stored in one slot of queue file
+typedef struct
+{
+  uint32_t seq;
+  uint16_t len;
+  uint16_t reserved;
+  uint32_t crc;
+  uint8_t data[UQ_MAX_DATA_LENGTH];
+} UQ_record;
+
+/// Queue state stored in meta file
+typedef struct
+{
+  uint32_t magic;
+  uint32_t head;
+  uint32_t tail;
+  uint32_t crc;
+} UQ_meta;
+
+// queue state kept across deep sleep, sequence numbers grow and slot is seq % UQ_CAPACITY
+RTC_DATA_ATTR uint32_t uq_magic = 0;
+RTC_DATA_ATTR uint32_t uq_head = 0;
+RTC_DATA_ATTR uint32_t uq_tail = 0;
+RTC_DATA_ATTR uint32_t uq_head_saved = 0;
+
+static fs::FS *uq_fs = NULL;
+static File uq_file;
+
+/**
+ * Function that calculates CRC of record (over all fields except CRC)
+ * @param record - Record
+ * @return CRC32 value
+ **/
+static uint32_t UQ_recordCRC(UQ_record *record)
+{
+  uint32_t crc = crc32_le(0, (const uint8_t *)record, offsetof(UQ_record, crc));
+  return crc32_le(crc, record->data, record->len);
+}
+
+/**
+ * Function that reads record with given sequence number and checks its integrity
+ * @param seq - Sequence number of record
+ * @param record - Read record
+ * @return Returns true if record is valid
+ **/
+static bool UQ_readRecord(uint32_t seq, UQ_record *record)
+{
+  uint32_t offset = (seq % UQ_CAPACITY) * UQ_RECORD_SIZE;
+
+  if (offset + UQ_RECORD_SIZE > uq_file.size() || !uq_file.seek(offset))
+    return false;
+  if (uq_file.read((uint8_t *)record, UQ_RECORD_SIZE) != UQ_RECORD_SIZE)
+    return false;
+
+  return record->seq == seq && record->len <= UQ_MAX_DATA_LENGTH && record->crc == UQ_recordCRC(record);
+}
+
+/**
+ * Function that stores queue state to meta file
+ * @return Returns true on success
+ **/
+static bool UQ_saveMeta()
+{
+  UQ_meta meta = {UQ_MAGIC, uq_head, uq_tail, 0};
+  meta.crc = crc32_le(0, (const uint8_t *)&meta, offsetof(UQ_meta, crc));
+
+  File file = uq_fs->open(UQ_META_FILE, FILE_WRITE);
+  if (!file)
+    return false;
+  bool ok = file.write((const uint8_t *)&meta, sizeof(meta)) == sizeof(meta);
+  file.close();
+
+  if (ok)
+    uq_head_saved = uq_head;
+  return ok;
+}
+
+/**
+ * Function that restores queue state after reset. Records appended after last stored state
+ * are found by following sequence numbers; without valid meta file whole ring is scanned.
+ **/
+static void UQ_restore()
+{
+  UQ_meta meta;
+  UQ_record record;
+
+  File file = uq_fs->open(UQ_META_FILE, FILE_READ);
+  bool meta_ok = file && file.read((uint8_t *)&meta, sizeof(meta)) == sizeof(meta) &&
+                 meta.magic == UQ_MAGIC && meta.crc == crc32_le(0, (const uint8_t *)&meta, offsetof(UQ_meta, crc));
+  if (file)
+    file.close();
+
+  if (meta_ok)
+  {
+    uq_head = meta.head;
+    uq_tail = meta.tail;
+    for (uint32_t i = 0; i < UQ_CAPACITY && UQ_readRecord(uq_head, &record); i++)
+      uq_head++;
+  }
+  else
+  {
+    // the newest valid record determines head, all records in ring are considered unsent
+    bool found = false;
+    uq_head = 0;
+    uq_file.seek(0);
+    for (uint32_t slot = 0; slot < UQ_CAPACITY; slot++)
+    {
+      if (uq_file.read((uint8_t *)&record, UQ_RECORD_SIZE) != UQ_RECORD_SIZE)
+        break;
+      if (record.seq % UQ_CAPACITY != slot || record.len > UQ_MAX_DATA_LENGTH || record.crc != UQ_recordCRC(&record))
+        continue;
+      if (!found || record.seq >= uq_head)
+        uq_head = record.seq + 1;
+      found = true;
+    }
+    uq_tail = (uq_head > UQ_CAPACITY) ? uq_head - UQ_CAPACITY : 0;
+  }
+
+  if (uq_head - uq_tail > UQ_CAPACITY)
+    uq_tail = uq_head - UQ_CAPACITY;
+
+  uq_magic = UQ_MAGIC;
+  UQ_saveMeta();
+}
+
+bool UQ_init(fs::FS &fs)
+{
+  uq_fs = &fs;
+
+  if (!fs.exists(UQ_FILE))
+  {
+    File file = fs.open(UQ_FILE, FILE_WRITE);
+    if (!file)
+      return false;
+    file.close();
+  }
+
+  // file is opened for update, records are overwritten in place
+  uq_file = fs.open(UQ_FILE, "r+");
+  if (!uq_file)
+    return false;
+
+  if (uq_magic != UQ_MAGIC)
+    UQ_restore();
+
+  return true;
+}
+
+bool UQ_push(const uint8_t *data, uint16_t len)
+{
+  UQ_record record;
+
+  if (!uq_file || len > UQ_MAX_DATA_LENGTH)
+    return false;
+
+  memset(&record, 0x00, sizeof(record));
+  record.seq = uq_head;
+  record.len = len;
+  memcpy(record.data, data, len);
+  record.crc = UQ_recordCRC(&record);
+
+  // file grows until ring is full, then the oldest slot is overwritten
+  uint32_t offset = (uq_head % UQ_CAPACITY) * UQ_RECORD_SIZE;
+  if (offset > uq_file.size() || !uq_file.seek(offset))
+    return false;
+  if (uq_file.write((const uint8_t *)&record, UQ_RECORD_SIZE) != UQ_RECORD_SIZE)
+    return false;
+  uq_file.flush();
+
+  uq_head++;
+  if (uq_head - uq_tail > UQ_CAPACITY)
+    uq_tail = uq_head - UQ_CAPACITY;
+
+  // state is stored periodically, so restore after reset follows only a few records
+  if (uq_head - uq_head_saved >= UQ_META_INTERVAL)
+    UQ_saveMeta();
+
+  return true;
+}
+
+bool UQ_peek(uint32_t index, uint8_t *data, uint16_t *len)
+{
+  UQ_record record;
+
+  if (!uq_file || index >= UQ_count())
+    return false;
+
+  if (UQ_readRecord(uq_tail + index, &record))
+  {
+    memcpy(data, record.data, record.len);
+    *len = record.len;
+  }
+  else
+    *len = 0;
+
+  return true;
+}
+
+bool UQ_pop(uint32_t count)
+{
+  if (!uq_file)
+    return false;
+
+  if (count > UQ_count())
+    count = UQ_count();
+  if (count == 0)
+    return true;
+
+  uq_tail += count;
+  return UQ_saveMeta();
+}
+
+uint32_t UQ_count()
+{
+  return uq_head - uq_tail;
+}
@@ -0,0 +1,63 @@
+#ifndef _UPLINK_QUEUE_H
+#define _UPLINK_QUEUE_H
+
+#include <Arduino.h>
+#include "FS.h"
+
+/// File in which records are stored, it is used as ring of fixed size slots
+#define UQ_FILE               "/uplink_queue.bin"
+/// File in which position of oldest unsent record is stored
+#define UQ_META_FILE          "/uplink_queue.meta"
+/// Number of record slots in ring (UQ_CAPACITY * UQ_RECORD_SIZE bytes of flash)
+#define UQ_CAPACITY           8192
+/// Size of one record slot
+#define UQ_RECORD_SIZE        64
+/// Size of record header (sequence number, length, CRC)
+#define UQ_HEADER_SIZE        12
+/// Maximum length of data stored in one record
+#define UQ_MAX_DATA_LENGTH    (UQ_RECORD_SIZE - UQ_HEADER_SIZE)
+/// Number of appended records after which queue state is stored to flash
+#define UQ_META_INTERVAL      64
+/// Maximum number of records sent from backlog after one measurement
+#define UQ_DRAIN_BATCH        16
+
+/**
+ * Function that opens queue file and restores queue state. State is kept in RTC memory
+ * across deep sleep; after reset it is restored from meta file and records appended after it.
+ * @param fs - File system (SPIFFS must be mounted)
+ * @return Returns true on success
+ **/
+bool UQ_init(fs::FS &fs);
+
+/**
+ * Function that appends record to queue. If queue is full, the oldest record is overwritten.
+ * @param data - Data to be stored
+ * @param len - Length of data (at most UQ_MAX_DATA_LENGTH)
+ * @return Returns true on success
+ **/
+bool UQ_push(const uint8_t *data, uint16_t len);
+
+/**
+ * Function that reads record from queue without removing it
+ * @param index - Index of record counting from the oldest unsent record
+ * @param data - Buffer (of at least UQ_MAX_DATA_LENGTH bytes) to which data is written
+ * @param len - Length of read data, 0 if record is corrupted and should be skipped
+ * @return Returns false if there is no record with given index
+ **/
+bool UQ_peek(uint32_t index, uint8_t *data, uint16_t *len);
+
+/**
+ * Function that removes the oldest records from queue. Queue state is stored to flash,
+ * so it should be called once per sent batch.
+ * @param count - Number of records to be removed
+ * @return Returns true on success
+ **/
+bool UQ_pop(uint32_t count);
+
+/**
+ * Function that returns number of unsent records
+ * @return Number of records in queue
+ **/
+uint32_t UQ_count();
+
+#endif
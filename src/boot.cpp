@@ -0,0 +1,56 @@
+#include "boot.h"
+#include <trace.h>
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "soc/rtc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "esp32/rom/rtc.h"
+#include "esp32/clk.h"
+
+// RTC slow clock time (in ticks) at wake stub entry
+RTC_DATA_ATTR uint64_t boot_wake_tick = 0;
+
+static uint32_t boot_time_us = 0;
+
+/**
+* Function that reads RTC slow clock counter. It is placed in RTC memory, so it can be used by wake stub.
+* @return - RTC time in slow clock ticks
+*/
+static uint64_t RTC_IRAM_ATTR BOOT_readRtcTicks()
+{
+    SET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_UPDATE);
+    while (GET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_VALID) == 0)
+        ;
+    SET_PERI_REG_MASK(RTC_CNTL_INT_CLR_REG, RTC_CNTL_TIME_VALID_INT_CLR);
+    return READ_PERI_REG(RTC_CNTL_TIME0_REG) | ((uint64_t)READ_PERI_REG(RTC_CNTL_TIME1_REG) << 32);
+}
+
+/**
+* Wake stub, runs from RTC memory before bootloader loads application. Only registers and RTC memory can be used.
+* It records time of wake up, so boot time includes ROM and bootloader.
+*/
+extern "C" void RTC_IRAM_ATTR esp_wake_deep_sleep(void)
+{
+    boot_wake_tick = BOOT_readRtcTicks();
+    esp_default_wake_deep_sleep();
+}
+
+void BOOT_markFirstSample()
+{
+    if (boot_time_us != 0)
+        return;
+
+    if (esp_reset_reason() == ESP_RST_DEEPSLEEP && boot_wake_tick != 0)
+        boot_time_us = rtc_time_slowclk_to_us(rtc_time_get() - boot_wake_tick, esp_clk_slowclk_cal_get());
+    else
+        // ROM and bootloader time is not included after reset
+        boot_time_us = esp_timer_get_time();
+
+    TRC_add(TRC_BOOT, esp_timer_get_time() - boot_time_us, boot_time_us);
+    DEBUG_PRINTLN("Boot to first sample: " + String(boot_time_us) + " us");
+}
+
+void BOOT_scheduleNextSample(uint64_t sleep_us)
+{
+    esp_sleep_enable_timer_wakeup(sleep_us);
+}
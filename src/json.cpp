@@ -1,4 +1,7 @@
 #include "json.h"
+#include "boot.h"
+#include <Preferences.h>
+#include <rom/crc.h>
 
 /**
  * Function that copies data from json to array
@@ -62,6 +65,15 @@ bool getJsonConfig(json_config *jc, DynamicJsonDocument *config)
 
             const char *_wifi_pass = (*config)["wifi"]["pass"];
             getJsonArray(_wifi_pass, jc->wifi_pass, sizeof(jc->wifi_pass));
+
+            const char *_wifi_ip = (*config)["wifi"]["static_ip"]["ip"] | "";
+            getJsonArray(_wifi_ip, jc->wifi_ip, sizeof(jc->wifi_ip));
+            const char *_wifi_gateway = (*config)["wifi"]["static_ip"]["gateway"] | "";
+            getJsonArray(_wifi_gateway, jc->wifi_gateway, sizeof(jc->wifi_gateway));
+            const char *_wifi_subnet = (*config)["wifi"]["static_ip"]["subnet"] | "";
+            getJsonArray(_wifi_subnet, jc->wifi_subnet, sizeof(jc->wifi_subnet));
+            const char *_wifi_dns = (*config)["wifi"]["static_ip"]["dns"] | "";
+            getJsonArray(_wifi_dns, jc->wifi_dns, sizeof(jc->wifi_dns));
         }
         else if (server_tunnel == "BG96")
         {
@@ -75,6 +87,13 @@ bool getJsonConfig(json_config *jc, DynamicJsonDocument *config)
 
             const char *_apn_password = (*config)["bg96"]["apn_password"];
             getJsonArray(_apn_password, jc->apn_password, sizeof(jc->apn_password));
+
+            jc->bg96_power.psm_enable = (*config)["bg96"]["psm"]["enable"] | false;
+            jc->bg96_power.psm_tau = (*config)["bg96"]["psm"]["tau"] | 3600;
+            jc->bg96_power.psm_active_time = (*config)["bg96"]["psm"]["active_time"] | 60;
+            jc->bg96_power.edrx_enable = (*config)["bg96"]["edrx"]["enable"] | false;
+            jc->bg96_power.edrx_act_type = (*config)["bg96"]["edrx"]["act_type"] | BG96_EDRX_ACT_NBIOT;
+            jc->bg96_power.edrx_cycle = (*config)["bg96"]["edrx"]["cycle"] | 5;
         }
         else
             return false;
@@ -126,6 +145,15 @@ bool getJsonConfig(json_config *jc, DynamicJsonDocument *config)
         getJsonArray(_server_salt, jc->server_salt, sizeof(jc->server_salt));
         const char *_server_password = (*config)["cryptography"]["server_password"];
         getJsonArray(_server_password, jc->server_password, sizeof(jc->server_password));
+        jc->session_lifetime = (*config)["cryptography"]["session_lifetime"] | SDU_DEFAULT_SESSION_LIFETIME;
+
+        jc->batch_size = (*config)["batch"]["size"] | 1;
+        jc->batch_deadline = (*config)["batch"]["deadline"] | 0;
+
+        jc->compact = (*config)["compact"]["enable"] | false;
+        jc->compact_keyframe_interval = (*config)["compact"]["keyframe_interval"] | COMPACT_DEFAULT_KEYFRAME_INTERVAL;
+
+        jc->pipeline = (*config)["pipeline"]["enable"] | false;
     }
 
     if ((jc->device_type == CORE) || ((jc->device_type == SENSOR) && !jc->standalone))
@@ -140,14 +168,24 @@ bool getJsonConfig(json_config *jc, DynamicJsonDocument *config)
             getJsonArray(_serv_uuid, jc->serv_uuid, sizeof(jc->serv_uuid));
             const char *_char_uuid = (*config)["ble"]["CHAR_UUID"];
             getJsonArray(_char_uuid, jc->char_uuid, sizeof(jc->char_uuid));
+            jc->ble_fast_connect = (*config)["ble"]["fast_connect"] | false;
+            jc->ble_bulk = (*config)["ble"]["bulk"] | false;
 
             const char *_ble_password = (*config)["cryptography"]["ble_password"];
             getJsonArray(_ble_password, jc->ble_password, sizeof(jc->ble_password));
         }
         else if (local_tunnel == "RS485")
+        {
             jc->local_tunnel = RS485;
+
+            jc->rs485_baudrate = (*config)["rs485"]["baudrate"] | 115200;
+            jc->rs485_multidrop = (*config)["rs485"]["multidrop"] | false;
+            jc->rs485_poll_timeout = (*config)["rs485"]["poll_timeout"] | LDU_DEFAULT_POLL_TIMEOUT;
+        }
         else
             return false;
+
+        jc->local_backlog = (*config)["local_backlog"]["enable"] | false;
     }
     
     if (jc->device_type == SENSOR)
@@ -172,8 +210,101 @@ bool getJsonConfig(json_config *jc, DynamicJsonDocument *config)
         jc->sc.soil_moist_2 = (*config)["sensors"]["soil_moisture_2"];
         jc->sc.lum = (*config)["sensors"]["luminosity"];
 
+        jc->sc.soil_temp_1_resolution = (*config)["sensors"]["soil_temperature_1_resolution"] | DS18B20_DEFAULT_RESOLUTION;
+        jc->sc.soil_temp_2_resolution = (*config)["sensors"]["soil_temperature_2_resolution"] | DS18B20_DEFAULT_RESOLUTION;
+        jc->sc.async_sampling = (*config)["sensors"]["async_sampling"] | false;
+
+        jc->sc.ulp_sampling = (*config)["sensors"]["ulp"]["enable"] | false;
+        jc->sc.ulp_period = (*config)["sensors"]["ulp"]["period"] | ULP_DEFAULT_PERIOD;
+        jc->sc.ulp_batch = (*config)["sensors"]["ulp"]["batch"] | ULP_DEFAULT_BATCH;
+        jc->sc.ulp_threshold = (*config)["sensors"]["ulp"]["threshold"] | ULP_DEFAULT_THRESHOLD;
+        // history sampled by ULP is sent only to server, local packet carries one reading
+        if (jc->sc.ulp_sampling && !jc->standalone)
+        {
+            DEBUG_PRINTLN("ULP sampling is not supported in local mode, disabled");
+            jc->sc.ulp_sampling = false;
+        }
+
+        // deadbands are configured in units used for printing (e.g. 0.1 for 0.1 degree)
+        jc->sc.report_by_exception = (*config)["sensors"]["report_by_exception"] | false;
+        jc->sc.heartbeat = (*config)["sensors"]["heartbeat"] | DEFAULT_HEARTBEAT;
+        for (uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+        {
+            float deadband = (*config)["sensors"]["deadband"][sensor_descriptors[i].key] | 0.0;
+            jc->sc.deadband[i] = deadband * sensor_descriptors[i].scale + 0.5;
+        }
+
+        jc->sc.soil_oversampling = (*config)["sensors"]["soil_oversampling"] | 1;
+        for (uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+        {
+            jc->filters[i].median = (*config)["sensors"]["filter"][sensor_descriptors[i].key]["median"] | 0;
+            jc->filters[i].ewma_shift = (*config)["sensors"]["filter"][sensor_descriptors[i].key]["ewma_shift"] | 0;
+        }
+
+        jc->telemetry = (*config)["telemetry"]["enable"] | false;
+        jc->config_cache = (*config)["config_cache"]["enable"] | false;
+
         calculateNumberOfSensorsBytes(&jc->sc);
     }
     
     return true;
-}
\ No newline at end of file
+}
+
+uint32_t getJsonConfigHash(const char *json, uint16_t json_length)
+{
+    return crc32_le(0, (const uint8_t *)json, json_length);
+}
+
+bool loadJsonConfigCache(json_config *jc, uint32_t hash)
+{
+    Preferences prefs;
+    bool ok = false;
+
+    if (!prefs.begin(JSON_CONFIG_CACHE_NAMESPACE, true))
+        return false;
+
+    // structure layout depends on firmware, so version and size have to match as well
+    if (prefs.getUChar("version", 0) == JSON_CONFIG_CACHE_VERSION &&
+        prefs.getULong("hash", 0) == hash &&
+        prefs.getBytesLength("jc") == sizeof(json_config))
+    {
+        ok = prefs.getBytes("jc", jc, sizeof(json_config)) == sizeof(json_config);
+    }
+
+    prefs.end();
+    return ok;
+}
+
+bool storeJsonConfigCache(json_config *jc, uint32_t hash)
+{
+    Preferences prefs;
+    bool cached = false;
+
+    if (!jc->config_cache)
+    {
+        // cache is erased only if it exists, so flash is not written on every boot
+        if (prefs.begin(JSON_CONFIG_CACHE_NAMESPACE, true))
+        {
+            cached = prefs.isKey("hash");
+            prefs.end();
+        }
+        if (cached && prefs.begin(JSON_CONFIG_CACHE_NAMESPACE, false))
+        {
+            prefs.clear();
+            prefs.end();
+        }
+        return false;
+    }
+
+    if (!prefs.begin(JSON_CONFIG_CACHE_NAMESPACE, false))
+        return false;
+
+    // hash is written last, so interrupted write is not taken as valid cache
+    prefs.remove("hash");
+    bool ok = prefs.putUChar("version", JSON_CONFIG_CACHE_VERSION) &&
+              prefs.putBytes("jc", jc, sizeof(json_config)) == sizeof(json_config) &&
+              prefs.putULong("hash", hash);
+
+    prefs.end();
+    return ok;
+}
@@ -1,4 +1,5 @@
 #include "ldu.h"
+#include <trace.h>
 
 
 bool LDU_debug_enable = false;
@@ -14,7 +15,7 @@ void LDU_debugPrint(int8_t *title, uint8_t *data, uint16_t data_len)
         Crypto_debugPrint(title, data, data_len);
 }
 
-uint8_t LDU_constructPacket(char *password,  uint16_t header_type, uint8_t *in_data, uint8_t in_data_len, uint8_t *out_data, uint16_t *out_data_len)
+uint8_t LDU_constructPacket(Crypto_HMACKey *key, uint16_t header_type, uint8_t *in_data, uint16_t in_data_len, uint8_t *out_data, uint16_t *out_data_len)
 {
     CRC32 crc;
     crc.setPolynome(CRC32_DEFAULT_VALUE);
@@ -33,7 +34,8 @@ uint8_t LDU_constructPacket(char *password,  uint16_t header_type, uint8_t *in_d
         break;
 
         case SENSOR_DATA_VALUE_HEADER:
-            if (in_data_len < 1)
+        case SENSOR_BACKLOG_VALUE_HEADER:
+            if (in_data_len < 1 || HEADER_LENGTH + in_data_len + CRC32_LENGTH > LDU_MAX_PACKET_LENGTH)
                 return LOCAL_ERROR(INVALID_NUM_OF_BYTES);
             memcpy(out_data + HEADER_LENGTH, in_data, in_data_len);
             *out_data_len = HEADER_LENGTH + in_data_len;
@@ -45,8 +47,8 @@ uint8_t LDU_constructPacket(char *password,  uint16_t header_type, uint8_t *in_d
     }
 
     uint8_t hmac_value[32];
-    mbedtls_md_context_t ctx;
-    Crypto_Digest(&ctx, HMAC_SHA256, (uint8_t *)&out_data[HEADER_LENGTH], *out_data_len - HEADER_LENGTH, hmac_value, (uint8_t *) password, strlen(password));
+    if (!Crypto_HMAC(key, (uint8_t *)&out_data[HEADER_LENGTH], *out_data_len - HEADER_LENGTH, hmac_value))
+        return CRYPTO_FUNC_ERROR;
 
     crc.add(hmac_value, sizeof(hmac_value));
     uint32_t crc32 = crc.getCRC();
@@ -94,6 +96,16 @@ uint8_t LDU_parsePacket(LDU_struct *comm_params, uint8_t *input, uint16_t input_
                 return INVALID_AUTH;
             
             *header = ((uint16_t) input[0 + HASH_LENGTH] << 8) | input[1 + HASH_LENGTH];
+
+            // frames for other units on multi-drop bus are rejected
+            if (comm_params->rs485_address != LDU_RS485_NO_ADDRESS)
+            {
+                if (input_length < HASH_LENGTH + HEADER_LENGTH + RS485_ADDRESS_LENGTH)
+                    return LOCAL_ERROR(INVALID_NUM_OF_BYTES);
+                uint16_t address = ((uint16_t) input[HASH_LENGTH + HEADER_LENGTH] << 8) | input[HASH_LENGTH + HEADER_LENGTH + 1];
+                if (address != comm_params->rs485_address)
+                    return LOCAL_ERROR(INVALID_HEADER);
+            }
         break;
 
         default:
@@ -107,7 +119,6 @@ bool LDU_calculateDevicesHash(LDU_struct *comm_params)
 {
     uint8_t hash_input[80];
     uint8_t hash_input_length = 0;
-    mbedtls_md_context_t ctx;
 
     memcpy(hash_input, comm_params->serv_uuid, strlen(comm_params->serv_uuid));
     hash_input_length += strlen(comm_params->serv_uuid);
@@ -115,7 +126,7 @@ bool LDU_calculateDevicesHash(LDU_struct *comm_params)
     memcpy(hash_input, comm_params->char_uuid, strlen(comm_params->char_uuid));
     hash_input_length += strlen(comm_params->char_uuid);
 
-    return Crypto_Digest(&ctx, HMAC_SHA256, hash_input, hash_input_length, comm_params->devices_hmac, (uint8_t *)comm_params->ble_password, strlen(comm_params->ble_password));
+    return Crypto_HMAC(&comm_params->ble_key, hash_input, hash_input_length, comm_params->devices_hmac);
 }
 
 void LDU_setBLEParams(LDU_struct *comm_params, char *serv_uuid, char *char_uuid, char *ble_password)
@@ -125,6 +136,8 @@ void LDU_setBLEParams(LDU_struct *comm_params, char *serv_uuid, char *char_uuid,
     comm_params->char_uuid = char_uuid;
     comm_params->ble_password = ble_password;
 
+    // key schedule is computed once and reused for every packet
+    Crypto_HMACSetKey(&comm_params->ble_key, (uint8_t *)ble_password, strlen(ble_password));
     LDU_calculateDevicesHash(comm_params);
 }
 
@@ -134,6 +147,34 @@ void LDU_setRS485Params(LDU_struct *comm_params, uint32_t rs485_baudrate)
     comm_params->rs485_baudrate = rs485_baudrate;
 }
 
+void LDU_setRS485Address(LDU_struct *comm_params, uint8_t ble_mac[])
+{
+    comm_params->rs485_address = ((uint16_t) ble_mac[4] << 8) | ble_mac[5];
+    if (comm_params->rs485_address == LDU_RS485_NO_ADDRESS)
+        comm_params->rs485_address = 0x0001;
+}
+
+uint8_t LDU_waitForPoll(LDU_struct *comm_params, uint32_t timeout)
+{
+    uint8_t frame[HASH_LENGTH + HEADER_LENGTH + RS485_ADDRESS_LENGTH + 1];
+    uint32_t t0 = millis();
+    uint32_t elapsed;
+
+    while ((elapsed = millis() - t0) < timeout)
+    {
+        // longer frames of other units are truncated, only start of frame is checked
+        uint16_t frame_length = sizeof(frame) - 1;
+        if (!RS485_recv(frame, &frame_length, timeout - elapsed))
+            continue;
+
+        uint16_t header;
+        if (LDU_parsePacket(comm_params, frame, frame_length, &header) == LDU_OK && header == SENSOR_DATA_REQUEST_HEADER)
+            return LDU_OK;
+    }
+
+    return RS485_ERROR;
+}
+
 uint8_t LDU_init(LDU_struct *comm_params)
 {
     switch(comm_params->mode)
@@ -155,60 +196,100 @@ uint8_t LDU_init(LDU_struct *comm_params)
 
 uint8_t LDU_send(LDU_struct *comm_params, uint8_t packet[], uint16_t size)
 {
+    uint8_t ret = LDU_OK;
+
+    TRC_begin(TRC_LOCAL_SEND);
     switch(comm_params->mode)
     {
         case BLE:
-            BLE_connectToServer();
-            BLE_send(packet, size);
+            if (!BLE_connectToServer() || !BLE_send(packet, size))
+                ret = BLE_ERROR;
         break;
 
         case RS485:
-            RS485_setMode(RS485_TX);
-            RS485_send(packet, size);
-            RS485_setMode(RS485_RX);
+            // driver is enabled only while frame is sent, with turnaround gap after previous frame
+            if (!RS485_transmit(packet, size))
+                ret = RS485_ERROR;
         break;
 
         default:
-            return BAD_COM_STRUCTURE;
+            ret = BAD_COM_STRUCTURE;
+        break;
     }
+    TRC_end(TRC_LOCAL_SEND);
 
+    if (ret == BAD_COM_STRUCTURE)
+        return ret;
     LDU_debugPrint((int8_t *)"LDU send: ", packet, size);
-    return LDU_OK;
+    return ret;
 }
 
 uint8_t LDU_recv(LDU_struct *comm_params, char rx_buffer[], uint16_t *size, uint32_t timeout = 5000)
 {
+    uint8_t ret = LDU_OK;
+
+    TRC_begin(TRC_LOCAL_RECV);
     switch(comm_params->mode)
     {
         case BLE:
-            BLE_recv((uint8_t *)rx_buffer, size);
-            BLE_disconnectFromServer();
+            // connection stays open for next frame until LDU_close
+            if (!BLE_recv((uint8_t *)rx_buffer, size, timeout))
+                ret = BLE_ERROR;
         break;
         
         case RS485:
-            RS485_recv((uint8_t *)rx_buffer, size, timeout);
+            if (!RS485_recv((uint8_t *)rx_buffer, size, timeout))
+                ret = RS485_ERROR;
         break;
         
         default:
-            return BAD_COM_STRUCTURE;
+            ret = BAD_COM_STRUCTURE;
+        break;
+    }
+    TRC_end(TRC_LOCAL_RECV);
+
+    // nothing is parsed from buffer if response is not received
+    if (ret != LDU_OK)
+    {
+        *size = 0;
+        return ret;
     }
-    
+
     LDU_debugPrint((int8_t *)"LDU recieve: ", (uint8_t *)rx_buffer, *size);
     return LDU_OK;
 }
 
+uint8_t LDU_close(LDU_struct *comm_params)
+{
+    switch(comm_params->mode)
+    {
+        case BLE:
+            BLE_disconnectFromServer();
+        break;
+
+        case RS485:
+        break;
+
+        default:
+            return BAD_COM_STRUCTURE;
+    }
+    return LDU_OK;
+}
+
 uint8_t LDU_sendPacket(LDU_struct *comm_params, uint16_t header, uint8_t *data, uint16_t data_length)
 {
-    uint8_t packet[256];
+    uint8_t packet[LDU_MAX_PACKET_LENGTH];
     uint16_t packet_length = 0;
 
-    LDU_constructPacket(comm_params->ble_password, 
+    uint8_t ret = LDU_constructPacket(&comm_params->ble_key, 
                         header,
                         data,
                         data_length,
                         packet,
                         &packet_length
                         );
+    if (ret != LDU_OK)
+        return ret;
 
     return LDU_send(comm_params, packet, packet_length);
 }
@@ -221,4 +302,33 @@ uint8_t LDU_sendBLEMAC(LDU_struct *comm_params, uint8_t ble_mac[])
 uint8_t LDU_sendSensorData(LDU_struct *comm_params, uint8_t data[], uint16_t data_length)
 {
     return LDU_sendPacket(comm_params, SENSOR_DATA_VALUE_HEADER, data, data_length);
-}
\ No newline at end of file
+}
+
+uint16_t LDU_getMaxDataLength(LDU_struct *comm_params)
+{
+    uint16_t length = 0;
+
+    switch(comm_params->mode)
+    {
+        case BLE:
+            length = BLE_getMaxFrameLength();
+            length = (length > HEADER_LENGTH + CRC32_LENGTH) ? length - HEADER_LENGTH - CRC32_LENGTH : 0;
+        break;
+
+        case RS485:
+            length = LDU_RS485_MAX_DATA_LENGTH;
+        break;
+
+        default:
+        break;
+    }
+
+    if (length > LDU_MAX_PACKET_LENGTH - HEADER_LENGTH - CRC32_LENGTH)
+        length = LDU_MAX_PACKET_LENGTH - HEADER_LENGTH - CRC32_LENGTH;
+    return length;
+}
+
+uint8_t LDU_sendBacklog(LDU_struct *comm_params, uint8_t data[], uint16_t data_length)
+{
+    return LDU_sendPacket(comm_params, SENSOR_BACKLOG_VALUE_HEADER, data, data_length);
+}
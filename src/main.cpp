@@ -9,16 +9,20 @@
 #include <WiFi_client.h>
 #include <BLE_client.h>
 #include <file_utils.h>
+#include <uplink_queue.h>
 #include <crypto_utils.h>
+#include <trace.h>
 #include "sensors.h"
 #include "sdu.h"
 #include "ldu.h"
 #include "json.h"
+#include "boot.h"
+#include "pipeline.h"
 #include <mbedtls/md.h>
 
 json_config jc;
 
-uint8_t packet[256];
+uint8_t packet[SDU_MAX_DATA_LENGTH];
 uint16_t packet_len;
 uint8_t udp_packet[6 + sizeof(sensor_data)];
 
@@ -39,142 +43,667 @@ uint8_t devices_hash[32];
 
 RTC_DATA_ATTR int bootCount = 0;
 
-void WiFi_loop()
+/// Unconfirmed local backlog frames after which backlog is sent only every few cycles
+#define LOCAL_BACKLOG_RETRIES   3
+/// Maximum number of cycles in which local backlog is not sent
+#define LOCAL_BACKLOG_MAX_SKIP  64
+
+// consecutive local backlog frames not confirmed by core and cycles left until the next one is sent
+RTC_DATA_ATTR uint8_t local_backlog_failures = 0;
+RTC_DATA_ATTR uint8_t local_backlog_skip = 0;
+
+/**
+ * Function that checks if server accepted sensor data
+ * @param ret - Return value of SDU_sendData
+ * @return Returns true if data is delivered
+ */
+bool isDelivered(uint8_t ret)
 {
-  while (1)
+  return ret == S_PACKET_OK || ret == S_SUCCESS;
+}
+
+/**
+ * Function that checks if server received sensor data but rejected its content, so sending it again makes no sense
+ * @param ret - Return value of SDU_sendData
+ * @param renewed - True if data was sent again with session negotiated by renewSession
+ * @return Returns true if data is rejected
+ */
+bool isRejected(uint8_t ret, bool renewed)
+{
+  if (ret == S_INVALID_HEADER || ret == S_INVALID_NUM_OF_BYTES || ret == S_INVALID_NUM_OF_BYTES_SENS || ret == S_FORMAT_ERROR)
+    return true;
+  // integrity failure that repeats with new session is caused by data itself
+  return renewed && SDU_isSessionRejected(ret);
+}
+
+/**
+ * Function that negotiates new session if server rejected resumed one
+ * @return Returns true if data should be sent again
+ */
+bool renewSession()
+{
+  if (jc.comm_mode != ENCRYPTED_COMM || SDU_isSessionValid())
+    return false;
+
+  uint8_t ret = SDU_updateIV(&comm_params);
+  SDU_debugPrintError(ret);
+
+  ret = SDU_handshake(&comm_params);
+  SDU_debugPrintError(ret);
+
+  return ret == PACKET_OK;
+}
+
+/**
+ * Function that resumes session from previous wake up or negotiates new one, it is called before the first packet is sent
+ */
+void startSession()
+{
+  static bool started = false;
+
+  if (started || jc.comm_mode != ENCRYPTED_COMM)
+    return;
+  started = true;
+
+  // handshake is needed only if session from previous wake up is not valid anymore
+  if (!SDU_resumeSession(&comm_params))
   {
-    RGB_LED_setColor(BLUE);
+    uint8_t ret = SDU_updateIV(&comm_params);
+    SDU_debugPrintError(ret);
+
+    ret = SDU_handshake(&comm_params);
+    SDU_debugPrintError(ret);
+  }
+}
+
+/**
+ * Function that appends phase timing of previous cycle as extra record after reading
+ * @param frame - Frame with reading
+ * @param frame_len - Length of frame, it is updated
+ * @param max_len - Size of frame buffer
+ */
+void appendTelemetry(uint8_t *frame, uint16_t *frame_len, uint16_t max_len)
+{
+  uint8_t record[TRC_TELEMETRY_LENGTH];
+  uint16_t record_len = TRC_getTelemetry(record, sizeof(record));
+
+  // encrypted data is padded, so at least one byte of packet is left free
+  if (!jc.telemetry || record_len == 0 || *frame_len + 1 + record_len >= max_len)
+    return;
+
+  frame[(*frame_len)++] = record_len;
+  memcpy(&frame[*frame_len], record, record_len);
+  *frame_len += record_len;
+}
+
+/**
+ * Function that sends single reading in full format
+ * @param sd - Sensor data
+ * @return Returns value of SDU_sendData
+ */
+uint8_t sendReading(sensor_data *sd)
+{
+  if(!convertToSensorDataArray(&packet[7], 256-7, &packet_len, sd, &jc.sc))
+    DEBUG_PRINTLN("Conversion failed");
+
+  packet[6] = packet_len;
+  packet_len += 7;
+  appendTelemetry(packet, &packet_len, sizeof(packet));
+
+  uint8_t ret = SDU_sendData(&comm_params, packet, packet_len);
+  SDU_debugPrintError(ret);
+  return ret;
+}
+
+/**
+ * Function that stores undelivered batched readings in uplink queue, they already contain time of measurement
+ */
+void storeBatch()
+{
+  uint8_t *reading;
+  uint16_t reading_len;
+
+  for (uint8_t i = 0; SDU_batchGet(i, &reading, &reading_len); i++)
+  {
+    if (!UQ_push(reading, reading_len))
+      DEBUG_PRINTLN("Storing reading failed");
+  }
+  DEBUG_PRINTLN("Batch stored, backlog: " + String(UQ_count()));
+}
 
-    SDU_debugEnable(true);
+/**
+ * Function that stores undelivered reading with time of measurement in uplink queue
+ * @param sd - Sensor data
+ */
+void storeReading(sensor_data *sd)
+{
+  uint8_t record[UQ_MAX_DATA_LENGTH];
+  uint16_t record_len;
+  sensors_config sc = jc.sc;
 
-    memset(&packet[6], 0x00, sizeof(packet)-6);
+  sc.timestamp = true;
+  sd->timestamp = time(NULL);
+
+  if (!convertToSensorDataArray(record, sizeof(record), &record_len, sd, &sc) || !UQ_push(record, record_len))
+    DEBUG_PRINTLN("Storing reading failed");
+  else
+    DEBUG_PRINTLN("Reading stored, backlog: " + String(UQ_count()));
+}
 
+/**
+ * Function that sends stored readings in one packet, in the same format as batched readings
+ */
+void sendBacklog()
+{
+  uint8_t record[UQ_MAX_DATA_LENGTH];
+  uint16_t record_len;
+  uint16_t frame_len = MAC_LENGTH;
+  uint32_t count = 0;
+
+  while (count < UQ_DRAIN_BATCH && UQ_peek(count, record, &record_len))
+  {
+    // encrypted data is padded, so at least one byte of packet is left free
+    if (frame_len + DATA_LENGTH + record_len >= SDU_MAX_DATA_LENGTH)
+      break;
+
+    // corrupted record is skipped
+    if (record_len != 0)
+    {
+      packet[frame_len++] = record_len;
+      memcpy(&packet[frame_len], record, record_len);
+      frame_len += record_len;
+    }
+    count++;
+  }
+
+  if (frame_len > MAC_LENGTH)
+  {
+    uint8_t ret = SDU_sendData(&comm_params, packet, frame_len);
+    SDU_debugPrintError(ret);
+
+    bool renewed = renewSession();
+    if (renewed)
+    {
+      ret = SDU_sendData(&comm_params, packet, frame_len);
+      SDU_debugPrintError(ret);
+    }
+
+    if (!isDelivered(ret) && !isRejected(ret, renewed))
+      return;
+  }
+
+  // queue state is written once per batch
+  UQ_pop(count);
+  if (count)
+    DEBUG_PRINTLN("Backlog sent: " + String(count) + ", left: " + String(UQ_count()));
+}
+
+/**
+ * Function that waits for core response to frame sent via local communication channel
+ * @return Returns true if core confirmed frame
+ */
+bool isConfirmedByCore()
+{
+  // buffer size, one byte is left for terminating zero
+  packet_len = sizeof(packet) - 1;
+  uint8_t ret = LDU_recv(&loc_comm_params, (char *)packet, &packet_len, (uint32_t)5000);
+
+  uint16_t header;
+  if (ret != LDU_OK || LDU_parsePacket(&loc_comm_params, packet, packet_len, &header) != LDU_OK)
+  {
+    DEBUG_PRINTLN("PARSE ERROR");
+    return false;
+  }
+  return header == CORE_RESPONSE_HEADER;
+}
+
+/**
+ * Function that sends readings stored while core was not reachable in one frame, right after core confirmed current reading.
+ * Frame is limited to what active link and core accept, after repeated unconfirmed frames sending is backed off.
+ */
+void sendLocalBacklog()
+{
+  uint8_t data[LDU_MAX_PACKET_LENGTH - HEADER_LENGTH - CRC32_LENGTH];
+  uint16_t max_len = LDU_getMaxDataLength(&loc_comm_params);
+  uint8_t record[UQ_MAX_DATA_LENGTH];
+  uint16_t record_len;
+  uint16_t data_len = 0;
+  uint32_t count = 0;
+
+  if (UQ_count() == 0)
+    return;
+
+  if (local_backlog_skip > 0)
+  {
+    local_backlog_skip--;
+    DEBUG_PRINTLN("Local backlog postponed, cycles left: " + String(local_backlog_skip));
+    return;
+  }
+
+  if (max_len > sizeof(data))
+    max_len = sizeof(data);
+
+  while (count < UQ_DRAIN_BATCH && UQ_peek(count, record, &record_len))
+  {
+    if (data_len + 1 + record_len > max_len)
+    {
+      // record that never fits into frame on this link would block backlog, it is dropped
+      if (data_len == 0)
+        count++;
+      break;
+    }
+
+    // corrupted record is skipped
+    if (record_len != 0)
+    {
+      data[data_len++] = record_len;
+      memcpy(&data[data_len], record, record_len);
+      data_len += record_len;
+    }
+    count++;
+  }
+
+  if (data_len > 0 && (LDU_sendBacklog(&loc_comm_params, data, data_len) != LDU_OK || !isConfirmedByCore()))
+  {
+    // core does not answer backlog frames, they are sent after 1, 2, 4 ... LOCAL_BACKLOG_MAX_SKIP cycles
+    if (local_backlog_failures < UINT8_MAX)
+      local_backlog_failures++;
+    if (local_backlog_failures >= LOCAL_BACKLOG_RETRIES)
+    {
+      uint8_t shift = local_backlog_failures - LOCAL_BACKLOG_RETRIES;
+      local_backlog_skip = LOCAL_BACKLOG_MAX_SKIP;
+      if (shift < 8 && (1 << shift) < LOCAL_BACKLOG_MAX_SKIP)
+        local_backlog_skip = 1 << shift;
+    }
+    DEBUG_PRINTLN("Local backlog not confirmed");
+    return;
+  }
+
+  local_backlog_failures = 0;
+  UQ_pop(count);
+  if (count)
+    DEBUG_PRINTLN("Local backlog sent: " + String(count) + ", left: " + String(UQ_count()));
+}
+
+/**
+ * Function that sends soil moisture values sampled by ULP during deep sleep in one packet, in the same format as batched readings
+ */
+void sendSoilHistory()
+{
+  int8_t history[ULP_DEFAULT_BATCH];
+  uint8_t count = getSoilMoistureHistory(history, sizeof(history), &jc.sc);
+  uint8_t record[UQ_MAX_DATA_LENGTH];
+  uint16_t record_len;
+  uint16_t frame_len = MAC_LENGTH;
+  uint32_t now = time(NULL);
+
+  if (count == 0)
+    return;
+
+  startSession();
+
+  sensors_config sc;
+  resetSensorConfig(&sc);
+  sc.soil_moist_1 = true;
+  sc.timestamp = true;
+
+  for (uint8_t i = 0; i < count; i++)
+  {
     sensor_data sd;
-    getSensorData(&sd, &jc.sc);
-    printSensorData(&sd, &jc.sc);
+    sd.soil_moist_1 = history[i];
+    // the newest value is sampled just before wake up
+    sd.timestamp = now - (uint32_t)(count - 1 - i) * jc.sc.ulp_period / 1000;
+
+    if (!convertToSensorDataArray(record, sizeof(record), &record_len, &sd, &sc))
+      continue;
+    packet[frame_len++] = record_len;
+    memcpy(&packet[frame_len], record, record_len);
+    frame_len += record_len;
+  }
 
-    if(!convertToSensorDataArray(&packet[7], 256-7, &packet_len, &sd, &jc.sc))
-      Serial.println("Conversion failed");
-    
-    packet[6] = packet_len;
-    packet_len += 7;
+  uint8_t ret = SDU_sendData(&comm_params, packet, frame_len);
+  SDU_debugPrintError(ret);
 
-    uint8_t ret = SDU_sendData(&comm_params, packet, packet_len);
+  bool renewed = renewSession();
+  if (renewed)
+  {
+    ret = SDU_sendData(&comm_params, packet, frame_len);
     SDU_debugPrintError(ret);
+  }
+  DEBUG_PRINTLN("Soil moisture history sent: " + String(count));
 
+  // undelivered values are stored one by one, the same way as batched readings
+  if (!isDelivered(ret) && !isRejected(ret, renewed))
+  {
+    for (uint16_t pos = MAC_LENGTH; pos < frame_len; pos += 1 + packet[pos])
+    {
+      if (!UQ_push(&packet[pos + 1], packet[pos]))
+        DEBUG_PRINTLN("Storing reading failed");
+    }
+  }
+}
+
+/**
+ * Function that schedules next sample and puts unit to deep sleep
+ */
+void goToSleep()
+{
+  // BG96 stays registered and enters PSM/eDRX on its own
+  if (jc.standalone && jc.server_tunnel == WIFI)
     WiFi_disconnect();
 
-    RGB_LED_setColor(BLACK);
+  // ULP wakes unit when soil moisture changes or its history is full
+  if (prepareSensorsForSleep(&jc.sc))
+    DEBUG_PRINTLN("Setup ESP32 to sleep until ULP wake up");
+  else
+  {
+    BOOT_scheduleNextSample(TIME_TO_SLEEP * uS_TO_S_FACTOR);
+    DEBUG_PRINTLN("Setup ESP32 to sleep for every " + String(TIME_TO_SLEEP) + " Seconds");
+  }
+
+  DEBUG_PRINTLN("Going to sleep now");
+#ifndef FAST_BOOT
+  // recorded spans are printed if "trace" command was received while unit was awake
+  TRC_handleSerial();
+  Serial.flush();
+#endif
+  esp_deep_sleep_start();
+}
+
+/**
+ * Function that measures, filters and prints reading (sampling stage)
+ * @param sd - Sensor data
+ */
+void sampleReading(sensor_data *sd)
+{
+  getSensorData(sd, &jc.sc);
+  BOOT_markFirstSample();
+  FLT_apply(sd, &jc.sc, jc.filters);
+  if (BOOT_DEBUG_ENABLE)
+    printSensorData(sd, &jc.sc);
+}
+
+/**
+ * Function that joins network and starts session while sensors are measured (association stage)
+ */
+void associate()
+{
+  // with report by exception most cycles send nothing, so radio is used only after reading shows a change
+  if (jc.sc.report_by_exception)
+    return;
+
+  uint8_t ret = SDU_associate(&comm_params);
+  SDU_debugPrintError(ret);
+
+  startSession();
+}
+
+/**
+ * Function that sends reading, stores it if it is not delivered and sends backlog (transmit stage)
+ * @param sd - Sensor data
+ */
+void transmitReading(sensor_data *sd)
+{
+  memset(&packet[6], 0x00, sizeof(packet)-6);
+
+  // values sampled by ULP are sent before current reading
+  sendSoilHistory();
+
+  // report by exception, radio is not used if nothing changed
+  if (!isReportNeeded(sd, &jc.sc, time(NULL)))
+  {
+    DEBUG_PRINTLN("No significant change, reading not reported");
+    return;
+  }
+
+  if (jc.batch_size > 1)
+  {
+    // batched reading is sent later, so it carries time of measurement
+    sensors_config sc = jc.sc;
+    sc.timestamp = true;
+    sd->timestamp = time(NULL);
+
+    if(!convertToSensorDataArray(&packet[7], 256-7, &packet_len, sd, &sc))
+      DEBUG_PRINTLN("Conversion failed");
+
+    if (SDU_batchAdd(&comm_params, &packet[7], packet_len) != PACKET_OK)
+      DEBUG_PRINTLN("Batch error");
+    else
+      markReported(sd, sd->timestamp);
+    DEBUG_PRINTLN("Batched readings: " + String(SDU_batchCount()));
+
+    if (SDU_batchReady(&comm_params))
+    {
+      startSession();
+
+      uint8_t ret = SDU_sendBatch(&comm_params);
+      SDU_debugPrintError(ret);
+
+      // server rejected resumed session, negotiate new one and send data again
+      bool renewed = renewSession();
+      if (renewed)
+      {
+        ret = SDU_sendBatch(&comm_params);
+        SDU_debugPrintError(ret);
+      }
+
+      if (isDelivered(ret))
+        sendBacklog();
+      else if (!isRejected(ret, renewed))
+        storeBatch();
+      SDU_batchClear();
+    }
+  }
+  else
+  {
+    uint8_t ret = S_INVALID_HEADER;
+
+    startSession();
+
+    // compact format is used until server rejects its header
+    if (jc.compact && SDU_isCompactSupported())
+    {
+      if(!convertToCompactSensorDataArray(&packet[7], 256-7, &packet_len, sd, &jc.sc, jc.compact_keyframe_interval))
+        DEBUG_PRINTLN("Conversion failed");
+
+      packet[6] = packet_len;
+      packet_len += 7;
+
+      ret = SDU_sendCompactData(&comm_params, packet, packet_len);
+      SDU_debugPrintError(ret);
+      compactFrameDelivered(isDelivered(ret));
+    }
+
+    if (ret == S_INVALID_HEADER)
+      ret = sendReading(sd);
+
+    // server rejected resumed session, negotiate new one and send data again
+    bool renewed = renewSession();
+    if (renewed)
+      ret = sendReading(sd);
+
+    // no reading is lost during outage, backlog is sent when connection is back
+    if (isDelivered(ret))
+      sendBacklog();
+    else if (!isRejected(ret, renewed))
+      storeReading(sd);
+
+    if (!isRejected(ret, renewed))
+      markReported(sd, time(NULL));
+  }
+}
+
+void server_loop()
+{
+  const PL_stages stages = { associate, sampleReading, transmitReading };
+
+  while (1)
+  {
+    RGB_LED_setColor(BLUE);
 
-    esp_sleep_enable_timer_wakeup(TIME_TO_SLEEP * uS_TO_S_FACTOR);
-    Serial.println("Setup ESP32 to sleep for every " + String(TIME_TO_SLEEP) +
-    " Seconds");
+    SDU_debugEnable(BOOT_DEBUG_ENABLE);
 
-    Serial.println("Going to sleep now");
-    Serial.flush(); 
-    esp_deep_sleep_start();
-    Serial.println("This will never be printed");
+    // radio joins network on one core while sensors are measured on the other
+    if (!jc.pipeline || !PL_run(&stages, 1))
+    {
+      sensor_data sd;
+      sampleReading(&sd);
+      transmitReading(&sd);
+    }
+
+    RGB_LED_setColor(BLACK);
+
+    goToSleep();
   }
 }
 
 void setup()
 {
+  TRC_newCycle();
+
+#ifndef FAST_BOOT
   delay(5000);
+#endif
 
   Serial.begin(115200);
-  Serial.println("--- IoTartic Sensing Unit ---");  
+  DEBUG_PRINTLN("--- IoTartic Sensing Unit ---");  
 
   ++bootCount;
-  Serial.println("Boot number: " + String(bootCount));
+  DEBUG_PRINTLN("Boot number: " + String(bootCount));
 
   RGB_LED_init();
   RGB_LED_setSaturation(255);
 
   FS_setup();
   
-  char json[2048];
-  FS_readFile(SPIFFS, "/config.json", json);
+  TRC_begin(TRC_CONFIG);
+  char json[JSON_CONFIG_FILE_SIZE];
+  int16_t json_len = FS_readFile(SPIFFS, "/config.json", json, sizeof(json));
+  uint32_t json_hash = getJsonConfigHash(json, json_len);
+
+  // json is parsed only if file changed since configuration was cached
+  if (loadJsonConfigCache(&jc, json_hash))
+    DEBUG_PRINTLN("Cached config loaded");
+  else
+  {
+    DynamicJsonDocument config(JSON_CONFIG_DOC_SIZE);
+    DeserializationError error = deserializeJson(config, json);
+    if (error)
+    {
+      DEBUG_PRINT("Json parse error: ");
+      DEBUG_PRINTLN(error.c_str());
+    }
 
-  DynamicJsonDocument config(2048);
-  deserializeJson(config, json);
+    while(!getJsonConfig(&jc, &config))
+    {
+      DEBUG_PRINTLN("Json config error!");
+      delay(1000);
+    }
 
-  while(!getJsonConfig(&jc, &config))
-  {
-    Serial.println("Json config error!");
-    delay(1000);
+    if (storeJsonConfigCache(&jc, json_hash))
+      DEBUG_PRINTLN("Config cached");
   }
+  TRC_end(TRC_CONFIG);
 
   while(jc.device_type != SENSOR)
   {
-    Serial.println("Device not configured as sensor type!");
+    DEBUG_PRINTLN("Device not configured as sensor type!");
     delay(1000);
   }
 
+  TRC_begin(TRC_SENSOR_INIT);
   initSensors(&jc.sc);
+  TRC_end(TRC_SENSOR_INIT);
+  // temperature conversions run while radio connects
+  startSensorConversions(&jc.sc);
 
   if (jc.standalone)
   {
-    if (jc.server_tunnel == WIFI)
-    {
-      Serial.println("WiFi server communication");
+    if (!UQ_init(SPIFFS))
+      DEBUG_PRINTLN("Uplink queue init failed");
 
-      uint8_t ret;
-      
-      WiFI_debugEnable(true);
-      SDU_debugEnable(true);
+    SDU_debugEnable(BOOT_DEBUG_ENABLE);
 
-      BLE_getMACStandalone(gateaway_mac);
+    BLE_getMACStandalone(gateaway_mac);
 
-      SDU_init(&comm_params, jc.comm_mode, jc.protocol, jc.server_tunnel, (char *) jc.ip, jc.port, (char *) jc.server_salt, (char *)jc.server_password, (uint8_t*) gateaway_mac);
+    SDU_init(&comm_params, jc.comm_mode, jc.protocol, jc.server_tunnel, (char *) jc.ip, jc.port, (char *) jc.server_salt, (char *)jc.server_password, (uint8_t*) gateaway_mac);
+
+    if (SDU_setBatchParams(&comm_params, jc.batch_size, jc.batch_deadline) != PACKET_OK)
+      DEBUG_PRINTLN("Invalid batch configuration");
+
+    if (jc.server_tunnel == WIFI)
+    {
+      DEBUG_PRINTLN("WiFi server communication");
+
+      WiFI_debugEnable(BOOT_DEBUG_ENABLE);
       SDU_setWIFIparams(&comm_params, jc.wifi_ssid, jc.wifi_pass);
 
-      if (jc.protocol == MQTT)
-      {
-        memcpy(topic_to_subscribe, jc.subscribe_topic, strlen(jc.subscribe_topic));
-        for(uint8_t i= 0; i < 6; i++)
-            sprintf(topic_to_subscribe + strlen(jc.subscribe_topic) + 2*i, "%02x", (int)gateaway_mac[i]);
-        topic_to_subscribe[strlen(jc.subscribe_topic) + 12] = 0;
-        SDU_setMQTTparams(&comm_params, jc.client_id, jc.publish_topic, topic_to_subscribe);
-      }
+      // static IP saves DHCP on every connection
+      if (strlen(jc.wifi_ip) > 0 && !WiFi_setStaticIP(jc.wifi_ip, jc.wifi_gateway, jc.wifi_subnet, jc.wifi_dns))
+        DEBUG_PRINTLN("Invalid static IP configuration");
+    }
+    else if (jc.server_tunnel == BG96)
+    {
+      DEBUG_PRINTLN("BG96 server communication");
 
-      if (jc.comm_mode == ENCRYPTED_COMM)
-      {
-        ret = SDU_updateIV(&comm_params);
-        SDU_debugPrintError(ret);
+      // modem registration is done on first connection and reused after deep sleep
+      SDU_setBG96params(&comm_params, jc.apn, jc.apn_user, jc.apn_password, &jc.bg96_power);
+    }
 
-        ret = SDU_handshake(&comm_params);
-        SDU_debugPrintError(ret);
-      }
+    if (jc.protocol == MQTT)
+    {
+      memcpy(topic_to_subscribe, jc.subscribe_topic, strlen(jc.subscribe_topic));
+      for(uint8_t i= 0; i < 6; i++)
+          sprintf(topic_to_subscribe + strlen(jc.subscribe_topic) + 2*i, "%02x", (int)gateaway_mac[i]);
+      topic_to_subscribe[strlen(jc.subscribe_topic) + 12] = 0;
+      SDU_setMQTTparams(&comm_params, jc.client_id, jc.publish_topic, topic_to_subscribe);
+    }
 
-      memcpy(packet, gateaway_mac, 6);
+    if (jc.comm_mode == ENCRYPTED_COMM)
+    {
+      // session is started with the first packet, so it is not negotiated if nothing is reported
+      SDU_setSessionLifetime(&comm_params, jc.session_lifetime);
+    }
+
+    memcpy(packet, gateaway_mac, 6);
 
-      WiFi_loop();
-    } 
+    server_loop();
   }
   else
   {   
-    LDU_debugEnable(true);
+    // readings not confirmed by core are sent later in one frame, if core accepts such frames
+    if (jc.local_backlog && !UQ_init(SPIFFS))
+      DEBUG_PRINTLN("Uplink queue init failed");
+
+    LDU_debugEnable(BOOT_DEBUG_ENABLE);
     LDU_setBLEParams(&loc_comm_params, jc.serv_uuid, jc.char_uuid, jc.ble_password); 
     if (jc.local_tunnel == BLE)
     {
-      Serial.println("BLE local communication");
+      DEBUG_PRINTLN("BLE local communication");
       
       BLE_getMACStandalone(gateaway_mac);
       memcpy(sensor_data_packet, gateaway_mac, 6);
+
+      // core found by scan is connected directly after deep sleep
+      BLE_setFastConnect(jc.ble_fast_connect);
+      BLE_setBulkTransfer(jc.ble_bulk);
     }
     else if (jc.local_tunnel == RS485)
     {
-      Serial.println("RS485 local communication");
+      DEBUG_PRINTLN("RS485 local communication");
       
-      LDU_setRS485Params(&loc_comm_params, (uint32_t)115200);
+      LDU_setRS485Params(&loc_comm_params, jc.rs485_baudrate);
 
       BLE_getMACStandalone(gateaway_mac);
       memcpy(sensor_data_packet, gateaway_mac, 6);
 
+      // units sharing bus are addressed by their BLE MAC
+      if (jc.rs485_multidrop)
+        LDU_setRS485Address(&loc_comm_params, gateaway_mac);
     }
     LDU_init(&loc_comm_params);
   }
-  LDU_debugEnable(true);
+  LDU_debugEnable(BOOT_DEBUG_ENABLE);
   BLE_debugEnable(false);
 }
 
@@ -186,34 +715,55 @@ void loop()
 
   sensor_data sd;
   getSensorData(&sd, &jc.sc);
-  printSensorData(&sd, &jc.sc);
+  BOOT_markFirstSample();
+  FLT_apply(&sd, &jc.sc, jc.filters);
+  if (BOOT_DEBUG_ENABLE)
+    printSensorData(&sd, &jc.sc);
+
+  // report by exception, local link is not used if nothing changed
+  if (!isReportNeeded(&sd, &jc.sc, time(NULL)))
+  {
+    DEBUG_PRINTLN("No significant change, reading not reported");
+    RGB_LED_setColor(BLACK);
+    goToSleep();
+  }
 
   if(!convertToSensorDataArray(&sensor_data_packet[7], 256-7, &sensor_data_packet_length, &sd, &jc.sc))
-    Serial.println("Conversion failed");
+    DEBUG_PRINTLN("Conversion failed");
   
   sensor_data_packet[6] = sensor_data_packet_length;
   sensor_data_packet_length += 7;
+  appendTelemetry(sensor_data_packet, &sensor_data_packet_length, sizeof(sensor_data_packet));
 
-  Serial.print("Packet len: ");
-  Serial.println(sensor_data_packet_length);
+  DEBUG_PRINTLN("Packet len: " + String(sensor_data_packet_length));
+
+  // on multi-drop bus core decides when unit sends, so units never collide
+  if (loc_comm_params.rs485_address != LDU_RS485_NO_ADDRESS && LDU_waitForPoll(&loc_comm_params, jc.rs485_poll_timeout) != LDU_OK)
+  {
+    DEBUG_PRINTLN("Not polled by core");
+    if (jc.local_backlog)
+      storeReading(&sd);
+    RGB_LED_setColor(BLACK);
+    goToSleep();
+  }
 
   uint8_t ret = LDU_sendSensorData(&loc_comm_params, sensor_data_packet, sensor_data_packet_length);
+  if (ret != LDU_OK)
+    DEBUG_PRINTLN("LDU send failed");
 
-  packet_len = 0;
-  LDU_recv(&loc_comm_params, (char *)packet, &packet_len, (uint32_t)5000);
+  // reading is reported only when core confirms it, otherwise it is stored and sent with backlog
+  if (ret == LDU_OK && isConfirmedByCore())
+  {
+    markReported(&sd, time(NULL));
+    if (jc.local_backlog)
+      sendLocalBacklog();
+  }
+  else if (jc.local_backlog)
+    storeReading(&sd);
 
-  uint16_t header;
-  if(LDU_parsePacket(&loc_comm_params, packet, packet_len, &header) != LDU_OK)
-    Serial.println("PARSE ERROR");
+  LDU_close(&loc_comm_params);
 
   RGB_LED_setColor(BLACK);
   
-  esp_sleep_enable_timer_wakeup(TIME_TO_SLEEP * uS_TO_S_FACTOR);
-  Serial.println("Setup ESP32 to sleep for every " + String(TIME_TO_SLEEP) +
-  " Seconds");
-
-  Serial.println("Going to sleep now");
-  Serial.flush(); 
-  esp_deep_sleep_start();
-  Serial.println("This will never be printed");
+  goToSleep();
 }
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "pipeline.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+
+#define PL_DONE_BIT     BIT0
+
+// preallocated reading buffers, pointers to them are passed through queues
+static sensor_data pl_pool[PL_POOL_SIZE];
+
+static StaticQueue_t pl_free_queue_buffer;
+static StaticQueue_t pl_ready_queue_buffer;
+static uint8_t pl_free_queue_storage[PL_POOL_SIZE * sizeof(sensor_data *)];
+static uint8_t pl_ready_queue_storage[PL_POOL_SIZE * sizeof(sensor_data *)];
+static QueueHandle_t pl_free_queue = NULL;
+static QueueHandle_t pl_ready_queue = NULL;
+
+static StaticEventGroup_t pl_events_buffer;
+static EventGroupHandle_t pl_events = NULL;
+
+static StaticTask_t pl_sample_task_buffer;
+static StaticTask_t pl_radio_task_buffer;
+static StackType_t pl_sample_stack[PL_SAMPLE_STACK_SIZE];
+static StackType_t pl_radio_stack[PL_RADIO_STACK_SIZE];
+
+static const PL_stages *pl_stages;
+static uint8_t pl_readings;
+
+/**
+* Task that samples readings into free buffers and passes them to radio task.
+* @param arg - not used
+*/
+static void PL_sampleTask(void *arg)
+{
+    sensor_data *sd;
+
+    for (uint8_t i = 0; i < pl_readings; i++)
+    {
+        xQueueReceive(pl_free_queue, &sd, portMAX_DELAY);
+        pl_stages->sample(sd);
+        xQueueSend(pl_ready_queue, &sd, portMAX_DELAY);
+    }
+
+    vTaskDelete(NULL);
+}
+
+/**
+* Task that joins network and then transmits readings from sampling task.
+* @param arg - not used
+*/
+static void PL_radioTask(void *arg)
+{
+    sensor_data *sd;
+
+    pl_stages->associate();
+
+    for (uint8_t i = 0; i < pl_readings; i++)
+    {
+        xQueueReceive(pl_ready_queue, &sd, portMAX_DELAY);
+        // sampling task could not be started, readings are handled by caller
+        if (sd == NULL)
+            break;
+        pl_stages->transmit(sd);
+        xQueueSend(pl_free_queue, &sd, portMAX_DELAY);
+    }
+
+    xEventGroupSetBits(pl_events, PL_DONE_BIT);
+    vTaskDelete(NULL);
+}
+
+bool PL_run(const PL_stages *stages, uint8_t readings)
+{
+    if (readings == 0)
+        readings = 1;
+
+    if (pl_events == NULL)
+    {
+        pl_free_queue = xQueueCreateStatic(PL_POOL_SIZE, sizeof(sensor_data *), pl_free_queue_storage, &pl_free_queue_buffer);
+        pl_ready_queue = xQueueCreateStatic(PL_POOL_SIZE, sizeof(sensor_data *), pl_ready_queue_storage, &pl_ready_queue_buffer);
+        pl_events = xEventGroupCreateStatic(&pl_events_buffer);
+    }
+
+    xQueueReset(pl_free_queue);
+    xQueueReset(pl_ready_queue);
+    xEventGroupClearBits(pl_events, PL_DONE_BIT);
+    for (uint8_t i = 0; i < PL_POOL_SIZE; i++)
+    {
+        sensor_data *sd = &pl_pool[i];
+        xQueueSend(pl_free_queue, &sd, 0);
+    }
+
+    pl_stages = stages;
+    pl_readings = readings;
+
+    // radio task is started first, so association starts as soon as possible
+    if (xTaskCreateStaticPinnedToCore(PL_radioTask, "pl_radio", PL_RADIO_STACK_SIZE, NULL, PL_TASK_PRIORITY,
+                                      pl_radio_stack, &pl_radio_task_buffer, PL_RADIO_CORE) == NULL)
+        return false;
+    if (xTaskCreateStaticPinnedToCore(PL_sampleTask, "pl_sample", PL_SAMPLE_STACK_SIZE, NULL, PL_TASK_PRIORITY,
+                                      pl_sample_stack, &pl_sample_task_buffer, PL_SAMPLE_CORE) == NULL)
+    {
+        // radio task is stopped after association, so it does not run in parallel with caller
+        sensor_data *stop = NULL;
+        xQueueSend(pl_ready_queue, &stop, portMAX_DELAY);
+        xEventGroupWaitBits(pl_events, PL_DONE_BIT, pdTRUE, pdTRUE, portMAX_DELAY);
+        return false;
+    }
+
+    xEventGroupWaitBits(pl_events, PL_DONE_BIT, pdTRUE, pdTRUE, portMAX_DELAY);
+    return true;
+}
@@ -1,10 +1,30 @@
 #include "sdu.h"
+#include <trace.h>
 
-#define NUM_OF_ATTEMPTS_ON_RECEIVE 3
+// time to wait for server response on BG96 (in milliseconds)
+#define RECEIVE_TIMEOUT 5000
 
 ESP32Time rtc;
 bool SDU_debug_enable = false;
-unsigned char session_key[32];
+
+// session established by handshake, kept in RTC memory across deep sleep
+RTC_DATA_ATTR unsigned char session_key[32];
+RTC_DATA_ATTR bool session_valid = false;
+RTC_DATA_ATTR uint32_t session_epoch = 0;
+
+// readings batched across deep sleep, each one is prefixed with its length
+RTC_DATA_ATTR uint8_t batch_buffer[SDU_BATCH_BUFFER_SIZE];
+RTC_DATA_ATTR uint16_t batch_len = 0;
+RTC_DATA_ATTR uint8_t batch_count = 0;
+RTC_DATA_ATTR uint8_t batch_last_len = 0;
+RTC_DATA_ATTR uint32_t batch_epoch = 0;
+
+// server rejected compact sensor data header
+RTC_DATA_ATTR bool compact_rejected = false;
+
+// HMAC(salt, password) used by IV update and handshake, derived once per configuration
+static uint8_t shared_secret_cache[32];
+static bool shared_secret_cached = false;
 
 void SDU_debugEnable(bool enable)
 {
@@ -18,6 +38,7 @@ void SDU_debugPrint(int8_t *title, uint8_t *data, uint16_t data_len)
 
 void SDU_debugPrintError(uint8_t error_code)
 {
+#ifndef FAST_BOOT
     switch(error_code)
     {
         case PACKET_OK:
@@ -99,6 +120,7 @@ void SDU_debugPrintError(uint8_t error_code)
         default:
             DEBUG_STREAM.println("UNKNOWN_ERROR_CODE");
     }
+#endif
 }
 
 
@@ -107,8 +129,34 @@ uint8_t checkBytes(uint8_t input1, uint8_t input2)
     return (input1 == input2) ? 0x00 : 0xFF;   
 }
 
+uint8_t SDU_associate(SDU_struct *comm_params)
+{
+    // registered modem is only woken up
+    if (comm_params->type_of_tunnel == BG96)
+    {
+        if (!BG96_attach(comm_params->apn, comm_params->apn_user, comm_params->apn_password, comm_params->bg96_power))
+            return BG96_ERROR;
+    }
+    else if (comm_params->type_of_tunnel == WIFI)
+    {
+        if (WIFI_status() != WL_CONNECTED)
+            WiFi_setup(comm_params->ssid, comm_params->pass);
+    }
+    else
+    {
+        return BAD_COMM_STRUCTURE;
+    }
+
+    return 0x00;
+}
+
 uint8_t SDU_establishConnection(SDU_struct *comm_params)
 {
+    // does nothing if network is already joined
+    uint8_t ret = SDU_associate(comm_params);
+    if (ret != 0x00)
+        return ret;
+
     if (comm_params->type_of_protocol == UDP && comm_params->type_of_tunnel == BG96)
     {
         if (!BG96_OpenSocketUDP())
@@ -128,9 +176,6 @@ uint8_t SDU_establishConnection(SDU_struct *comm_params)
     }
     else if (comm_params->type_of_tunnel == WIFI)
     {
-        if (WIFI_status() != WL_CONNECTED)
-            WiFi_setup(comm_params->ssid, comm_params->pass);
-
         if (comm_params->type_of_protocol == TCP)
         {
             if (!WiFi_TCPconnect(comm_params->server_IP, comm_params->port))
@@ -179,7 +224,7 @@ uint8_t SDU_closeConnection(SDU_struct *comm_params)
 }
 
 
-uint8_t SDU_constructPacket(uint8_t *mac, uint16_t header_type, uint8_t *in_data, uint8_t in_data_len, uint8_t *out_data, uint16_t *out_data_len)
+uint8_t SDU_constructPacket(uint8_t *mac, uint16_t header_type, uint8_t *in_data, uint16_t in_data_len, uint8_t *out_data, uint16_t *out_data_len)
 {
     CRC8 crc;
     crc.setPolynome(CRC8_DEFAULT_VALUE);
@@ -217,6 +262,9 @@ uint8_t SDU_constructPacket(uint8_t *mac, uint16_t header_type, uint8_t *in_data
         break;
 
         case SENSOR_ENC_DATA_HEADER:
+        case SENSOR_ENC_COMPACT_DATA_HEADER:
+            if (in_data_len > SDU_MAX_DATA_LENGTH)
+                return LOCAL_ERROR(INVALID_NUM_OF_BYTES);
             //memcpy(out_data + MAC_LENGTH + HEADER_LENGTH, &in_data_len, 1);
             //memcpy(out_data + MAC_LENGTH + HEADER_LENGTH + DATA_LENGTH, in_data, in_data_len);
             memcpy(out_data + MAC_LENGTH + HEADER_LENGTH, in_data, in_data_len);
@@ -225,6 +273,9 @@ uint8_t SDU_constructPacket(uint8_t *mac, uint16_t header_type, uint8_t *in_data
         break;
 
         case SENSOR_DATA_HEADER:
+        case SENSOR_COMPACT_DATA_HEADER:
+            if (in_data_len > SDU_MAX_DATA_LENGTH)
+                return LOCAL_ERROR(INVALID_NUM_OF_BYTES);
             memcpy(out_data + MAC_LENGTH + HEADER_LENGTH, in_data, in_data_len);
             crc.add((uint8_t*)in_data, in_data_len);
             *out_data_len = MAC_LENGTH + HEADER_LENGTH + in_data_len + CRC_LENGTH;
@@ -292,13 +343,38 @@ uint8_t SDU_parsePacket(uint8_t *input, uint16_t input_length, uint8_t *output,
     CRC8 crc;
     crc.setPolynome(CRC8_DEFAULT_VALUE);
     crc.add((uint8_t*)output, *output_length);
-    
-    DEBUG_STREAM.println(crc.getCRC(), HEX);
-    DEBUG_STREAM.println(input[*output_length + HEADER_LENGTH], HEX);
+
+#ifndef FAST_BOOT
+    if (SDU_debug_enable)
+    {
+        DEBUG_STREAM.println(crc.getCRC(), HEX);
+        DEBUG_STREAM.println(input[*output_length + HEADER_LENGTH], HEX);
+    }
+#endif
 
     return checkBytes(crc.getCRC(), input[*output_length + HEADER_LENGTH]);
 }
 
+/**
+ * Function that returns shared secret derived from salt and password, it is derived only on first call
+ * @param comm_params - Configuration structure for server communication
+ * @param shared_secret - Buffer for shared secret (32 bytes)
+ * @return Returns true on success
+ */
+static bool SDU_getSharedSecret(SDU_struct *comm_params, uint8_t *shared_secret)
+{
+    if (!shared_secret_cached)
+    {
+        mbedtls_md_context_t ctx;
+        if (!Crypto_Digest(&ctx, HMAC_SHA256, (uint8_t *) comm_params->hmac_salt, strlen(comm_params->hmac_salt), shared_secret_cache, (uint8_t *) comm_params->password, strlen(comm_params->password)))
+            return false;
+        shared_secret_cached = true;
+    }
+
+    memcpy(shared_secret, shared_secret_cache, sizeof(shared_secret_cache));
+    return true;
+}
+
 uint8_t SDU_updateIV(SDU_struct *comm_params)
 {
     if (comm_params->mode_of_work != ENCRYPTED_COMM)
@@ -308,11 +384,10 @@ uint8_t SDU_updateIV(SDU_struct *comm_params)
     uint8_t ret;
     uint16_t expected_size = 0;
     byte shared_secret[32];
-    mbedtls_md_context_t ctx;
 
     Crypto_debugEnable(true);
     
-    if (!Crypto_Digest(&ctx, HMAC_SHA256, (uint8_t *) comm_params->hmac_salt, strlen(comm_params->hmac_salt), shared_secret, (uint8_t *) comm_params->password, strlen(comm_params->password)))
+    if (!SDU_getSharedSecret(comm_params, shared_secret))
       return CRYPTO_FUNC_ERROR;
 
     ret = SDU_establishConnection(comm_params);
@@ -387,50 +462,34 @@ uint8_t SDU_updateIV(SDU_struct *comm_params)
 
     if (comm_params->type_of_protocol == UDP && comm_params->type_of_tunnel == BG96)
     {
-        uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-        do
+        expected_size = HEADER_LENGTH + DATE_UPDATE_LEN + CRC_LENGTH;
+        if (!BG96_waitForRecv(BG96_UDP_CONNECT_ID, RECEIVE_TIMEOUT))
+            expected_size = 0;
+        else if (!BG96_RecvUDP(date_update, &expected_size))
         {
-            delay(1000);
-            expected_size = HEADER_LENGTH + DATE_UPDATE_LEN + CRC_LENGTH;
-            if (!BG96_RecvUDP(date_update, &expected_size))
-            {
-                ret = SDU_closeConnection(comm_params);
-                if (ret != 0x00)
-                    return ret;
-                return BG96_ERROR;
-            }
-            
-            num_of_attempts--;
-        } while(expected_size == 0 && num_of_attempts != 0);
+            ret = SDU_closeConnection(comm_params);
+            if (ret != 0x00)
+                return ret;
+            return BG96_ERROR;
+        }
     }
     else if (comm_params->type_of_protocol == TCP && comm_params->type_of_tunnel == BG96)
     {
-        uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-        do
+        expected_size = HEADER_LENGTH + DATE_UPDATE_LEN + CRC_LENGTH;
+        if (!BG96_waitForRecv(BG96_TCP_CONNECT_ID, RECEIVE_TIMEOUT))
+            expected_size = 0;
+        else if (!BG96_RecvTCP(date_update, &expected_size))
         {
-            delay(1000);
-            expected_size = HEADER_LENGTH + DATE_UPDATE_LEN + CRC_LENGTH;
-            if (!BG96_RecvTCP(date_update, &expected_size))
-            {
-                ret = SDU_closeConnection(comm_params);
-                if (ret != 0x00)
-                    return ret;
-                return BG96_ERROR;
-            }
-            
-            num_of_attempts--;
-        } while(expected_size == 0 && num_of_attempts != 0);
+            ret = SDU_closeConnection(comm_params);
+            if (ret != 0x00)
+                return ret;
+            return BG96_ERROR;
+        }
     }
     else if (comm_params->type_of_protocol == MQTT && comm_params->type_of_tunnel == BG96)
     {
-        uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-        do
-        {
-            delay(1000);
-            expected_size = HEADER_LENGTH + DATE_UPDATE_LEN + CRC_LENGTH;
-            BG96_MQTTcollectData(date_update, &expected_size);
-            num_of_attempts--;
-        } while(expected_size == 0 && num_of_attempts != 0);
+        expected_size = HEADER_LENGTH + DATE_UPDATE_LEN + CRC_LENGTH;
+        BG96_MQTTcollectData(date_update, &expected_size, RECEIVE_TIMEOUT);
     }
     else if (comm_params->type_of_protocol == UDP && comm_params->type_of_tunnel == WIFI)
     {
@@ -515,7 +574,10 @@ uint8_t SDU_genIV(uint8_t *iv)
     str += ((rtc.getMonth() + 1) < 10) ? ("0" + String(rtc.getMonth() + 1)) : String(rtc.getMonth() + 1);
     str += String(rtc.getYear());
 
-    DEBUG_STREAM.println(str);
+#ifndef FAST_BOOT
+    if (SDU_debug_enable)
+        DEBUG_STREAM.println(str);
+#endif
 
     str.toCharArray(hash_input, 32);
 
@@ -564,6 +626,23 @@ uint8_t SDU_setWIFIparams(SDU_struct *comm_params, char *ssid, char *pass)
 }
 
 
+uint8_t SDU_setBG96params(SDU_struct *comm_params, char *apn, char *apn_user, char *apn_password, BG96_powerConfig *power)
+{
+    if (comm_params->type_of_tunnel == BG96)
+    {
+        comm_params->apn = apn;
+        comm_params->apn_user = apn_user;
+        comm_params->apn_password = apn_password;
+        comm_params->bg96_power = power;
+        return PACKET_OK;
+    }
+    else
+    {
+        return BAD_COMM_STRUCTURE;
+    }
+}
+
+
 void SDU_init(SDU_struct *comm_params, COMM_MODE mode_of_work, PROTOCOL_MODE type_of_protocol, SERVER_TUNNEL_MODE type_of_tunnel, char server_IP[], uint16_t port, char *hmac_salt, char *password, uint8_t *device_mac)
 {
     comm_params->mode_of_work = mode_of_work;
@@ -575,14 +654,167 @@ void SDU_init(SDU_struct *comm_params, COMM_MODE mode_of_work, PROTOCOL_MODE typ
     comm_params->password = password;
     comm_params->personalization_info = (char *)device_mac;
     comm_params->device_mac = device_mac;
+    comm_params->session_lifetime = SDU_DEFAULT_SESSION_LIFETIME;
+    comm_params->apn = (char *)"";
+    comm_params->apn_user = (char *)"";
+    comm_params->apn_password = (char *)"";
+    comm_params->bg96_power = NULL;
+    comm_params->batch_size = 1;
+    comm_params->batch_deadline = 0;
+
+    // salt or password may be changed
+    shared_secret_cached = false;
 }
 
+uint8_t SDU_setBatchParams(SDU_struct *comm_params, uint8_t batch_size, uint32_t batch_deadline)
+{
+    if (batch_size == 0 || batch_size > SDU_MAX_BATCH_SIZE)
+        return BAD_COMM_STRUCTURE;
 
-uint8_t SDU_handshake(SDU_struct *comm_params)
+    comm_params->batch_size = batch_size;
+    comm_params->batch_deadline = batch_deadline;
+    return PACKET_OK;
+}
+
+uint8_t SDU_batchAdd(SDU_struct *comm_params, uint8_t *reading, uint16_t reading_len)
+{
+    if (reading_len == 0 || reading_len > 0xFF || batch_count == SDU_MAX_BATCH_SIZE ||
+        batch_len + DATA_LENGTH + reading_len > SDU_BATCH_BUFFER_SIZE)
+        return LOCAL_ERROR(INVALID_NUM_OF_BYTES);
+
+    if (batch_count == 0)
+        batch_epoch = rtc.getEpoch();
+
+    batch_buffer[batch_len++] = reading_len;
+    memcpy(&batch_buffer[batch_len], reading, reading_len);
+    batch_len += reading_len;
+    batch_count++;
+    batch_last_len = reading_len;
+
+    return PACKET_OK;
+}
+
+bool SDU_batchReady(SDU_struct *comm_params)
+{
+    if (batch_count == 0)
+        return false;
+
+    if (batch_count >= comm_params->batch_size)
+        return true;
+
+    // readings have the same format, so the next one would not fit
+    if (batch_len + DATA_LENGTH + batch_last_len > SDU_BATCH_BUFFER_SIZE || batch_count == SDU_MAX_BATCH_SIZE)
+        return true;
+
+    uint32_t now = rtc.getEpoch();
+    return comm_params->batch_deadline != 0 && (now < batch_epoch || now - batch_epoch >= comm_params->batch_deadline);
+}
+
+uint8_t SDU_sendBatch(SDU_struct *comm_params)
+{
+    static uint8_t raw_data[MAC_LENGTH + SDU_BATCH_BUFFER_SIZE];
+
+    if (batch_count == 0)
+        return LOCAL_ERROR(INVALID_NUM_OF_BYTES);
+
+    memcpy(raw_data, comm_params->device_mac, MAC_LENGTH);
+    memcpy(raw_data + MAC_LENGTH, batch_buffer, batch_len);
+
+    if (SDU_debug_enable)
+        DEBUG_STREAM.println("Sending batch of " + String(batch_count) + " readings");
+
+    return SDU_sendData(comm_params, raw_data, MAC_LENGTH + batch_len);
+}
+
+bool SDU_batchGet(uint8_t index, uint8_t **reading, uint16_t *reading_len)
+{
+    uint16_t pos = 0;
+
+    if (index >= batch_count)
+        return false;
+
+    for (uint8_t i = 0; i < index; i++)
+        pos += DATA_LENGTH + batch_buffer[pos];
+
+    *reading_len = batch_buffer[pos];
+    *reading = &batch_buffer[pos + DATA_LENGTH];
+    return true;
+}
+
+uint8_t SDU_batchCount()
+{
+    return batch_count;
+}
+
+void SDU_batchClear()
+{
+    batch_len = 0;
+    batch_count = 0;
+    batch_last_len = 0;
+}
+
+uint8_t SDU_setSessionLifetime(SDU_struct *comm_params, uint32_t session_lifetime)
+{
+    if (comm_params->mode_of_work != ENCRYPTED_COMM)
+        return BAD_COMM_STRUCTURE;
+
+    comm_params->session_lifetime = session_lifetime;
+    return PACKET_OK;
+}
+
+bool SDU_resumeSession(SDU_struct *comm_params)
+{
+    if (comm_params->mode_of_work != ENCRYPTED_COMM || !session_valid)
+        return false;
+
+    uint32_t now = rtc.getEpoch();
+    if (now < session_epoch || now - session_epoch >= comm_params->session_lifetime)
+    {
+        if (SDU_debug_enable)
+            DEBUG_STREAM.println("Session expired");
+        SDU_invalidateSession();
+        return false;
+    }
+
+    if (SDU_debug_enable)
+        DEBUG_STREAM.println("Session resumed, age: " + String(now - session_epoch) + " s");
+
+    return true;
+}
+
+bool SDU_isSessionValid()
+{
+    return session_valid;
+}
+
+void SDU_invalidateSession()
+{
+    session_valid = false;
+    memset(session_key, 0, sizeof(session_key));
+}
+
+bool SDU_isSessionRejected(uint8_t response_code)
+{
+    switch (response_code)
+    {
+        case S_INVALID_MAC:
+        case S_INTEGRITY_ERROR:
+        case S_VERIFICATION_ERROR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+static uint8_t SDU_doHandshake(SDU_struct *comm_params)
 {
     if (comm_params -> mode_of_work != ENCRYPTED_COMM)
         return BAD_COMM_STRUCTURE;
 
+    // session key is overwritten during handshake
+    SDU_invalidateSession();
+
     uint8_t ret;
     uint16_t expected_size = 0;
     uint8_t cmd[128], response[128];
@@ -591,11 +823,10 @@ uint8_t SDU_handshake(SDU_struct *comm_params)
 
      // generate sha of password
     byte shared_secret[32];
-    mbedtls_md_context_t ctx;
 
     //Crypto_debugEnable(true);
     
-    if (!Crypto_Digest(&ctx, HMAC_SHA256, (uint8_t *) comm_params->hmac_salt, strlen(comm_params->hmac_salt), shared_secret, (uint8_t *) comm_params->password, strlen(comm_params->password)))
+    if (!SDU_getSharedSecret(comm_params, shared_secret))
       return CRYPTO_FUNC_ERROR;
 
     // generate private public key pair
@@ -711,51 +942,37 @@ uint8_t SDU_handshake(SDU_struct *comm_params)
 
     if (comm_params->type_of_protocol == UDP && comm_params->type_of_tunnel == BG96)
     {
-        uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-        do
+        expected_size = HEADER_LENGTH + SERVER_HELLO_LENGTH + CRC_LENGTH;
+        if (!BG96_waitForRecv(BG96_UDP_CONNECT_ID, RECEIVE_TIMEOUT))
+            expected_size = 0;
+        else if (!BG96_RecvUDP(server_hello, &expected_size))
         {
-            delay(1000);
-            expected_size = HEADER_LENGTH + SERVER_HELLO_LENGTH + CRC_LENGTH;
-            if (!BG96_RecvUDP(server_hello, &expected_size))
-            {
-                ret = SDU_closeConnection(comm_params);
-                if (ret != 0x00)
-                    return ret;
-                return BG96_ERROR;
-            }
-            num_of_attempts--;
-        } while(expected_size == 0 && num_of_attempts != 0);
+            ret = SDU_closeConnection(comm_params);
+            if (ret != 0x00)
+                return ret;
+            return BG96_ERROR;
+        }
     }
     else if (comm_params->type_of_protocol == TCP && comm_params->type_of_tunnel == BG96)
     {
-        uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-        do
+        expected_size = HEADER_LENGTH + SERVER_HELLO_LENGTH + CRC_LENGTH;
+        if (!BG96_waitForRecv(BG96_TCP_CONNECT_ID, RECEIVE_TIMEOUT))
+            expected_size = 0;
+        else if (!BG96_RecvTCP(server_hello, &expected_size))
         {
-            delay(1000);
-            expected_size = HEADER_LENGTH + SERVER_HELLO_LENGTH + CRC_LENGTH;
-            if (!BG96_RecvTCP(server_hello, &expected_size))
-            {
-                ret = SDU_closeConnection(comm_params);
-                if (ret != 0x00)
-                    return ret;
-                return BG96_ERROR;
-            }
-            num_of_attempts--;
-        } while(expected_size == 0 && num_of_attempts != 0);
+            ret = SDU_closeConnection(comm_params);
+            if (ret != 0x00)
+                return ret;
+            return BG96_ERROR;
+        }
 
         if (!SDU_closeConnection(comm_params))
             return BG96_ERROR;
     }
     else if (comm_params->type_of_protocol == MQTT && comm_params->type_of_tunnel == BG96)
     {
-        uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-        do
-        {
-            delay(1000);
-            expected_size = HEADER_LENGTH + SERVER_HELLO_LENGTH + CRC_LENGTH;
-            BG96_MQTTcollectData(server_hello, &expected_size);
-            num_of_attempts--;
-        } while(expected_size == 0 && num_of_attempts != 0);
+        expected_size = HEADER_LENGTH + SERVER_HELLO_LENGTH + CRC_LENGTH;
+        BG96_MQTTcollectData(server_hello, &expected_size, RECEIVE_TIMEOUT);
     }
     else if (comm_params->type_of_protocol == UDP && comm_params->type_of_tunnel == WIFI)
     {
@@ -952,48 +1169,34 @@ uint8_t SDU_handshake(SDU_struct *comm_params)
     expected_size = HEADER_LENGTH + SERVER_VERIFY_LENGTH + CRC_LENGTH;
     if (comm_params->type_of_protocol == UDP && comm_params->type_of_tunnel == BG96)
     {
-        uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-        do
+        expected_size = HEADER_LENGTH + SERVER_VERIFY_LENGTH + CRC_LENGTH;
+        if (!BG96_waitForRecv(BG96_UDP_CONNECT_ID, RECEIVE_TIMEOUT))
+            expected_size = 0;
+        else if (!BG96_RecvUDP(server_verify, &expected_size))
         {
-            delay(1000);
-            expected_size = HEADER_LENGTH + SERVER_VERIFY_LENGTH + CRC_LENGTH;
-            if (!BG96_RecvUDP(server_verify, &expected_size))
-            {
-                ret = SDU_closeConnection(comm_params);
-                if (ret != 0x00)
-                    return ret;
-                return BG96_ERROR;
-            }
-            num_of_attempts--;
-        } while(expected_size == 0 && num_of_attempts != 0);
+            ret = SDU_closeConnection(comm_params);
+            if (ret != 0x00)
+                return ret;
+            return BG96_ERROR;
+        }
     }
     else if (comm_params->type_of_protocol == TCP && comm_params->type_of_tunnel == BG96)
     {
-        uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-        do
+        expected_size = HEADER_LENGTH + SERVER_VERIFY_LENGTH + CRC_LENGTH;
+        if (!BG96_waitForRecv(BG96_TCP_CONNECT_ID, RECEIVE_TIMEOUT))
+            expected_size = 0;
+        else if (!BG96_RecvTCP(server_verify, &expected_size))
         {
-            delay(1000);
-            expected_size = HEADER_LENGTH + SERVER_VERIFY_LENGTH + CRC_LENGTH;
-            if (!BG96_RecvTCP(server_verify, &expected_size))
-            {
-                ret = SDU_closeConnection(comm_params);
-                if (ret != 0x00)
-                    return ret;
-                return BG96_ERROR;
-            }
-            num_of_attempts--;
-        } while(expected_size == 0 && num_of_attempts != 0);
+            ret = SDU_closeConnection(comm_params);
+            if (ret != 0x00)
+                return ret;
+            return BG96_ERROR;
+        }
     }
     else if (comm_params->type_of_protocol == MQTT && comm_params->type_of_tunnel == BG96)
     {
-        uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-        do
-        {
-            delay(1000);
-            expected_size = HEADER_LENGTH + SERVER_VERIFY_LENGTH + CRC_LENGTH;
-            BG96_MQTTcollectData(server_verify, &expected_size);
-            num_of_attempts--;
-        } while(expected_size == 0 && num_of_attempts != 0);
+        expected_size = HEADER_LENGTH + SERVER_VERIFY_LENGTH + CRC_LENGTH;
+        BG96_MQTTcollectData(server_verify, &expected_size, RECEIVE_TIMEOUT);
     }
     else if (comm_params->type_of_protocol == UDP && comm_params->type_of_tunnel == WIFI)
     {
@@ -1051,11 +1254,31 @@ uint8_t SDU_handshake(SDU_struct *comm_params)
     if (ret != 0x00)
         return ret;
 
+    session_valid = true;
+    session_epoch = rtc.getEpoch();
+
     return PACKET_OK;
 }
 
+uint8_t SDU_handshake(SDU_struct *comm_params)
+{
+    TRC_begin(TRC_HANDSHAKE);
+    uint8_t ret = SDU_doHandshake(comm_params);
+    TRC_end(TRC_HANDSHAKE);
 
-uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_data_len)
+    return ret;
+}
+
+
+/**
+* Function used to send sensor data in full or compact format.
+* @param comm_params - pointer to communication structure that will be used
+* @param raw_data - pointer to array of bytes to be sent
+* @param raw_data_len - length of bytes to be sent
+* @param compact - true if data contains readings in compact format
+* @return - error code
+*/
+static uint8_t SDU_sendSensorData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_data_len, bool compact)
 {
     uint8_t ret;
     uint16_t expected_size = 0;
@@ -1069,9 +1292,13 @@ uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_da
         if (ret != 0)
             return ret;
 
-        uint8_t sensor_data[256];
+        uint8_t sensor_data[MAC_LENGTH + HEADER_LENGTH + SDU_MAX_DATA_LENGTH + CRC_LENGTH];
         uint16_t sensor_data_len;
-        uint8_t enc_sensor_data_raw[128];
+        uint8_t enc_sensor_data_raw[SDU_MAX_DATA_LENGTH];
+
+        // data is padded with 1 to 16 bytes
+        if (raw_data_len + 16 - raw_data_len % 16 > SDU_MAX_DATA_LENGTH)
+            return LOCAL_ERROR(INVALID_NUM_OF_BYTES);
 
         if (!Crypto_AES(&aes, ENCRYPT, session_key, 256, iv, raw_data, enc_sensor_data_raw, raw_data_len))
             return CRYPTO_FUNC_ERROR;
@@ -1084,7 +1311,7 @@ uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_da
         if (ret != 0x00)
             return ret;
 
-        ret = SDU_constructPacket(comm_params->device_mac, SENSOR_ENC_DATA_HEADER, enc_sensor_data_raw, raw_data_len, sensor_data, &sensor_data_len);
+        ret = SDU_constructPacket(comm_params->device_mac, compact ? SENSOR_ENC_COMPACT_DATA_HEADER : SENSOR_ENC_DATA_HEADER, enc_sensor_data_raw, raw_data_len, sensor_data, &sensor_data_len);
 
         if (ret != 0)
         {
@@ -1150,52 +1377,31 @@ uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_da
         uint8_t sensor_response_raw[16];
         uint16_t sensor_response_raw_length;
 
+        // response span is ended before any return below
+        bool recv_failed = false;
         expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
+        TRC_begin(TRC_RESPONSE);
 
         if (comm_params->type_of_protocol == UDP && comm_params->type_of_tunnel == BG96)
         {
-            uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-            do
-            {
-                delay(1000);
-                expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
-                if (!BG96_RecvUDP(sensor_response, &expected_size))
-                {
-                    ret = SDU_closeConnection(comm_params);
-                    if (ret != 0x00)
-                        return ret;
-                    return BG96_ERROR;
-                }
-                num_of_attempts--;
-            } while(expected_size == 0 && num_of_attempts != 0);
+            expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
+            if (!BG96_waitForRecv(BG96_UDP_CONNECT_ID, RECEIVE_TIMEOUT))
+                expected_size = 0;
+            else if (!BG96_RecvUDP(sensor_response, &expected_size))
+                recv_failed = true;
         }
         else if (comm_params->type_of_protocol == TCP && comm_params->type_of_tunnel == BG96)
         {
-            uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-            do
-            {
-                delay(1000);
-                expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
-                if (!BG96_RecvTCP(sensor_response, &expected_size))
-                {
-                    ret = SDU_closeConnection(comm_params);
-                    if (ret != 0x00)
-                        return ret;
-                    return BG96_ERROR;
-                }
-                num_of_attempts--;
-            } while(expected_size == 0 && num_of_attempts != 0);
+            expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
+            if (!BG96_waitForRecv(BG96_TCP_CONNECT_ID, RECEIVE_TIMEOUT))
+                expected_size = 0;
+            else if (!BG96_RecvTCP(sensor_response, &expected_size))
+                recv_failed = true;
         }
         else if (comm_params->type_of_protocol == MQTT && comm_params->type_of_tunnel == BG96)
         {
-            uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-            do
-            {
-                delay(1000);
-                expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
-                BG96_MQTTcollectData(sensor_response, &expected_size);
-                num_of_attempts--;
-            } while(expected_size == 0 && num_of_attempts != 0);
+            expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
+            BG96_MQTTcollectData(sensor_response, &expected_size, RECEIVE_TIMEOUT);
         }
         else if (comm_params->type_of_protocol == UDP && comm_params->type_of_tunnel == WIFI)
         {
@@ -1210,6 +1416,14 @@ uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_da
             WiFi_MQTTrecv(sensor_response, &expected_size);
         }
 
+        TRC_end(TRC_RESPONSE);
+        if (recv_failed)
+        {
+            ret = SDU_closeConnection(comm_params);
+            if (ret != 0x00)
+                return ret;
+            return BG96_ERROR;
+        }
         SDU_debugPrint((int8_t *)"Sensor response", sensor_response, expected_size);
 
         sensor_response_length = expected_size;
@@ -1236,6 +1450,9 @@ uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_da
             SDU_debugPrint((int8_t *)"Sensor response", sensor_response_raw, sensor_response_raw_length);
         }
 
+        if (SDU_isSessionRejected(sensor_response_raw[0]))
+            SDU_invalidateSession();
+
         ret = SDU_closeConnection(comm_params);
         if (ret != 0x00)
             return ret;
@@ -1244,14 +1461,17 @@ uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_da
     }
     else if (comm_params -> mode_of_work == NON_ENCRYPTED_COMM)
     {
-        uint8_t sensor_data[256];
+        uint8_t sensor_data[MAC_LENGTH + HEADER_LENGTH + SDU_MAX_DATA_LENGTH + CRC_LENGTH];
         uint16_t sensor_data_len;
 
+        if (raw_data_len > SDU_MAX_DATA_LENGTH)
+            return LOCAL_ERROR(INVALID_NUM_OF_BYTES);
+
         ret = SDU_establishConnection(comm_params);
         if (ret != 0x00)
             return ret;
 
-        ret = SDU_constructPacket(comm_params->device_mac, SENSOR_DATA_HEADER, raw_data, raw_data_len, sensor_data, &sensor_data_len);
+        ret = SDU_constructPacket(comm_params->device_mac, compact ? SENSOR_COMPACT_DATA_HEADER : SENSOR_DATA_HEADER, raw_data, raw_data_len, sensor_data, &sensor_data_len);
 
         if (ret != 0)
         {
@@ -1317,52 +1537,31 @@ uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_da
         uint8_t sensor_response_raw[16];
         uint16_t sensor_response_raw_length;
 
+        // response span is ended before any return below
+        bool recv_failed = false;
         expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
+        TRC_begin(TRC_RESPONSE);
 
         if (comm_params->type_of_protocol == UDP && comm_params->type_of_tunnel == BG96)
         {
-            uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-            do
-            {
-                delay(1000);
-                expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
-                if (!BG96_RecvUDP(sensor_response, &expected_size))
-                {
-                    ret = SDU_closeConnection(comm_params);
-                    if (ret != 0x00)
-                        return ret;
-                    return BG96_ERROR;
-                }
-                num_of_attempts--;
-            } while(expected_size == 0 && num_of_attempts != 0);
+            expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
+            if (!BG96_waitForRecv(BG96_UDP_CONNECT_ID, RECEIVE_TIMEOUT))
+                expected_size = 0;
+            else if (!BG96_RecvUDP(sensor_response, &expected_size))
+                recv_failed = true;
         }
         else if (comm_params->type_of_protocol == TCP && comm_params->type_of_tunnel == BG96)
         {
-            uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-            do
-            {
-                delay(1000);
-                expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
-                if (!BG96_RecvTCP(sensor_response, &expected_size))
-                {
-                    ret = SDU_closeConnection(comm_params);
-                    if (ret != 0x00)
-                        return ret;
-                    return BG96_ERROR;
-                }
-                num_of_attempts--;
-            } while(expected_size == 0 && num_of_attempts != 0);
+            expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
+            if (!BG96_waitForRecv(BG96_TCP_CONNECT_ID, RECEIVE_TIMEOUT))
+                expected_size = 0;
+            else if (!BG96_RecvTCP(sensor_response, &expected_size))
+                recv_failed = true;
         }
         else if (comm_params->type_of_protocol == MQTT && comm_params->type_of_tunnel == BG96)
         {
-            uint8_t num_of_attempts = NUM_OF_ATTEMPTS_ON_RECEIVE;
-            do
-            {
-                delay(1000);
-                expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
-                BG96_MQTTcollectData(sensor_response, &expected_size);
-                num_of_attempts--;
-            } while(expected_size == 0 && num_of_attempts != 0);
+            expected_size = HEADER_LENGTH + SENSOR_RESPONSE_LENGTH;
+            BG96_MQTTcollectData(sensor_response, &expected_size, RECEIVE_TIMEOUT);
         }
         else if (comm_params->type_of_protocol == UDP && comm_params->type_of_tunnel == WIFI)
         {
@@ -1377,6 +1576,14 @@ uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_da
             WiFi_MQTTrecv(sensor_response, &expected_size);
         }
 
+        TRC_end(TRC_RESPONSE);
+        if (recv_failed)
+        {
+            ret = SDU_closeConnection(comm_params);
+            if (ret != 0x00)
+                return ret;
+            return BG96_ERROR;
+        }
         sensor_response_length = expected_size;
         ret = SDU_parsePacket(sensor_response, sensor_response_length, sensor_response_raw, &sensor_response_raw_length);
 
@@ -1411,4 +1618,35 @@ uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_da
     {
         return BAD_COMM_STRUCTURE;
     }
-}
\ No newline at end of file
+}
+
+uint8_t SDU_sendData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_data_len)
+{
+    TRC_begin(TRC_SEND);
+    uint8_t ret = SDU_sendSensorData(comm_params, raw_data, raw_data_len, false);
+    TRC_end(TRC_SEND);
+
+    return ret;
+}
+
+uint8_t SDU_sendCompactData(SDU_struct *comm_params, uint8_t *raw_data, uint16_t raw_data_len)
+{
+    TRC_begin(TRC_SEND);
+    uint8_t ret = SDU_sendSensorData(comm_params, raw_data, raw_data_len, true);
+    TRC_end(TRC_SEND);
+
+    // server that does not know compact header rejects it, full format is used from now on
+    if (ret == S_INVALID_HEADER)
+    {
+        compact_rejected = true;
+        if (SDU_debug_enable)
+            DEBUG_STREAM.println("Compact format rejected by server");
+    }
+
+    return ret;
+}
+
+bool SDU_isCompactSupported()
+{
+    return !compact_rejected;
+}
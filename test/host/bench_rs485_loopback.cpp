@@ -0,0 +1,96 @@
+// Loopback benchmark of RS485 frame latency. Peer on the line echoes every frame after bus turnaround
+// (frame gap and driver setup), round trip is measured in virtual time of UART model and compared
+// with time the bytes need on the wire. Frame end has to be detected by idle line, not by
+// RS485_FRAME_TIMEOUT, so overhead stays within a few character times. Host CPU time per round trip
+// is reported as well.
+
+#include <Arduino.h>
+#include <RS485.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "driver/uart.h"
+#include "host_test.h"
+
+#define BENCH_ROUND_TRIPS 100
+#define BENCH_SEED        0x485
+
+static std::mt19937 rng(BENCH_SEED);
+
+/**
+ * Function that measures round trip of frames with given size
+ * @param baudrate - Baud rate of the line
+ * @param size - Frame length in bytes
+ */
+static void benchRoundTrip(uint32_t baudrate, uint16_t size)
+{
+  RS485_begin(baudrate);
+  RS485_setMode(RS485_RX);
+
+  double char_time = HOST_uartCharTime();
+  uint64_t turnaround = (uint64_t)(RS485_FRAME_GAP * char_time) + RS485_DE_SETUP_US;
+  HOST_uartSetPeer([turnaround](const uint8_t *data, size_t len, uint64_t end_us) {
+    HOST_uartSend(data, len, end_us + turnaround);
+  });
+
+  // two frames on the wire, peer turnaround, own driver setup and idle detection of response
+  double wire = 2 * size * char_time;
+  double expected = wire + turnaround + RS485_DE_SETUP_US + RS485_FRAME_GAP * char_time;
+
+  // line is idle before the first request
+  delayMicroseconds((unsigned int)(RS485_FRAME_GAP * char_time) + 1);
+
+  uint64_t virtual_total = 0;
+  uint64_t virtual_max = 0;
+  std::chrono::nanoseconds host_total(0);
+
+  for (int i = 0; i < BENCH_ROUND_TRIPS; i++)
+  {
+    std::vector<uint8_t> frame(size);
+    for (uint16_t j = 0; j < size; j++)
+      frame[j] = (uint8_t)rng();
+
+    uint8_t rx[RS485_MAX_FRAME_LENGTH + 1];
+    uint16_t rx_len = RS485_MAX_FRAME_LENGTH;
+
+    uint64_t start = micros();
+    auto host_start = std::chrono::steady_clock::now();
+    CHECK(RS485_transmit(frame.data(), size));
+    CHECK(RS485_recv(rx, &rx_len, 1000));
+    host_total += std::chrono::steady_clock::now() - host_start;
+    uint64_t round_trip = micros() - start;
+
+    CHECK_EQ(rx_len, size);
+    CHECK(memcmp(rx, frame.data(), size) == 0);
+    virtual_total += round_trip;
+    if (round_trip > virtual_max)
+      virtual_max = round_trip;
+  }
+
+  HOST_uartSetPeer(nullptr);
+  RS485_end();
+
+  double average = (double)virtual_total / BENCH_ROUND_TRIPS;
+  printf("  %7u baud %5u B: round trip %10.1f us (max %8llu, wire %10.1f, overhead %7.1f), host %6.2f us\n",
+         baudrate, size, average, (unsigned long long)virtual_max, wire, average - wire,
+         host_total.count() / 1000.0 / BENCH_ROUND_TRIPS);
+
+  // rounding of virtual time to microseconds is the only allowed slack
+  CHECK(virtual_max <= expected + 3);
+}
+
+TEST(round_trip_ends_on_idle_line)
+{
+  const uint32_t baudrates[] = {9600, 115200, 921600};
+  // 1000 B spans several FIFO threshold events, none of the sizes is multiple of threshold
+  const uint16_t sizes[] = {16, 64, 200, 1000};
+
+  for (uint32_t baudrate : baudrates)
+    for (uint16_t size : sizes)
+      benchRoundTrip(baudrate, size);
+}
+
+int main()
+{
+  return HOST_runTests();
+}
@@ -0,0 +1,70 @@
+#ifndef _HOST_TEST_H
+#define _HOST_TEST_H
+
+// Minimal test runner for host builds, each executable registers its cases with TEST and calls HOST_runTests
+
+#include <stdio.h>
+#include <vector>
+
+typedef void (*HOST_testFunc)();
+
+struct HOST_testCase
+{
+  const char *name;
+  HOST_testFunc func;
+};
+
+static inline std::vector<HOST_testCase> &HOST_tests()
+{
+  static std::vector<HOST_testCase> tests;
+  return tests;
+}
+
+static int host_failures = 0;
+
+struct HOST_registrar
+{
+  HOST_registrar(const char *name, HOST_testFunc func) { HOST_tests().push_back({name, func}); }
+};
+
+#define TEST(name) \
+  static void name(); \
+  static HOST_registrar name##_registrar(#name, name); \
+  static void name()
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) \
+    { \
+      printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      host_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) \
+  do { \
+    long long _a = (long long)(a), _b = (long long)(b); \
+    if (_a != _b) \
+    { \
+      printf("  %s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+      host_failures++; \
+    } \
+  } while (0)
+
+/**
+ * Function that runs all registered test cases
+ * @return Process exit code, 0 if all checks passed
+ */
+static inline int HOST_runTests()
+{
+  for (const HOST_testCase &test : HOST_tests())
+  {
+    int before = host_failures;
+    test.func();
+    printf("%s %s\n", host_failures == before ? "PASS" : "FAIL", test.name);
+  }
+  printf("%d failed checks\n", host_failures);
+  return host_failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#include <Arduino.h>
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+
+std::function<void(unsigned long)> HOST_delayHook;
+
+// virtual time in microseconds
+static uint64_t host_time_us = 0;
+
+unsigned long millis()
+{
+  return (unsigned long)(host_time_us / 1000);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)host_time_us;
+}
+
+void delay(unsigned long ms)
+{
+  host_time_us += (uint64_t)ms * 1000;
+  if (HOST_delayHook)
+    HOST_delayHook(ms);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  host_time_us += us;
+}
+
+void HOST_advance(unsigned long ms)
+{
+  host_time_us += (uint64_t)ms * 1000;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+}
+
+int digitalRead(uint8_t pin)
+{
+  return LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+  return 0;
+}
@@ -0,0 +1,211 @@
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+
+// Minimal Arduino API for host builds of firmware libraries. Time is virtual: millis() only advances
+// on delay(), so transcripts with timeouts run instantly and deterministically.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <deque>
+#include <functional>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
+
+#define HEX 16
+#define DEC 10
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define HIGH 0x1
+#define LOW 0x0
+#define SERIAL_8N1 0x800001c
+#define F(x) (x)
+
+class String
+{
+public:
+  String() {}
+  String(const char *s) : s_(s ? s : "") {}
+  String(const std::string &s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int v) : s_(std::to_string(v)) {}
+  String(unsigned int v) : s_(std::to_string(v)) {}
+  String(long v) : s_(std::to_string(v)) {}
+  String(unsigned long v) : s_(std::to_string(v)) {}
+  String(double v, int digits = 2) { char b[32]; snprintf(b, sizeof(b), "%.*f", digits, v); s_ = b; }
+
+  String operator+(const String &o) const { return String(s_ + o.s_); }
+  friend String operator+(const char *a, const String &b) { return String(a) + b; }
+  String &operator+=(const String &o) { s_ += o.s_; return *this; }
+  bool operator==(const char *o) const { return s_ == o; }
+  bool operator==(const String &o) const { return s_ == o.s_; }
+  unsigned int length() const { return s_.size(); }
+  const char *c_str() const { return s_.c_str(); }
+  void toCharArray(char *buf, unsigned int size) const
+  {
+    if (size == 0)
+      return;
+    size_t n = s_.size() < size - 1 ? s_.size() : size - 1;
+    memcpy(buf, s_.data(), n);
+    buf[n] = '\0';
+  }
+
+private:
+  std::string s_;
+};
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t len)
+  {
+    for (size_t i = 0; i < len; i++)
+      write(buf[i]);
+    return len;
+  }
+  size_t write(const char *buf, size_t len) { return write((const uint8_t *)buf, len); }
+
+  size_t print(const char *s) { return write(s, strlen(s)); }
+  size_t print(const String &s) { return write(s.c_str(), s.length()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC) { return printNumber(base == HEX ? "%lX" : "%ld", v); }
+  size_t print(unsigned long v, int base = DEC) { return printNumber(base == HEX ? "%lX" : "%lu", v); }
+  size_t print(double v, int digits = 2) { return print(String(v, digits)); }
+
+  size_t println() { return print("\r\n"); }
+  template <typename T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+  template <typename T> size_t println(const T &v, int base) { size_t n = print(v, base); return n + println(); }
+
+  size_t printf(const char *format, ...)
+  {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    return n > 0 ? write(buf, strlen(buf)) : 0;
+  }
+
+private:
+  template <typename T> size_t printNumber(const char *format, T v)
+  {
+    char buf[24];
+    snprintf(buf, sizeof(buf), format, v);
+    return print(buf);
+  }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  size_t readBytes(char *buf, size_t len)
+  {
+    size_t n = 0;
+    while (n < len && available())
+      buf[n++] = (char)read();
+    return n;
+  }
+  size_t readBytes(uint8_t *buf, size_t len) { return readBytes((char *)buf, len); }
+  void setTimeout(unsigned long) {}
+};
+
+/**
+ * Serial port whose received bytes are injected by test and whose written bytes are captured.
+ * Hook is called after every write, so a scripted peer can answer as soon as command is complete.
+ */
+class HardwareSerial : public Stream
+{
+public:
+  std::deque<uint8_t> rx;
+  std::string tx;
+  std::function<void(HardwareSerial &)> on_write;
+
+  void begin(unsigned long, uint32_t = SERIAL_8N1, int8_t = -1, int8_t = -1) {}
+  void end() {}
+  size_t setRxBufferSize(size_t size) { return size; }
+  void flush() {}
+
+  int available() override { return (int)rx.size(); }
+  int read() override
+  {
+    if (rx.empty())
+      return -1;
+    uint8_t c = rx.front();
+    rx.pop_front();
+    return c;
+  }
+
+  using Print::write;
+  size_t write(uint8_t c) override
+  {
+    tx.push_back((char)c);
+    if (on_write)
+      on_write(*this);
+    return 1;
+  }
+  size_t write(const uint8_t *buf, size_t len) override
+  {
+    tx.append((const char *)buf, len);
+    if (on_write)
+      on_write(*this);
+    return len;
+  }
+
+  /**
+   * Function that injects bytes as if they were received on the line
+   * @param data - Received bytes
+   * @param len - Number of bytes
+   */
+  void inject(const void *data, size_t len)
+  {
+    rx.insert(rx.end(), (const uint8_t *)data, (const uint8_t *)data + len);
+  }
+  void inject(const std::string &data) { inject(data.data(), data.size()); }
+
+  void reset()
+  {
+    rx.clear();
+    tx.clear();
+    on_write = nullptr;
+  }
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+/// Hook called on every delay() after time is advanced, scripted peers use it to deliver delayed bytes
+extern std::function<void(unsigned long)> HOST_delayHook;
+
+/**
+ * Function that advances virtual time without calling delay hook
+ * @param ms - Number of milliseconds
+ */
+void HOST_advance(unsigned long ms);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef _HOST_BH1750FVI_H
+#define _HOST_BH1750FVI_H
+
+#include <Arduino.h>
+
+class BH1750FVI
+{
+public:
+  typedef enum { k_DevAddress_L = 0x23, k_DevAddress_H = 0x5C } eDeviceAddress_t;
+  typedef enum { k_DevModeContHighRes = 0x10 } eDeviceMode_t;
+
+  BH1750FVI(uint8_t pin, eDeviceAddress_t address, eDeviceMode_t mode) {}
+  void begin() {}
+  uint16_t GetLightIntensity() { return 0; }
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef _HOST_DALLAS_TEMPERATURE_H
+#define _HOST_DALLAS_TEMPERATURE_H
+
+// DS18B20 is not present on host, conversions complete at once and read 0 °C
+
+#include <Arduino.h>
+
+class OneWire
+{
+public:
+  OneWire(uint8_t pin) {}
+};
+
+class DallasTemperature
+{
+public:
+  DallasTemperature(OneWire *wire) {}
+  void begin() {}
+  bool setResolution(uint8_t resolution) { return true; }
+  void setWaitForConversion(bool wait) {}
+  void requestTemperatures() {}
+  int16_t millisToWaitForConversion(uint8_t resolution) { return 0; }
+  bool isConversionComplete() { return true; }
+  float getTempCByIndex(uint8_t index) { return 0; }
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _HOST_SPARKFUN_BME280_H
+#define _HOST_SPARKFUN_BME280_H
+
+#include <Arduino.h>
+
+class BME280
+{
+public:
+  void setI2CAddress(uint8_t address) {}
+  bool beginI2C() { return false; }
+  float readTempC() { return 0; }
+  float readFloatHumidity() { return 0; }
+  float readFloatPressure() { return 0; }
+};
+
+#endif
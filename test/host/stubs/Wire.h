@@ -0,0 +1,14 @@
+#ifndef _HOST_WIRE_H
+#define _HOST_WIRE_H
+
+#include <Arduino.h>
+
+class TwoWire
+{
+public:
+  bool begin() { return true; }
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _HOST_ZANSHIN_BME680_H
+#define _HOST_ZANSHIN_BME680_H
+
+#include <Arduino.h>
+
+#define I2C_STANDARD_MODE 100000
+
+enum sensorTypes { TemperatureSensor, HumiditySensor, PressureSensor, GasSensor };
+enum oversamplingTypes { SensorOff, Oversample1, Oversample2, Oversample4, Oversample8, Oversample16 };
+enum iirFilterTypes { IIROff, IIR2, IIR4, IIR8, IIR16, IIR32, IIR64, IIR128 };
+
+class BME680_Class
+{
+public:
+  bool begin(uint32_t speed) { return false; }
+  bool setOversampling(uint8_t sensor, uint8_t sampling) { return true; }
+  uint8_t setIIRFilter(uint8_t filter) { return filter; }
+  bool setGas(uint16_t temperature, uint16_t milliseconds) { return true; }
+  void getSensorData(int32_t &temp, int32_t &hum, int32_t &press, int32_t &gas)
+  {
+    temp = hum = press = gas = 0;
+  }
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef _HOST_DRIVER_UART_H
+#define _HOST_DRIVER_UART_H
+
+// ESP-IDF UART driver on host. Bytes written by firmware are passed to a peer callback, bytes sent by peer
+// arrive at line speed in virtual time and are reported as driver events: UART_DATA after every
+// HOST_UART_FIFO_THRESHOLD bytes and after rx timeout (idle line), like the ESP32 UART interrupt does.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+/// RX FIFO full threshold used by IDF driver
+#define HOST_UART_FIFO_THRESHOLD  120
+
+typedef int esp_err_t;
+#define ESP_OK 0
+
+typedef enum { UART_NUM_0, UART_NUM_1, UART_NUM_2 } uart_port_t;
+typedef enum { UART_DATA_8_BITS = 3 } uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE = 0 } uart_parity_t;
+typedef enum { UART_STOP_BITS_1 = 1 } uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE = 0 } uart_hw_flowcontrol_t;
+#define UART_PIN_NO_CHANGE (-1)
+
+typedef struct
+{
+  int baud_rate;
+  uart_word_length_t data_bits;
+  uart_parity_t parity;
+  uart_stop_bits_t stop_bits;
+  uart_hw_flowcontrol_t flow_ctrl;
+  uint8_t rx_flow_ctrl_thresh;
+} uart_config_t;
+
+typedef enum { UART_DATA, UART_BREAK, UART_BUFFER_FULL, UART_FIFO_OVF, UART_FRAME_ERR, UART_PARITY_ERR } uart_event_type_t;
+
+typedef struct
+{
+  uart_event_type_t type;
+  size_t size;
+  bool timeout_flag;
+} uart_event_t;
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *queue, int intr_flags);
+esp_err_t uart_driver_delete(uart_port_t port);
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config);
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t tout);
+esp_err_t uart_flush_input(uart_port_t port);
+int uart_write_bytes(uart_port_t port, const char *data, size_t size);
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks);
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks);
+
+/// Peer that receives frame written by firmware, end_us is virtual time when the last bit left the line
+typedef std::function<void(const uint8_t *data, size_t len, uint64_t end_us)> HOST_uartPeer;
+
+/**
+ * Function that sets peer on the other side of the line
+ * @param peer - Callback called when firmware frame is completely sent
+ */
+void HOST_uartSetPeer(HOST_uartPeer peer);
+
+/**
+ * Function that sends frame from peer, first bit starts at given virtual time
+ * @param data - Frame
+ * @param len - Length of frame
+ * @param start_us - Virtual time of first bit
+ */
+void HOST_uartSend(const uint8_t *data, size_t len, uint64_t start_us);
+
+/**
+ * Function that returns duration of one character on the line
+ * @return Character time in microseconds
+ */
+double HOST_uartCharTime();
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef _HOST_ESP_TIMER_H
+#define _HOST_ESP_TIMER_H
+
+#include <Arduino.h>
+
+static inline int64_t esp_timer_get_time()
+{
+  return (int64_t)micros();
+}
+
+// host tests are single threaded
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux)  ((void)(mux))
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _HOST_FREERTOS_H
+#define _HOST_FREERTOS_H
+
+#include <stdint.h>
+
+// one tick is one millisecond, as on ESP32 Arduino
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define portMAX_DELAY       0xffffffffUL
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef _HOST_FREERTOS_QUEUE_H
+#define _HOST_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+// only UART event queue is used on host, it is implemented by UART model
+struct HOST_queue;
+typedef HOST_queue *QueueHandle_t;
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+#endif
@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <string.h>
+#include "mbedtls/md.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+
+// only SHA-256 digests are implemented, other primitives are not used by host tests and always fail
+#define HOST_MBEDTLS_UNSUPPORTED -0x0070
+
+#define SHA256_BLOCK_SIZE 64
+#define SHA256_SIZE       32
+
+struct mbedtls_md_info_t
+{
+  mbedtls_md_type_t type;
+};
+
+struct HOST_sha256
+{
+  uint32_t state[8];
+  uint8_t buffer[SHA256_BLOCK_SIZE];
+  uint64_t total;
+};
+
+uint64_t HOST_sha256Blocks = 0;
+
+static const mbedtls_md_info_t sha256_info = {MBEDTLS_MD_SHA256};
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr(uint32_t x, uint8_t n)
+{
+  return (x >> n) | (x << (32 - n));
+}
+
+/**
+ * Function that compresses one 64 byte block into hash state
+ * @param state - Hash state
+ * @param block - Message block
+ */
+static void sha256Compress(uint32_t state[8], const uint8_t *block)
+{
+  uint32_t w[64];
+  uint32_t v[8];
+
+  for (uint8_t i = 0; i < 16; i++)
+    w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+  for (uint8_t i = 16; i < 64; i++)
+  {
+    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  memcpy(v, state, sizeof(v));
+  for (uint8_t i = 0; i < 64; i++)
+  {
+    uint32_t t1 = v[7] + (rotr(v[4], 6) ^ rotr(v[4], 11) ^ rotr(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256_k[i] + w[i];
+    uint32_t t2 = (rotr(v[0], 2) ^ rotr(v[0], 13) ^ rotr(v[0], 22)) + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+    memmove(&v[1], &v[0], 7 * sizeof(uint32_t));
+    v[4] += t1;
+    v[0] = t1 + t2;
+  }
+  for (uint8_t i = 0; i < 8; i++)
+    state[i] += v[i];
+
+  HOST_sha256Blocks++;
+}
+
+static void sha256Starts(HOST_sha256 *sha)
+{
+  static const uint32_t initial[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+  };
+  memcpy(sha->state, initial, sizeof(initial));
+  sha->total = 0;
+}
+
+static void sha256Update(HOST_sha256 *sha, const uint8_t *input, size_t len)
+{
+  size_t fill = sha->total % SHA256_BLOCK_SIZE;
+
+  sha->total += len;
+  while (len > 0)
+  {
+    size_t n = SHA256_BLOCK_SIZE - fill < len ? SHA256_BLOCK_SIZE - fill : len;
+    memcpy(sha->buffer + fill, input, n);
+    fill += n;
+    input += n;
+    len -= n;
+    if (fill == SHA256_BLOCK_SIZE)
+    {
+      sha256Compress(sha->state, sha->buffer);
+      fill = 0;
+    }
+  }
+}
+
+static void sha256Finish(HOST_sha256 *sha, uint8_t *output)
+{
+  uint64_t bits = sha->total * 8;
+  uint8_t pad[SHA256_BLOCK_SIZE + 8] = {0x80};
+  size_t fill = sha->total % SHA256_BLOCK_SIZE;
+  size_t pad_len = (fill < 56 ? 56 : 120) - fill;
+
+  for (uint8_t i = 0; i < 8; i++)
+    pad[pad_len + i] = (uint8_t)(bits >> (56 - 8 * i));
+  sha256Update(sha, pad, pad_len + 8);
+
+  for (uint8_t i = 0; i < 8; i++)
+    for (uint8_t j = 0; j < 4; j++)
+      output[4 * i + j] = (uint8_t)(sha->state[i] >> (24 - 8 * j));
+}
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t md_type)
+{
+  return md_type == MBEDTLS_MD_SHA256 ? &sha256_info : NULL;
+}
+
+void mbedtls_md_init(mbedtls_md_context_t *ctx)
+{
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_md_free(mbedtls_md_context_t *ctx)
+{
+  if (ctx == NULL)
+    return;
+
+  free(ctx->md_ctx);
+  if (ctx->hmac_ctx != NULL)
+    memset(ctx->hmac_ctx, 0, 2 * SHA256_BLOCK_SIZE);
+  free(ctx->hmac_ctx);
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac)
+{
+  if (md_info == NULL || ctx == NULL)
+    return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+
+  // digest state and ipad/opad blocks are allocated on heap as in mbedtls
+  ctx->md_info = md_info;
+  ctx->md_ctx = calloc(1, sizeof(HOST_sha256));
+  if (ctx->md_ctx == NULL)
+    return MBEDTLS_ERR_MD_ALLOC_FAILED;
+
+  if (hmac)
+  {
+    ctx->hmac_ctx = calloc(2, SHA256_BLOCK_SIZE);
+    if (ctx->hmac_ctx == NULL)
+    {
+      mbedtls_md_free(ctx);
+      return MBEDTLS_ERR_MD_ALLOC_FAILED;
+    }
+  }
+  return 0;
+}
+
+int mbedtls_md_clone(mbedtls_md_context_t *dst, const mbedtls_md_context_t *src)
+{
+  if (dst == NULL || dst->md_info == NULL || src == NULL || src->md_info != dst->md_info)
+    return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+
+  memcpy(dst->md_ctx, src->md_ctx, sizeof(HOST_sha256));
+  return 0;
+}
+
+int mbedtls_md_starts(mbedtls_md_context_t *ctx)
+{
+  if (ctx == NULL || ctx->md_info == NULL)
+    return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+
+  sha256Starts((HOST_sha256 *)ctx->md_ctx);
+  return 0;
+}
+
+int mbedtls_md_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen)
+{
+  if (ctx == NULL || ctx->md_info == NULL)
+    return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+
+  sha256Update((HOST_sha256 *)ctx->md_ctx, input, ilen);
+  return 0;
+}
+
+int mbedtls_md_finish(mbedtls_md_context_t *ctx, unsigned char *output)
+{
+  if (ctx == NULL || ctx->md_info == NULL)
+    return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+
+  sha256Finish((HOST_sha256 *)ctx->md_ctx, output);
+  return 0;
+}
+
+int mbedtls_md(const mbedtls_md_info_t *md_info, const unsigned char *input, size_t ilen, unsigned char *output)
+{
+  HOST_sha256 sha;
+
+  if (md_info == NULL)
+    return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+
+  sha256Starts(&sha);
+  sha256Update(&sha, input, ilen);
+  sha256Finish(&sha, output);
+  return 0;
+}
+
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen)
+{
+  uint8_t sum[SHA256_SIZE];
+
+  if (ctx == NULL || ctx->md_info == NULL || ctx->hmac_ctx == NULL)
+    return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+
+  // key longer than block is replaced by its hash, padded key is hashed again for every message
+  if (keylen > SHA256_BLOCK_SIZE)
+  {
+    mbedtls_md(ctx->md_info, key, keylen, sum);
+    key = sum;
+    keylen = SHA256_SIZE;
+  }
+
+  uint8_t *ipad = (uint8_t *)ctx->hmac_ctx;
+  uint8_t *opad = ipad + SHA256_BLOCK_SIZE;
+  memset(ipad, 0x36, SHA256_BLOCK_SIZE);
+  memset(opad, 0x5c, SHA256_BLOCK_SIZE);
+  for (size_t i = 0; i < keylen; i++)
+  {
+    ipad[i] ^= key[i];
+    opad[i] ^= key[i];
+  }
+
+  sha256Starts((HOST_sha256 *)ctx->md_ctx);
+  sha256Update((HOST_sha256 *)ctx->md_ctx, ipad, SHA256_BLOCK_SIZE);
+  return 0;
+}
+
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen)
+{
+  if (ctx == NULL || ctx->md_info == NULL || ctx->hmac_ctx == NULL)
+    return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+
+  sha256Update((HOST_sha256 *)ctx->md_ctx, input, ilen);
+  return 0;
+}
+
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output)
+{
+  uint8_t inner[SHA256_SIZE];
+
+  if (ctx == NULL || ctx->md_info == NULL || ctx->hmac_ctx == NULL)
+    return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+
+  HOST_sha256 *sha = (HOST_sha256 *)ctx->md_ctx;
+  sha256Finish(sha, inner);
+  sha256Starts(sha);
+  sha256Update(sha, (uint8_t *)ctx->hmac_ctx + SHA256_BLOCK_SIZE, SHA256_BLOCK_SIZE);
+  sha256Update(sha, inner, SHA256_SIZE);
+  sha256Finish(sha, output);
+  return 0;
+}
+
+void mbedtls_aes_init(mbedtls_aes_context *ctx)
+{
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_aes_free(mbedtls_aes_context *ctx)
+{
+}
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
+
+int mbedtls_aes_setkey_dec(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
+
+int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx, int mode, size_t length, unsigned char iv[16],
+                          const unsigned char *input, unsigned char *output)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
+
+void mbedtls_entropy_init(mbedtls_entropy_context *ctx)
+{
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_entropy_func(void *data, unsigned char *output, size_t len)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context *ctx)
+{
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context *ctx, int (*f_entropy)(void *, unsigned char *, size_t),
+                          void *p_entropy, const unsigned char *custom, size_t len)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
+
+int mbedtls_ctr_drbg_random(void *p_rng, unsigned char *output, size_t output_len)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
+
+int mbedtls_mpi_lset(mbedtls_mpi *X, mbedtls_mpi_sint z)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
+
+int mbedtls_mpi_read_binary(mbedtls_mpi *X, const unsigned char *buf, size_t buflen)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
+
+int mbedtls_mpi_write_binary(const mbedtls_mpi *X, unsigned char *buf, size_t buflen)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
+
+int mbedtls_ecp_group_load(mbedtls_ecp_group *grp, mbedtls_ecp_group_id id)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
+
+void mbedtls_ecdh_init(mbedtls_ecdh_context *ctx)
+{
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_ecdh_gen_public(mbedtls_ecp_group *grp, mbedtls_mpi *d, mbedtls_ecp_point *Q,
+                            int (*f_rng)(void *, unsigned char *, size_t), void *p_rng)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
+
+int mbedtls_ecdh_compute_shared(mbedtls_ecp_group *grp, mbedtls_mpi *z, const mbedtls_ecp_point *Q, const mbedtls_mpi *d,
+                                int (*f_rng)(void *, unsigned char *, size_t), void *p_rng)
+{
+  return HOST_MBEDTLS_UNSUPPORTED;
+}
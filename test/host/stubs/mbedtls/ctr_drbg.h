@@ -0,0 +1,19 @@
+#ifndef _HOST_MBEDTLS_CTR_DRBG_H
+#define _HOST_MBEDTLS_CTR_DRBG_H
+
+// random generator is declared only so crypto_utils builds on host, it fails (stubs/mbedtls.cpp)
+
+#include "mbedtls/aes.h"
+
+typedef struct mbedtls_ctr_drbg_context
+{
+  unsigned char counter[16];
+  mbedtls_aes_context aes_ctx;
+} mbedtls_ctr_drbg_context;
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context *ctx);
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context *ctx, int (*f_entropy)(void *, unsigned char *, size_t),
+                          void *p_entropy, const unsigned char *custom, size_t len);
+int mbedtls_ctr_drbg_random(void *p_rng, unsigned char *output, size_t output_len);
+
+#endif
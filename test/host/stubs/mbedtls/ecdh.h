@@ -0,0 +1,67 @@
+#ifndef _HOST_MBEDTLS_ECDH_H
+#define _HOST_MBEDTLS_ECDH_H
+
+// ECDH with bignum and curve types is declared only so crypto_utils builds on host, functions fail
+// (stubs/mbedtls.cpp)
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int64_t mbedtls_mpi_sint;
+
+typedef struct mbedtls_mpi
+{
+  int s;
+  size_t n;
+  uint64_t *p;
+} mbedtls_mpi;
+
+typedef enum {
+  MBEDTLS_ECP_DP_NONE = 0,
+  MBEDTLS_ECP_DP_SECP192R1,
+  MBEDTLS_ECP_DP_SECP224R1,
+  MBEDTLS_ECP_DP_SECP256R1,
+  MBEDTLS_ECP_DP_SECP384R1,
+  MBEDTLS_ECP_DP_SECP521R1,
+  MBEDTLS_ECP_DP_BP256R1,
+  MBEDTLS_ECP_DP_BP384R1,
+  MBEDTLS_ECP_DP_BP512R1,
+  MBEDTLS_ECP_DP_CURVE25519,
+  MBEDTLS_ECP_DP_SECP192K1,
+  MBEDTLS_ECP_DP_SECP224K1,
+  MBEDTLS_ECP_DP_SECP256K1,
+  MBEDTLS_ECP_DP_CURVE448,
+} mbedtls_ecp_group_id;
+
+typedef struct mbedtls_ecp_point
+{
+  mbedtls_mpi X;
+  mbedtls_mpi Y;
+  mbedtls_mpi Z;
+} mbedtls_ecp_point;
+
+typedef struct mbedtls_ecp_group
+{
+  mbedtls_ecp_group_id id;
+} mbedtls_ecp_group;
+
+typedef struct mbedtls_ecdh_context
+{
+  mbedtls_ecp_group grp;
+  mbedtls_mpi d;
+  mbedtls_ecp_point Q;
+  mbedtls_ecp_point Qp;
+  mbedtls_mpi z;
+} mbedtls_ecdh_context;
+
+int mbedtls_mpi_lset(mbedtls_mpi *X, mbedtls_mpi_sint z);
+int mbedtls_mpi_read_binary(mbedtls_mpi *X, const unsigned char *buf, size_t buflen);
+int mbedtls_mpi_write_binary(const mbedtls_mpi *X, unsigned char *buf, size_t buflen);
+int mbedtls_ecp_group_load(mbedtls_ecp_group *grp, mbedtls_ecp_group_id id);
+void mbedtls_ecdh_init(mbedtls_ecdh_context *ctx);
+int mbedtls_ecdh_gen_public(mbedtls_ecp_group *grp, mbedtls_mpi *d, mbedtls_ecp_point *Q,
+                            int (*f_rng)(void *, unsigned char *, size_t), void *p_rng);
+int mbedtls_ecdh_compute_shared(mbedtls_ecp_group *grp, mbedtls_mpi *z, const mbedtls_ecp_point *Q, const mbedtls_mpi *d,
+                                int (*f_rng)(void *, unsigned char *, size_t), void *p_rng);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _HOST_MBEDTLS_ENTROPY_H
+#define _HOST_MBEDTLS_ENTROPY_H
+
+// entropy source is declared only so crypto_utils builds on host, it fails (stubs/mbedtls.cpp)
+
+#include <stddef.h>
+
+typedef struct mbedtls_entropy_context
+{
+  int source_count;
+} mbedtls_entropy_context;
+
+void mbedtls_entropy_init(mbedtls_entropy_context *ctx);
+int mbedtls_entropy_func(void *data, unsigned char *output, size_t len);
+
+#endif
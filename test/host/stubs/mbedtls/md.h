@@ -0,0 +1,52 @@
+#ifndef _HOST_MBEDTLS_MD_H
+#define _HOST_MBEDTLS_MD_H
+
+// Message digest API of mbedtls 2.x (as in ESP-IDF) with SHA-256 only, implemented in stubs/mbedtls.cpp.
+// Number of compressed SHA-256 blocks is counted, it is what hardware accelerator spends time on.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_ERR_MD_FEATURE_UNAVAILABLE -0x5080
+#define MBEDTLS_ERR_MD_BAD_INPUT_DATA      -0x5100
+#define MBEDTLS_ERR_MD_ALLOC_FAILED        -0x5180
+
+typedef enum {
+  MBEDTLS_MD_NONE = 0,
+  MBEDTLS_MD_MD2,
+  MBEDTLS_MD_MD4,
+  MBEDTLS_MD_MD5,
+  MBEDTLS_MD_SHA1,
+  MBEDTLS_MD_SHA224,
+  MBEDTLS_MD_SHA256,
+  MBEDTLS_MD_SHA384,
+  MBEDTLS_MD_SHA512,
+  MBEDTLS_MD_RIPEMD160,
+} mbedtls_md_type_t;
+
+typedef struct mbedtls_md_info_t mbedtls_md_info_t;
+
+typedef struct mbedtls_md_context_t
+{
+  const mbedtls_md_info_t *md_info;
+  void *md_ctx;
+  void *hmac_ctx;
+} mbedtls_md_context_t;
+
+/// Number of SHA-256 blocks compressed since start of test program
+extern uint64_t HOST_sha256Blocks;
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t md_type);
+void mbedtls_md_init(mbedtls_md_context_t *ctx);
+void mbedtls_md_free(mbedtls_md_context_t *ctx);
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac);
+int mbedtls_md_clone(mbedtls_md_context_t *dst, const mbedtls_md_context_t *src);
+int mbedtls_md_starts(mbedtls_md_context_t *ctx);
+int mbedtls_md_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen);
+int mbedtls_md_finish(mbedtls_md_context_t *ctx, unsigned char *output);
+int mbedtls_md(const mbedtls_md_info_t *md_info, const unsigned char *input, size_t ilen, unsigned char *output);
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen);
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen);
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output);
+
+#endif
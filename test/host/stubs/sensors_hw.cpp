@@ -0,0 +1,40 @@
+#include <Arduino.h>
+#include <Wire.h>
+#include <ulp_sampler.h>
+
+// sensors are read only through descriptors on host, peripherals report nothing
+
+TwoWire Wire;
+
+bool ULPS_start(uint32_t period_ms, uint8_t batch_size, uint16_t threshold)
+{
+  return false;
+}
+
+bool ULPS_isRunning()
+{
+  return false;
+}
+
+uint16_t ULPS_getLast()
+{
+  return 0;
+}
+
+uint8_t ULPS_getHistory(uint16_t *values, uint8_t max_count)
+{
+  return 0;
+}
+
+uint8_t ULPS_getWakeReason()
+{
+  return ULPS_WAKE_NONE;
+}
+
+void ULPS_rearm(uint16_t reference)
+{
+}
+
+void ULPS_enableWakeup()
+{
+}
@@ -0,0 +1,187 @@
+#include <Arduino.h>
+#include <deque>
+#include <vector>
+#include "driver/uart.h"
+
+struct HOST_queue
+{
+  int port;
+};
+
+/// Event that becomes visible to firmware at given virtual time, its bytes are moved to driver buffer then
+struct HOST_uartEvent
+{
+  uint64_t time;
+  uart_event_t event;
+  std::vector<uint8_t> data;
+};
+
+static HOST_queue uart_queue;
+static std::deque<HOST_uartEvent> uart_events;
+static std::deque<uint8_t> uart_rx_buffer;
+static int uart_baudrate = 115200;
+static uint8_t uart_rx_tout = 10;
+static uint64_t uart_tx_end = 0;
+static HOST_uartPeer uart_peer;
+
+/**
+ * Function that advances virtual time to given moment, time never goes back
+ * @param time - Virtual time in microseconds
+ */
+static void advanceTo(uint64_t time)
+{
+  uint64_t now = micros();
+  if (time > now)
+    delayMicroseconds((unsigned int)(time - now));
+}
+
+/**
+ * Function that drops events that already arrived, later events are still on the line
+ */
+static void dropArrivedEvents()
+{
+  uint64_t now = micros();
+  while (!uart_events.empty() && uart_events.front().time <= now)
+    uart_events.pop_front();
+}
+
+double HOST_uartCharTime()
+{
+  return 10e6 / uart_baudrate;
+}
+
+void HOST_uartSetPeer(HOST_uartPeer peer)
+{
+  uart_peer = peer;
+}
+
+void HOST_uartSend(const uint8_t *data, size_t len, uint64_t start_us)
+{
+  double char_time = HOST_uartCharTime();
+  size_t pos = 0;
+
+  while (pos < len)
+  {
+    HOST_uartEvent ev;
+    size_t chunk = len - pos;
+
+    if (chunk >= HOST_UART_FIFO_THRESHOLD)
+    {
+      // FIFO full interrupt, more bytes follow
+      chunk = HOST_UART_FIFO_THRESHOLD;
+      ev.time = start_us + (uint64_t)((pos + chunk) * char_time);
+      ev.event.timeout_flag = false;
+    }
+    else
+    {
+      // rx timeout interrupt after idle line
+      ev.time = start_us + (uint64_t)((pos + chunk + uart_rx_tout) * char_time);
+      ev.event.timeout_flag = true;
+    }
+    ev.event.type = UART_DATA;
+    ev.event.size = chunk;
+    ev.data.assign(data + pos, data + pos + chunk);
+    pos += chunk;
+
+    auto it = uart_events.begin();
+    while (it != uart_events.end() && it->time <= ev.time)
+      ++it;
+    uart_events.insert(it, ev);
+  }
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *queue, int intr_flags)
+{
+  uart_queue.port = port;
+  uart_events.clear();
+  uart_rx_buffer.clear();
+  uart_tx_end = 0;
+  *queue = &uart_queue;
+  return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t port)
+{
+  uart_events.clear();
+  uart_rx_buffer.clear();
+  return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+  uart_baudrate = config->baud_rate;
+  return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+  return ESP_OK;
+}
+
+esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t tout)
+{
+  uart_rx_tout = tout;
+  return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+  uart_rx_buffer.clear();
+  dropArrivedEvents();
+  return ESP_OK;
+}
+
+int uart_write_bytes(uart_port_t port, const char *data, size_t size)
+{
+  uint64_t now = micros();
+  uint64_t start = (uart_tx_end > now) ? uart_tx_end : now;
+
+  uart_tx_end = start + (uint64_t)(size * HOST_uartCharTime());
+  if (uart_peer)
+    uart_peer((const uint8_t *)data, size, uart_tx_end);
+  return (int)size;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks)
+{
+  advanceTo(uart_tx_end);
+  return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks)
+{
+  uint32_t n = 0;
+  while (n < length && !uart_rx_buffer.empty())
+  {
+    ((uint8_t *)buf)[n++] = uart_rx_buffer.front();
+    uart_rx_buffer.pop_front();
+  }
+  return (int)n;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+  uint64_t now = micros();
+  uint64_t deadline = (ticks == portMAX_DELAY) ? UINT64_MAX : now + (uint64_t)ticks * 1000;
+
+  if (!uart_events.empty() && uart_events.front().time <= deadline)
+  {
+    HOST_uartEvent ev = uart_events.front();
+    uart_events.pop_front();
+    advanceTo(ev.time);
+    uart_rx_buffer.insert(uart_rx_buffer.end(), ev.data.begin(), ev.data.end());
+    *(uart_event_t *)item = ev.event;
+    return pdTRUE;
+  }
+
+  // nothing will ever arrive, host test must not hang
+  if (deadline != UINT64_MAX)
+    advanceTo(deadline);
+  return pdFALSE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+  dropArrivedEvents();
+  return pdTRUE;
+}
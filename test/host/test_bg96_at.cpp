@@ -0,0 +1,213 @@
+// Transcript tests of BG96 AT command engine. Scripted modem answers each command as soon as
+// it is completely written, replies can contain URCs and binary payload.
+
+#include <BG96.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "host_test.h"
+
+/// Scripted modem on NBIOT UART, each step is (expected bytes written by engine, bytes sent back)
+struct Transcript
+{
+  std::vector<std::pair<std::string, std::string>> steps;
+  size_t next = 0;
+
+  Transcript(std::initializer_list<std::pair<std::string, std::string>> s) : steps(s)
+  {
+    Serial2.reset();
+    Serial2.on_write = [this](HardwareSerial &port) {
+      while (next < steps.size() && port.tx.size() >= steps[next].first.size() &&
+             port.tx.compare(port.tx.size() - steps[next].first.size(), std::string::npos, steps[next].first) == 0)
+      {
+        port.tx.clear();
+        port.inject(steps[next].second);
+        next++;
+      }
+    };
+  }
+  ~Transcript() { Serial2.reset(); }
+
+  bool done() const { return next == steps.size(); }
+};
+
+static const std::string OPEN_UDP = "AT+QIOPEN=1,2,\"UDP SERVICE\",\"127.0.0.1\",0,3030,0\r\n";
+static const std::string STATE_UDP = "AT+QISTATE=0,1\r\n";
+
+TEST(open_socket_completes_on_expected_urc)
+{
+  Transcript t({
+    {OPEN_UDP, "\r\nOK\r\n\r\n+QIOPEN: 2,0\r\n"},
+    {STATE_UDP, "\r\n+QISTATE: 2,\"UDP SERVICE\",\"127.0.0.1\",0,3030,2,1,2,0,\"uart1\"\r\n\r\nOK\r\n"},
+  });
+  unsigned long t0 = millis();
+
+  CHECK(BG96_OpenSocketUDP());
+  CHECK(t.done());
+  CHECK(BG96_ATwaitIdle(0));
+  // command returns as soon as response arrives, no fixed delays
+  CHECK(millis() - t0 < 10);
+}
+
+TEST(error_result_code_fails_command_immediately)
+{
+  Transcript t({
+    {OPEN_UDP, "\r\n+CME ERROR: 563\r\n"},
+  });
+  unsigned long t0 = millis();
+
+  CHECK(!BG96_OpenSocketUDP());
+  CHECK(t.done());
+  CHECK(millis() - t0 < 10);
+}
+
+TEST(missing_response_times_out)
+{
+  Transcript t({
+    {OPEN_UDP, "\r\nOK\r\n"},
+  });
+  unsigned long t0 = millis();
+
+  CHECK(!BG96_OpenSocketUDP());
+  CHECK(millis() - t0 >= 5000);
+  CHECK(BG96_ATwaitIdle(0));
+}
+
+static std::vector<int> completions;
+
+static void recordCompletion(bool success, char *response, uint16_t response_len, void *arg)
+{
+  completions.push_back(success ? (int)(intptr_t)arg : -(int)(intptr_t)arg);
+}
+
+TEST(queued_commands_are_sent_one_at_a_time)
+{
+  char r1[64], r2[64];
+  Transcript t({
+    {"AT+CSQ\r\n", "\r\n+CSQ: 20,99\r\n\r\nOK\r\n"},
+    {"AT+CEREG?\r\n", "\r\n+CEREG: 0,1\r\n\r\nOK\r\n"},
+  });
+  completions.clear();
+
+  CHECK(BG96_ATsubmit("AT+CSQ\r\n", "OK", r1, sizeof(r1), 1000, recordCompletion, (void *)1));
+  CHECK(BG96_ATsubmit("AT+CEREG?\r\n", "OK", r2, sizeof(r2), 1000, recordCompletion, (void *)2));
+  // second command is written only after the first one completes
+  CHECK_EQ(t.next, 1);
+
+  CHECK(BG96_ATwaitIdle(1000));
+  CHECK(t.done());
+  CHECK_EQ(completions.size(), 2);
+  CHECK_EQ(completions[0], 1);
+  CHECK_EQ(completions[1], 2);
+  CHECK(strstr(r1, "+CSQ: 20,99") != NULL);
+  CHECK(strstr(r2, "+CEREG: 0,1") != NULL);
+}
+
+TEST(queue_rejects_commands_when_full)
+{
+  Transcript t({});
+  uint8_t queued = 0;
+
+  while (BG96_ATsubmit("AT\r\n", "OK", NULL, 0, 100, NULL, NULL))
+    queued++;
+  CHECK_EQ(queued, BG96_AT_QUEUE_SIZE);
+
+  // every command times out in turn
+  CHECK(BG96_ATwaitIdle(100 * BG96_AT_QUEUE_SIZE + 10));
+}
+
+TEST(send_writes_payload_after_prompt)
+{
+  uint8_t payload[] = {0x00, 0x0d, 0x0a, 'O', 'K', 0x0d, 0x0a, 0xff};
+  Transcript t({
+    {OPEN_UDP, "\r\nOK\r\n\r\n+QIOPEN: 2,0\r\n"},
+    {STATE_UDP, "\r\nOK\r\n"},
+    {"AT+QISEND=2,8,\"10.0.0.1\",2345\r\n", "\r\n> "},
+    {std::string((char *)payload, sizeof(payload)), "\r\nSEND OK\r\n\r\n+QIURC: \"recv\",2\r\n"},
+  });
+
+  CHECK(BG96_OpenSocketUDP());
+  CHECK(BG96_SendUDP((char *)"10.0.0.1", 2345, payload, sizeof(payload)));
+  CHECK(t.done());
+  CHECK(BG96_waitForRecv(BG96_UDP_CONNECT_ID, 1000));
+  CHECK(BG96_ATwaitIdle(0));
+}
+
+TEST(send_fail_stops_waiting_for_response)
+{
+  uint8_t payload[] = {1, 2, 3};
+  Transcript t({
+    {OPEN_UDP, "\r\nOK\r\n\r\n+QIOPEN: 2,0\r\n"},
+    {STATE_UDP, "\r\nOK\r\n"},
+    {"AT+QISEND=2,3,\"10.0.0.1\",2345\r\n", "\r\n> "},
+    {std::string((char *)payload, sizeof(payload)), "\r\nSEND FAIL\r\n"},
+  });
+  unsigned long t0 = millis();
+
+  CHECK(BG96_OpenSocketUDP());
+  BG96_SendUDP((char *)"10.0.0.1", 2345, payload, sizeof(payload));
+  CHECK(!BG96_waitForRecv(BG96_UDP_CONNECT_ID, 10000));
+  CHECK(millis() - t0 < 10);
+}
+
+TEST(urc_inside_response_is_dispatched)
+{
+  Transcript t({
+    {OPEN_UDP, "\r\nOK\r\n\r\n+QIURC: \"recv\",2\r\n\r\n+QIOPEN: 2,0\r\n"},
+    {STATE_UDP, "\r\nOK\r\n"},
+  });
+
+  CHECK(BG96_OpenSocketUDP());
+  // counter is cleared before open, so only the URC received during open is counted
+  CHECK(BG96_waitForRecv(BG96_UDP_CONNECT_ID, 0));
+  CHECK(!BG96_waitForRecv(BG96_UDP_CONNECT_ID, 0));
+}
+
+TEST(read_streams_binary_payload)
+{
+  const char payload[] = "\r\nOK\r\n\0\"ERROR\r\n";
+  std::string data(payload, sizeof(payload) - 1);
+  uint8_t output[64];
+  uint16_t output_len = sizeof(output);
+  Transcript t({
+    {"AT+QIRD=2\r\n", "\r\n+QIRD: " + std::to_string(data.size()) + ",\"10.0.0.1\",2345\r\n" + data + "\r\n\r\nOK\r\n"},
+  });
+
+  CHECK(BG96_RecvUDP(output, &output_len));
+  CHECK(t.done());
+  CHECK_EQ(output_len, data.size());
+  CHECK(memcmp(output, data.data(), data.size()) == 0);
+}
+
+TEST(read_discards_payload_above_buffer)
+{
+  std::string data = "0123456789";
+  uint8_t output[4];
+  uint16_t output_len = sizeof(output);
+  Transcript t({
+    {"AT+QIRD=2\r\n", "\r\n+QIRD: 10,\"10.0.0.1\",2345\r\n" + data + "\r\n\r\nOK\r\n"},
+  });
+
+  CHECK(BG96_RecvUDP(output, &output_len));
+  CHECK_EQ(output_len, sizeof(output));
+  CHECK(memcmp(output, "0123", 4) == 0);
+  CHECK(BG96_ATwaitIdle(0));
+}
+
+TEST(expected_response_after_long_line_is_matched)
+{
+  char response[32];
+  std::string noise(3 * BG96_AT_LINE_SIZE, 'x');
+  Transcript t({
+    {"AT+QGMR\r\n", "\r\n" + noise + "OK\r\n"},
+  });
+
+  CHECK(BG96_ATsubmit("AT+QGMR\r\n", "OK", response, sizeof(response), 1000, NULL, NULL));
+  CHECK(BG96_ATwaitIdle(10));
+  CHECK(t.done());
+}
+
+int main()
+{
+  return HOST_runTests();
+}
@@ -0,0 +1,132 @@
+// Fuzz test of BG96 raw payload streaming. Random binary payloads (biased towards quotes, line
+// endings and result codes) are delivered in random chunks, one chunk per delay() of the engine,
+// and must be received complete and unchanged.
+
+#include <BG96.h>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "host_test.h"
+
+#define FUZZ_ITERATIONS 500
+#define FUZZ_SEED       0x5eed
+
+static std::mt19937 rng(FUZZ_SEED);
+
+// pending bytes delivered in chunks while engine waits
+static std::string pending;
+
+static uint32_t randomRange(uint32_t min, uint32_t max)
+{
+  return std::uniform_int_distribution<uint32_t>(min, max)(rng);
+}
+
+static std::string randomPayload(uint16_t len)
+{
+  static const char special[] = "\"\r\nOK,ERROR+QMTRECV: ";
+  std::string payload;
+
+  for (uint16_t i = 0; i < len; i++)
+  {
+    if (randomRange(0, 3) == 0)
+      payload.push_back(special[randomRange(0, sizeof(special) - 2)]);
+    else
+      payload.push_back((char)randomRange(0, 255));
+  }
+  return payload;
+}
+
+static void deliverChunk(unsigned long ms)
+{
+  if (pending.empty())
+    return;
+  size_t n = randomRange(1, 64);
+  if (n > pending.size())
+    n = pending.size();
+  Serial2.inject(pending.substr(0, n));
+  pending.erase(0, n);
+}
+
+// scripted replies, each one is queued for chunked delivery when its command is written
+static std::vector<std::pair<std::string, std::string>> script;
+
+static void expectCommands(const std::vector<std::pair<std::string, std::string>> &steps)
+{
+  script = steps;
+  Serial2.on_write = [](HardwareSerial &port) {
+    const std::string &command = script.front().first;
+    if (port.tx.size() >= command.size() && port.tx.compare(port.tx.size() - command.size(), std::string::npos, command) == 0)
+    {
+      port.tx.clear();
+      pending += script.front().second;
+      script.erase(script.begin());
+      if (script.empty())
+        port.on_write = nullptr;
+    }
+  };
+}
+
+TEST(mqtt_payload_is_complete_when_collected)
+{
+  HOST_delayHook = deliverChunk;
+  Serial2.reset();
+  expectCommands({
+    {"AT+QMTCFG=\"recv/mode\",0,0,1\r\n", "\r\nOK\r\n"},
+    {"AT+QMTOPEN=0,\"10.0.0.1\",1883\r\n", "\r\nOK\r\n\r\n+QMTOPEN: 0,0\r\n"},
+    {"AT+QMTCONN=0,\"id\"\r\n", "\r\nOK\r\n\r\n+QMTCONN: 0,0,0\r\n"},
+  });
+  CHECK(BG96_MQTTconnect((char *)"id", (char *)"10.0.0.1", 1883));
+
+  for (int i = 0; i < FUZZ_ITERATIONS; i++)
+  {
+    std::string payload = randomPayload(randomRange(1, BG96_MQTT_RX_SIZE));
+    pending += "\r\n+QMTRECV: 0," + std::to_string(i + 1) + ",\"down/topic\"," + std::to_string(payload.size()) + ",\"" + payload + "\"\r\n";
+
+    uint8_t output[BG96_MQTT_RX_SIZE];
+    uint16_t output_len = sizeof(output);
+    CHECK(BG96_MQTTcollectData(output, &output_len, 5000));
+    CHECK_EQ(output_len, payload.size());
+    CHECK(memcmp(output, payload.data(), payload.size()) == 0);
+
+    // rest of URC line is consumed before next message
+    while (!pending.empty() || Serial2.available())
+    {
+      BG96_ATprocess();
+      delay(1);
+    }
+  }
+
+  HOST_delayHook = nullptr;
+  Serial2.reset();
+}
+
+TEST(read_payload_is_complete_when_command_completes)
+{
+  HOST_delayHook = deliverChunk;
+  Serial2.reset();
+
+  for (int i = 0; i < FUZZ_ITERATIONS; i++)
+  {
+    std::string payload = randomPayload(randomRange(1, BG96_MAX_RECV_LENGTH));
+    expectCommands({{"AT+QIRD=2\r\n", "\r\n+QIRD: " + std::to_string(payload.size()) + ",\"10.0.0.1\",2345\r\n" + payload + "\r\n\r\nOK\r\n"}});
+
+    uint8_t output[BG96_MAX_RECV_LENGTH];
+    uint16_t output_len = sizeof(output);
+    CHECK(BG96_RecvUDP(output, &output_len));
+    CHECK_EQ(output_len, payload.size());
+    CHECK(memcmp(output, payload.data(), payload.size()) == 0);
+    // command completes on OK, only the line ending can be left
+    CHECK(pending.size() <= 2);
+    pending.clear();
+    Serial2.rx.clear();
+  }
+
+  HOST_delayHook = nullptr;
+  Serial2.reset();
+}
+
+int main()
+{
+  return HOST_runTests();
+}
@@ -0,0 +1,188 @@
+// HMAC_SHA256 with precomputed key states against one-shot HMAC of Crypto_Digest. RFC 4231 vectors and
+// random keys and messages have to give the same digest. Cost per packet of both is reported as number
+// of compressed SHA-256 blocks (work of hardware accelerator on ESP32) and as host time.
+
+#include <Arduino.h>
+#include <crypto_utils.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "host_test.h"
+
+#define TEST_SEED        0x4D4C
+#define BENCH_ITERATIONS 20000
+
+static std::mt19937 rng(TEST_SEED);
+
+/// RFC 4231 test case, truncated output case 5 is left out
+struct HmacVector
+{
+  std::vector<uint8_t> key;
+  std::string data;
+  const char *hmac;
+};
+
+static std::string toHex(const uint8_t *data, size_t size)
+{
+  std::string hex;
+  char b[3];
+
+  for (size_t i = 0; i < size; i++)
+  {
+    snprintf(b, sizeof(b), "%02x", data[i]);
+    hex += b;
+  }
+  return hex;
+}
+
+static std::vector<uint8_t> randomBytes(size_t size)
+{
+  std::vector<uint8_t> bytes(size);
+  for (uint8_t &b : bytes)
+    b = (uint8_t)rng();
+  return bytes;
+}
+
+/**
+ * Function that computes one-shot HMAC, key is hashed with every message
+ * @param key - Key
+ * @param data - Message
+ * @param output - Digest (32 bytes)
+ * @return Returns true on success
+ */
+static bool oneShotHmac(std::vector<uint8_t> &key, std::vector<uint8_t> &data, uint8_t *output)
+{
+  mbedtls_md_context_t ctx;
+  return Crypto_Digest(&ctx, HMAC_SHA256, data.data(), data.size(), output, key.data(), key.size());
+}
+
+TEST(precomputed_key_matches_rfc4231_vectors)
+{
+  std::vector<uint8_t> key4;
+  for (uint8_t i = 1; i <= 25; i++)
+    key4.push_back(i);
+
+  const HmacVector vectors[] = {
+    {std::vector<uint8_t>(20, 0x0b), "Hi There",
+     "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7"},
+    {{'J', 'e', 'f', 'e'}, "what do ya want for nothing?",
+     "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843"},
+    {std::vector<uint8_t>(20, 0xaa), std::string(50, '\xdd'),
+     "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe"},
+    {key4, std::string(50, '\xcd'),
+     "82558a389a443c0ea4cc819899f2083a85f0faa3e578f8077a2e3ff46729665b"},
+    {std::vector<uint8_t>(131, 0xaa), "Test Using Larger Than Block-Size Key - Hash Key First",
+     "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54"},
+    {std::vector<uint8_t>(131, 0xaa),
+     "This is a test using a larger than block-size key and a larger than block-size data. "
+     "The key needs to be hashed before being used by the HMAC algorithm.",
+     "9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2"},
+  };
+
+  Crypto_HMACKey hkey = {};
+  for (const HmacVector &v : vectors)
+  {
+    std::vector<uint8_t> key = v.key;
+    std::vector<uint8_t> data(v.data.begin(), v.data.end());
+    uint8_t precomputed[CRYPTO_SHA256_SIZE], one_shot[CRYPTO_SHA256_SIZE];
+
+    CHECK(Crypto_HMACSetKey(&hkey, key.data(), key.size()));
+    CHECK(Crypto_HMAC(&hkey, data.data(), data.size(), precomputed));
+    CHECK(oneShotHmac(key, data, one_shot));
+
+    CHECK(toHex(precomputed, sizeof(precomputed)) == v.hmac);
+    CHECK(toHex(one_shot, sizeof(one_shot)) == v.hmac);
+  }
+  Crypto_HMACFree(&hkey);
+  CHECK(!hkey.ready);
+}
+
+TEST(precomputed_key_matches_one_shot_on_random_packets)
+{
+  const size_t key_sizes[] = {0, 1, 16, 32, 63, 64, 65, 200};
+  Crypto_HMACKey hkey = {};
+
+  for (size_t key_size : key_sizes)
+  {
+    std::vector<uint8_t> key = randomBytes(key_size);
+    CHECK(Crypto_HMACSetKey(&hkey, key.data(), key.size()));
+
+    // the same prepared key is reused for many packets, states must not change between them
+    for (size_t size = 0; size <= 300; size += 13)
+    {
+      std::vector<uint8_t> data = randomBytes(size);
+      uint8_t precomputed[CRYPTO_SHA256_SIZE], one_shot[CRYPTO_SHA256_SIZE];
+
+      CHECK(Crypto_HMAC(&hkey, data.data(), data.size(), precomputed));
+      CHECK(oneShotHmac(key, data, one_shot));
+      CHECK(memcmp(precomputed, one_shot, CRYPTO_SHA256_SIZE) == 0);
+    }
+  }
+  Crypto_HMACFree(&hkey);
+}
+
+TEST(hmac_without_key_fails)
+{
+  Crypto_HMACKey hkey = {};
+  uint8_t data[4] = {1, 2, 3, 4};
+  uint8_t output[CRYPTO_SHA256_SIZE];
+
+  CHECK(!Crypto_HMAC(&hkey, data, sizeof(data), output));
+  // freeing key that was never set or freed twice is allowed
+  Crypto_HMACFree(&hkey);
+  Crypto_HMACFree(&hkey);
+}
+
+TEST(per_packet_cost_before_and_after)
+{
+  // packet MAC of local link, handshake message and large server payload
+  const size_t sizes[] = {16, 64, 256};
+  std::vector<uint8_t> key = randomBytes(32);
+  Crypto_HMACKey hkey = {};
+  uint8_t output[CRYPTO_SHA256_SIZE];
+  uint32_t sink = 0;
+
+  CHECK(Crypto_HMACSetKey(&hkey, key.data(), key.size()));
+  for (size_t size : sizes)
+  {
+    std::vector<uint8_t> data = randomBytes(size);
+
+    uint64_t blocks = HOST_sha256Blocks;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+      data[0] = (uint8_t)i;
+      oneShotHmac(key, data, output);
+      sink += output[0];
+    }
+    auto one_shot = std::chrono::steady_clock::now() - start;
+    uint64_t one_shot_blocks = (HOST_sha256Blocks - blocks) / BENCH_ITERATIONS;
+
+    blocks = HOST_sha256Blocks;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+      data[0] = (uint8_t)i;
+      Crypto_HMAC(&hkey, data.data(), data.size(), output);
+      sink += output[0];
+    }
+    auto precomputed = std::chrono::steady_clock::now() - start;
+    uint64_t precomputed_blocks = (HOST_sha256Blocks - blocks) / BENCH_ITERATIONS;
+
+    double before = std::chrono::duration<double, std::micro>(one_shot).count() / BENCH_ITERATIONS;
+    double after = std::chrono::duration<double, std::micro>(precomputed).count() / BENCH_ITERATIONS;
+    printf("  %4zu B packet: one-shot %llu blocks %.2f us, precomputed key %llu blocks %.2f us\n", size,
+           (unsigned long long)one_shot_blocks, before, (unsigned long long)precomputed_blocks, after);
+
+    // ipad and opad blocks are not hashed again for every packet
+    CHECK_EQ(one_shot_blocks - precomputed_blocks, 2);
+  }
+  Crypto_HMACFree(&hkey);
+  CHECK(sink != 0);
+}
+
+int main()
+{
+  return HOST_runTests();
+}
@@ -0,0 +1,236 @@
+// Accuracy tests of median and EWMA filters applied to sensor readings. Median is compared with sorted
+// window for every supported window size, step response and single noise spikes are checked for both
+// filters and EWMA has to settle exactly on rising and falling input. Host time per filtered reading
+// is reported.
+
+#include <Arduino.h>
+#include <filters.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "host_test.h"
+
+#define TEST_SEED        0xF17
+#define BENCH_ITERATIONS 100000
+
+static std::mt19937 rng(TEST_SEED);
+
+/**
+ * Function that filters one value of one sensor type, filter state is kept between calls
+ * @param config - Filter configuration of sensor type
+ * @param value - Raw value
+ * @param type - Sensor type
+ * @return Filtered value
+ */
+static int64_t filterValue(FLT_config config, int64_t value, sensor_type type = SOIL_TEMPERATURE_1)
+{
+  FLT_config fc[NUMBER_OF_SENSOR_TYPES] = {};
+  sensors_config sc;
+  sensor_data sd = {};
+
+  resetSensorConfig(&sc);
+  setSensorEnabled(&sc, &sensor_descriptors[type], true);
+  fc[type] = config;
+  setSensorValue(&sd, &sensor_descriptors[type], value);
+
+  FLT_apply(&sd, &sc, fc);
+  return getSensorValue(&sd, &sensor_descriptors[type]);
+}
+
+TEST(median_matches_sorted_window_for_sizes_1_to_7)
+{
+  std::uniform_int_distribution<int> dist(-3000, 3000);
+
+  for (uint8_t size = 1; size <= FLT_MAX_MEDIAN; size++)
+  {
+    std::vector<int64_t> input;
+
+    FLT_reset();
+    for (int i = 0; i < 60; i++)
+    {
+      input.push_back(dist(rng));
+
+      // window is filled up first, median of even count is the upper one
+      size_t count = std::min<size_t>(input.size(), size);
+      std::vector<int64_t> window(input.end() - count, input.end());
+      std::sort(window.begin(), window.end());
+
+      CHECK_EQ(filterValue({size, 0}, input.back()), window[count / 2]);
+    }
+  }
+}
+
+TEST(median_step_response_is_delayed_by_half_window)
+{
+  for (uint8_t size = 1; size <= FLT_MAX_MEDIAN; size++)
+  {
+    FLT_reset();
+    for (int i = 0; i < FLT_MAX_MEDIAN; i++)
+      CHECK_EQ(filterValue({size, 0}, 0), 0);
+
+    // output follows step once new values are the majority of window
+    uint8_t delay = (size - size / 2) - 1;
+    for (uint8_t i = 0; i < FLT_MAX_MEDIAN; i++)
+      CHECK_EQ(filterValue({size, 0}, 1000), i < delay ? 0 : 1000);
+  }
+}
+
+TEST(median_rejects_noise_spike)
+{
+  for (uint8_t size = 3; size <= FLT_MAX_MEDIAN; size++)
+  {
+    // spikes shorter than half of window in both directions
+    uint8_t length = (size - 1) / 2;
+
+    FLT_reset();
+    for (int i = 0; i < size; i++)
+      filterValue({size, 0}, 2000);
+    for (uint8_t i = 0; i < length; i++)
+      CHECK_EQ(filterValue({size, 0}, 30000), 2000);
+    for (int i = 0; i < size; i++)
+      CHECK_EQ(filterValue({size, 0}, 2000), 2000);
+    for (uint8_t i = 0; i < length; i++)
+      CHECK_EQ(filterValue({size, 0}, -30000), 2000);
+    CHECK_EQ(filterValue({size, 0}, 2000), 2000);
+  }
+}
+
+TEST(ewma_step_response_settles_exactly_in_both_directions)
+{
+  const int64_t levels[][2] = {{0, 1000}, {1000, 0}, {0, -1000}, {-1000, 0}, {-1000, 1000}, {1000, -1000}, {0, 1}, {0, -1}};
+
+  for (uint8_t shift = 1; shift <= FLT_MAX_EWMA_SHIFT; shift++)
+  {
+    for (const int64_t *level : levels)
+    {
+      FLT_reset();
+      // the first reading initializes filter
+      CHECK_EQ(filterValue({0, shift}, level[0]), level[0]);
+
+      int64_t previous = level[0];
+      int settled = -1;
+      for (int i = 0; i < 64 << shift; i++)
+      {
+        int64_t value = filterValue({0, shift}, level[1]);
+
+        // monotonic, no overshoot
+        if (level[1] > level[0])
+          CHECK(value >= previous && value <= level[1]);
+        else
+          CHECK(value <= previous && value >= level[1]);
+
+        if (value == level[1] && settled < 0)
+          settled = i;
+        if (settled >= 0)
+          CHECK_EQ(value, level[1]);
+        previous = value;
+      }
+      CHECK(settled >= 0);
+    }
+  }
+}
+
+TEST(ewma_follows_first_order_response)
+{
+  for (uint8_t shift = 1; shift <= FLT_MAX_EWMA_SHIFT; shift++)
+  {
+    double alpha = 1.0 / (1 << shift);
+    double expected = -2000;
+
+    FLT_reset();
+    filterValue({0, shift}, -2000);
+    for (int i = 0; i < 4 << shift; i++)
+    {
+      expected += alpha * (3000 - expected);
+      int64_t value = filterValue({0, shift}, 3000);
+      // accumulator keeps FLT_EWMA_FRAC_BITS fractional bits, result is rounded
+      CHECK(value >= (int64_t)expected - 1 && value <= (int64_t)expected + 1);
+    }
+  }
+}
+
+TEST(ewma_smooths_noise_spike)
+{
+  const uint8_t shift = 3;
+
+  FLT_reset();
+  for (int i = 0; i < 8; i++)
+    filterValue({0, shift}, 2000);
+
+  // spike is attenuated by 2^shift and decays back exactly
+  int64_t value = filterValue({0, shift}, 2800);
+  CHECK_EQ(value, 2100);
+  for (int i = 0; i < 64; i++)
+    value = filterValue({0, shift}, 2000);
+  CHECK_EQ(value, 2000);
+
+  // median in front of EWMA removes the spike completely
+  FLT_reset();
+  for (int i = 0; i < 8; i++)
+    filterValue({3, shift}, 2000);
+  CHECK_EQ(filterValue({3, shift}, 2800), 2000);
+  CHECK_EQ(filterValue({3, shift}, 2000), 2000);
+}
+
+TEST(timestamp_and_disabled_sensors_are_not_filtered)
+{
+  FLT_config fc[NUMBER_OF_SENSOR_TYPES];
+  sensors_config sc;
+  sensor_data sd = {};
+
+  for (uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+    fc[i] = {5, 2};
+
+  FLT_reset();
+  resetSensorConfig(&sc);
+  sc.timestamp = true;
+  sc.lum = true;
+  for (uint32_t i = 0; i < 10; i++)
+  {
+    sd.timestamp = 1000 + i;
+    sd.lum = 100;
+    sd.air_temp = (int16_t)(i * 100);
+    FLT_apply(&sd, &sc, fc);
+    CHECK_EQ(sd.timestamp, 1000 + i);
+    CHECK_EQ(sd.lum, 100);
+    CHECK_EQ(sd.air_temp, i * 100);
+  }
+}
+
+TEST(filter_cost_per_reading)
+{
+  FLT_config fc[NUMBER_OF_SENSOR_TYPES];
+  sensors_config sc;
+  sensor_data sd = {};
+  std::uniform_int_distribution<int> dist(-100, 100);
+  int64_t sink = 0;
+
+  FLT_reset();
+  resetSensorConfig(&sc);
+  for (uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+  {
+    setSensorEnabled(&sc, &sensor_descriptors[i], true);
+    fc[i] = {FLT_MAX_MEDIAN, 4};
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_ITERATIONS; i++)
+  {
+    sd.air_temp = 2000 + dist(rng);
+    sd.air_pres = 101325 + dist(rng);
+    sd.soil_moist_1 = 40 + dist(rng) / 10;
+    FLT_apply(&sd, &sc, fc);
+    sink += sd.air_temp;
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  printf("  median %u + EWMA 1/16 on %u sensors: %.1f ns per reading (%d)\n", FLT_MAX_MEDIAN, NUMBER_OF_SENSOR_TYPES - 1,
+         std::chrono::duration<double, std::nano>(elapsed).count() / BENCH_ITERATIONS, (int)(sink & 1));
+  CHECK(sd.air_temp > 1900 && sd.air_temp < 2100);
+}
+
+int main()
+{
+  return HOST_runTests();
+}
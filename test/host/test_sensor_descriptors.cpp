@@ -0,0 +1,306 @@
+// Round trip tests of descriptor driven sensor encoding. Every descriptor is encoded with extreme values,
+// bytes are compared with the per-field layout used before descriptors (header byte followed by little
+// endian member in sensor type order) and decoded back. Printing is checked line by line and host time
+// of descriptor encoding is reported next to the per-field reference.
+
+#include <Arduino.h>
+#include <sensors.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "host_test.h"
+
+#define BENCH_ITERATIONS 100000
+
+/**
+ * Function that encodes reading field by field in the layout used before sensor descriptors
+ * @param data - Output array, it has to hold all sensors
+ * @param sd - Sensor data
+ * @param sc - Sensor configuration
+ * @return Number of written bytes
+ */
+static uint16_t referenceEncode(uint8_t *data, const sensor_data *sd, const sensors_config *sc)
+{
+  uint16_t size = 0;
+
+#define REFERENCE_FIELD(flag, type, member) \
+  if (sc->flag) \
+  { \
+    data[size++] = (uint8_t)type; \
+    memcpy(&data[size], &sd->member, sizeof(sd->member)); \
+    size += sizeof(sd->member); \
+  }
+
+  REFERENCE_FIELD(air_temp, AIR_TEMPERATURE, air_temp)
+  REFERENCE_FIELD(air_hum, AIR_HUMIDITY, air_hum)
+  REFERENCE_FIELD(air_pres, AIR_PRESSURE, air_pres)
+  REFERENCE_FIELD(soil_temp_1, SOIL_TEMPERATURE_1, soil_temp_1)
+  REFERENCE_FIELD(soil_temp_2, SOIL_TEMPERATURE_2, soil_temp_2)
+  REFERENCE_FIELD(soil_moist_1, SOIL_MOISTURE_1, soil_moist_1)
+  REFERENCE_FIELD(soil_moist_2, SOIL_MOISTURE_2, soil_moist_2)
+  REFERENCE_FIELD(lum, LUMINOSITY, lum)
+  REFERENCE_FIELD(timestamp, TIMESTAMP, timestamp)
+#undef REFERENCE_FIELD
+
+  return size;
+}
+
+/**
+ * Function that returns test values of descriptor, limits of its width and a few ordinary values
+ * @param desc - Sensor descriptor
+ * @return Raw values that fit in descriptor width
+ */
+static std::vector<int64_t> testValues(const sensor_descriptor *desc)
+{
+  uint8_t bits = desc->width * 8;
+
+  if (desc->is_signed)
+  {
+    int64_t max = ((int64_t)1 << (bits - 1)) - 1;
+    return {-max - 1, -1, 0, 1, -(max / 3), max / 7, max};
+  }
+
+  int64_t max = ((int64_t)1 << bits) - 1;
+  return {0, 1, max / 3, max - 1, max};
+}
+
+/**
+ * Function that fills reading with value number index of every descriptor (values repeat when exhausted)
+ * @param sd - Sensor data to fill
+ * @param index - Index of value
+ */
+static void fillReading(sensor_data *sd, size_t index)
+{
+  for (uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+  {
+    std::vector<int64_t> values = testValues(&sensor_descriptors[i]);
+    setSensorValue(sd, &sensor_descriptors[i], values[index % values.size()]);
+  }
+}
+
+static void enableAll(sensors_config *sc)
+{
+  resetSensorConfig(sc);
+  for (uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+    setSensorEnabled(sc, &sensor_descriptors[i], true);
+  calculateNumberOfSensorsBytes(sc);
+}
+
+TEST(descriptors_are_ordered_by_type_and_match_members)
+{
+  const uint8_t widths[NUMBER_OF_SENSOR_TYPES] = {2, 2, 4, 2, 2, 1, 1, 2, 4};
+
+  for (uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+  {
+    CHECK_EQ(sensor_descriptors[i].type, i);
+    CHECK_EQ(sensor_descriptors[i].width, widths[i]);
+    CHECK(sensor_descriptors[i].name != nullptr && sensor_descriptors[i].unit != nullptr);
+  }
+}
+
+TEST(every_descriptor_round_trips_alone)
+{
+  for (uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+  {
+    const sensor_descriptor *desc = &sensor_descriptors[i];
+
+    for (int64_t value : testValues(desc))
+    {
+      sensors_config sc, decoded_sc;
+      sensor_data sd = {}, decoded = {};
+      uint8_t data[16];
+      uint16_t size;
+
+      resetSensorConfig(&sc);
+      setSensorEnabled(&sc, desc, true);
+      setSensorValue(&sd, desc, value);
+
+      CHECK(convertToSensorDataArray(data, sizeof(data), &size, &sd, &sc));
+      CHECK_EQ(size, HEADER_SIZE + desc->width);
+      CHECK_EQ(size, calculateNumberOfSensorsBytes(&sc));
+      CHECK_EQ(data[0], desc->type);
+      for (uint8_t b = 0; b < desc->width; b++)
+        CHECK_EQ(data[HEADER_SIZE + b], (uint8_t)(value >> (8 * b)));
+
+      CHECK(convertToSensorData(&decoded, &decoded_sc, data, size));
+      CHECK(isSensorEnabled(&decoded_sc, desc));
+      CHECK_EQ(getSensorValue(&decoded, desc), value);
+      CHECK_EQ(decoded_sc.number_of_sensors_bytes, size);
+      for (uint8_t j = 0; j < NUMBER_OF_SENSOR_TYPES; j++)
+        if (j != i)
+          CHECK(!isSensorEnabled(&decoded_sc, &sensor_descriptors[j]));
+    }
+  }
+}
+
+TEST(all_sensors_match_per_field_layout)
+{
+  sensors_config sc;
+  enableAll(&sc);
+
+  for (size_t index = 0; index < 7; index++)
+  {
+    sensors_config decoded_sc;
+    sensor_data sd = {}, decoded = {};
+    uint8_t data[64], reference[64];
+    uint16_t size;
+
+    fillReading(&sd, index);
+    uint16_t reference_size = referenceEncode(reference, &sd, &sc);
+
+    CHECK(convertToSensorDataArray(data, sizeof(data), &size, &sd, &sc));
+    CHECK_EQ(size, reference_size);
+    CHECK_EQ(size, sc.number_of_sensors_bytes);
+    CHECK(memcmp(data, reference, size) == 0);
+
+    CHECK(convertToSensorData(&decoded, &decoded_sc, data, size));
+    for (uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+    {
+      CHECK(isSensorEnabled(&decoded_sc, &sensor_descriptors[i]));
+      CHECK_EQ(getSensorValue(&decoded, &sensor_descriptors[i]), getSensorValue(&sd, &sensor_descriptors[i]));
+    }
+  }
+}
+
+TEST(encoder_rejects_short_buffer_and_decoder_rejects_bad_frames)
+{
+  sensors_config sc, decoded_sc;
+  sensor_data sd = {}, decoded;
+  uint8_t data[64];
+  uint16_t size;
+
+  enableAll(&sc);
+  fillReading(&sd, 1);
+
+  // encoder keeps one byte free, as before descriptors
+  CHECK(!convertToSensorDataArray(data, sc.number_of_sensors_bytes, &size, &sd, &sc));
+  CHECK(convertToSensorDataArray(data, sc.number_of_sensors_bytes + 1, &size, &sd, &sc));
+
+  // truncated value
+  CHECK(!convertToSensorData(&decoded, &decoded_sc, data, size - 1));
+  // unknown sensor type
+  uint8_t unknown[] = {NUMBER_OF_SENSOR_TYPES, 0x00};
+  CHECK(!convertToSensorData(&decoded, &decoded_sc, unknown, sizeof(unknown)));
+  // sensor present twice
+  uint8_t twice[] = {LUMINOSITY, 0x01, 0x00, LUMINOSITY, 0x02, 0x00};
+  CHECK(!convertToSensorData(&decoded, &decoded_sc, twice, sizeof(twice)));
+}
+
+TEST(compact_frames_round_trip_every_descriptor)
+{
+  sensors_config sc, decoded_sc;
+  enableAll(&sc);
+
+  for (size_t index = 0; index < 7; index++)
+  {
+    sensor_data sd = {}, decoded = {};
+    uint8_t data[64];
+    uint16_t size;
+
+    fillReading(&sd, index);
+    CHECK(convertToCompactSensorDataArray(data, sizeof(data), &size, &sd, &sc, COMPACT_DEFAULT_KEYFRAME_INTERVAL));
+    CHECK_EQ(data[0] & ~COMPACT_KEYFRAME, COMPACT_MARKER);
+    // the first frame is keyframe, then deltas against delivered reading
+    CHECK_EQ((data[0] & COMPACT_KEYFRAME) != 0, index == 0);
+    compactFrameDelivered(true);
+
+    CHECK(convertToSensorData(&decoded, &decoded_sc, data, size));
+    for (uint8_t i = 0; i < NUMBER_OF_SENSOR_TYPES; i++)
+    {
+      CHECK(isSensorEnabled(&decoded_sc, &sensor_descriptors[i]));
+      CHECK_EQ(getSensorValue(&decoded, &sensor_descriptors[i]), getSensorValue(&sd, &sensor_descriptors[i]));
+    }
+    CHECK_EQ(decoded_sc.number_of_sensors_bytes, sc.number_of_sensors_bytes);
+  }
+}
+
+TEST(print_shows_every_enabled_descriptor_scaled)
+{
+  sensors_config sc;
+  sensor_data sd = {};
+
+  enableAll(&sc);
+  sc.air_sensor = IC_BME280;
+  sd.air_temp = -1234;
+  sd.air_hum = 5005;
+  sd.air_pres = 101325;
+  sd.soil_temp_1 = 2107;
+  sd.soil_temp_2 = -5;
+  sd.soil_moist_1 = 42;
+  sd.soil_moist_2 = -1;
+  sd.lum = 65535;
+  sd.timestamp = 1700000000;
+
+  Serial.reset();
+  printSensorData(&sd, &sc);
+
+  CHECK(Serial.tx ==
+        "*** Sensor data ***\r\n"
+        "** BME280 **\r\n"
+        "\tAir temperature = -12.34 \xC2\xB0\x43\r\n"
+        "\tAir humidity = 50.05 %\r\n"
+        "\tAir pressure = 1013.25 mBar\r\n"
+        "\tSoil temperature 1 = 21.07 \xC2\xB0\x43\r\n"
+        "\tSoil temperature 2 = -0.05 \xC2\xB0\x43\r\n"
+        "\tSoil moisture 1 = 42 %\r\n"
+        "\tSoil moisture 2 = -1 %\r\n"
+        "\tLuminosity = 65535 lux\r\n"
+        "\tTimestamp = 1700000000 s\r\n");
+
+  // disabled sensors are not printed
+  resetSensorConfig(&sc);
+  setSensorEnabled(&sc, &sensor_descriptors[LUMINOSITY], true);
+  Serial.reset();
+  printSensorData(&sd, &sc);
+  CHECK(Serial.tx == "*** Sensor data ***\r\n\tLuminosity = 65535 lux\r\n");
+  Serial.reset();
+}
+
+TEST(encoding_cost_next_to_per_field_reference)
+{
+  sensors_config sc, decoded_sc;
+  sensor_data sd = {}, decoded;
+  uint8_t data[64];
+  uint16_t size = 0;
+  uint32_t sink = 0;
+
+  enableAll(&sc);
+  fillReading(&sd, 4);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_ITERATIONS; i++)
+  {
+    sd.timestamp = i;
+    sink += referenceEncode(data, &sd, &sc) + data[i % 20];
+  }
+  auto reference = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_ITERATIONS; i++)
+  {
+    sd.timestamp = i;
+    convertToSensorDataArray(data, sizeof(data), &size, &sd, &sc);
+    sink += size + data[i % 20];
+  }
+  auto encode = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_ITERATIONS; i++)
+  {
+    data[size - 1] = (uint8_t)i;
+    convertToSensorData(&decoded, &decoded_sc, data, size);
+    sink += decoded.timestamp;
+  }
+  auto decode = std::chrono::steady_clock::now() - start;
+
+  printf("  per reading: per-field encode %.1f ns, descriptor encode %.1f ns, descriptor decode %.1f ns (%u)\n",
+         std::chrono::duration<double, std::nano>(reference).count() / BENCH_ITERATIONS,
+         std::chrono::duration<double, std::nano>(encode).count() / BENCH_ITERATIONS,
+         std::chrono::duration<double, std::nano>(decode).count() / BENCH_ITERATIONS, sink & 1);
+  CHECK_EQ(size, sc.number_of_sensors_bytes);
+}
+
+int main()
+{
+  return HOST_runTests();
+}